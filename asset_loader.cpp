@@ -0,0 +1,270 @@
+#include <windows.h>
+#include <GdiPlus.h>
+#include "asset_loader.h"
+#include <assert.h>
+#include <chrono>
+#include <cstdio>
+
+// texel of the placeholders, mid grey
+static const unsigned char ASSET_PLACEHOLDER[4] = { 128, 128, 128, 255 };
+static const glp::TexCubeBase::CubeFace ASSET_CUBE_FACES[6] = {
+	glp::TexCubeBase::CF_X_POS, glp::TexCubeBase::CF_X_NEG,
+	glp::TexCubeBase::CF_Y_POS, glp::TexCubeBase::CF_Y_NEG,
+	glp::TexCubeBase::CF_Z_POS, glp::TexCubeBase::CF_Z_NEG };
+
+
+AssetLoader::AssetLoader()
+{
+	m_pending = 0;
+	m_stop = false;
+}
+
+AssetLoader::~AssetLoader()
+{
+	release();
+}
+
+bool AssetLoader::init(int threads)
+{
+	release();
+	if (threads <= 0)
+	{
+		fprintf(stderr, "Invalid number of asset loading threads.\n");
+		return false;
+	}
+	m_stop = false;
+	for (int a = 0; a < threads; a++)
+		m_threads.push_back(std::thread(&AssetLoader::worker_main, this));
+	return true;
+}
+
+void AssetLoader::release()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (size_t a = 0; a < m_threads.size(); ++a)
+		m_threads[a].join();
+	m_threads.clear();
+
+	for (size_t a = 0; a < m_queue.size(); ++a)
+		delete m_queue[a];
+	m_queue.clear();
+	for (size_t a = 0; a < m_finished.size(); ++a)
+		delete m_finished[a];
+	m_finished.clear();
+	m_pending = 0;
+}
+
+void AssetLoader::load_obj(Renderable* target, const wchar_t* path, bool swap_z, bool gen_tangent,
+	Done done, void* ctx)
+{
+	Job* job = new Job();
+	job->kind = ASSET_OBJ;
+	job->target = target;
+	job->paths[0] = path;
+	job->swap_z = swap_z;
+	job->gen_tangent = gen_tangent;
+	job->done = done;
+	job->ctx = ctx;
+	request(job);
+}
+
+void AssetLoader::load_tex2d(glp::Tex2D* target, const wchar_t* path, Done done, void* ctx)
+{
+	target->init();
+	target->set_image(0, 1, 1, glp::Tex::IF_RGBA, glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, ASSET_PLACEHOLDER);
+	target->gen_mipmaps();
+
+	Job* job = new Job();
+	job->kind = ASSET_TEX_2D;
+	job->target = target;
+	job->paths[0] = path;
+	job->done = done;
+	job->ctx = ctx;
+	request(job);
+}
+
+void AssetLoader::load_tex_cube(glp::TexCube* target, const wchar_t* const paths[6], Done done, void* ctx)
+{
+	target->init();
+	for (int face = 0; face < 6; face++)
+		target->set_image(0, 1, ASSET_CUBE_FACES[face],
+			glp::Tex::IF_RGBA, glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, ASSET_PLACEHOLDER);
+	target->gen_mipmaps();
+
+	Job* job = new Job();
+	job->kind = ASSET_TEX_CUBE;
+	job->target = target;
+	for (int face = 0; face < 6; face++)
+		job->paths[face] = paths[face];
+	job->done = done;
+	job->ctx = ctx;
+	request(job);
+}
+
+void AssetLoader::request(Job* job)
+{
+	job->ok = false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(job);
+		m_pending++;
+	}
+	m_wake.notify_one();
+}
+
+int AssetLoader::upload(double usec_budget)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	int uploaded = 0;
+	for (;;)
+	{
+		Job* job = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_finished.empty())
+				break;
+			job = m_finished.front();
+			m_finished.erase(m_finished.begin());
+		}
+
+		if (job->ok)
+			finish(*job);
+		if (job->done != nullptr)
+			job->done(job->ctx, job->target, job->paths[0].c_str(), job->ok);
+		delete job;
+		uploaded++;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending--;
+		}
+
+		double usec = std::chrono::duration<double, std::micro>(
+			std::chrono::steady_clock::now() - begin).count();
+		if (usec >= usec_budget)
+			break;
+	}
+	return uploaded;
+}
+
+size_t AssetLoader::get_pending() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pending;
+}
+
+void AssetLoader::worker_main()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+		if (m_stop)
+			return;
+		Job* job = m_queue.front();
+		m_queue.erase(m_queue.begin());
+
+		lock.unlock();
+		job->ok = decode(*job);
+		lock.lock();
+		m_finished.push_back(job);
+	}
+}
+
+bool AssetLoader::decode(Job& job)
+{
+	switch (job.kind)
+	{
+	case ASSET_OBJ:
+		// the renderable is not drawn before its upload
+		return static_cast<Renderable*>(job.target)->load_obj_geometry(
+			job.paths[0].c_str(), job.swap_z, job.gen_tangent);
+	case ASSET_TEX_2D:
+		return decode_image(job.paths[0].c_str(), job.images[0]);
+	case ASSET_TEX_CUBE:
+		for (int face = 0; face < 6; face++)
+		{
+			if (!decode_image(job.paths[face].c_str(), job.images[face]))
+				return false;
+			if (job.images[face].width != job.images[face].height ||
+				job.images[face].width != job.images[0].width)
+			{
+				fwprintf(stderr, L"Cube map face %ls is not square or differs in size.\n", job.paths[face].c_str());
+				return false;
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+bool AssetLoader::decode_image(const wchar_t* path, Image& image)
+{
+	Gdiplus::Bitmap bitmap(path);
+	if (bitmap.GetLastStatus() != Gdiplus::Ok || bitmap.GetWidth() == 0 || bitmap.GetHeight() == 0)
+	{
+		fwprintf(stderr, L"Can not load image %ls.\n", path);
+		return false;
+	}
+	image.width = int(bitmap.GetWidth());
+	image.height = int(bitmap.GetHeight());
+	Gdiplus::Rect rect(0, 0, image.width, image.height);
+	Gdiplus::BitmapData data;
+	if (bitmap.LockBits(&rect, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, &data) != Gdiplus::Ok)
+	{
+		fwprintf(stderr, L"Can not decode image %ls.\n", path);
+		return false;
+	}
+
+	// BGRA top row first to RGBA bottom row first
+	image.texels.resize(size_t(image.width)*image.height*4);
+	for (int y = 0; y < image.height; y++)
+	{
+		const unsigned char* src = static_cast<const unsigned char*>(data.Scan0) + ptrdiff_t(y)*data.Stride;
+		unsigned char* dst = &image.texels[size_t(image.height - 1 - y)*image.width*4];
+		for (int x = 0; x < image.width; x++, src += 4, dst += 4)
+		{
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+			dst[3] = src[3];
+		}
+	}
+	bitmap.UnlockBits(&data);
+	return true;
+}
+
+void AssetLoader::finish(Job& job)
+{
+	switch (job.kind)
+	{
+	case ASSET_OBJ:
+		static_cast<Renderable*>(job.target)->fill_buffers();
+		break;
+	case ASSET_TEX_2D:
+		{
+			glp::Tex2D* tex = static_cast<glp::Tex2D*>(job.target);
+			const Image& image = job.images[0];
+			tex->set_image(0, image.width, image.height, glp::Tex::IF_RGBA,
+				glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, &image.texels.front());
+			tex->gen_mipmaps();
+		}
+		break;
+	case ASSET_TEX_CUBE:
+		{
+			glp::TexCube* tex = static_cast<glp::TexCube*>(job.target);
+			for (int face = 0; face < 6; face++)
+			{
+				const Image& image = job.images[face];
+				tex->set_image(0, image.width, ASSET_CUBE_FACES[face], glp::Tex::IF_RGBA,
+					glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, &image.texels.front());
+			}
+			tex->gen_mipmaps();
+		}
+		break;
+	}
+	assert(glGetError() == GL_NO_ERROR);
+}
@@ -0,0 +1,94 @@
+#ifndef assetloaderH
+#define assetloaderH
+
+#include "glplus.h"
+#include "renderable.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads assets in the background. Requests are made on the GL thread:
+// textures get a 1x1 placeholder at once, meshes stay empty. Worker
+// threads read and decode the files (GDI+ images, Renderable geometry
+// with its packed buffers) and upload() does the GL part of finished
+// assets on the GL thread, as many as fit into its time budget. Targets
+// must outlive the loader or its release().
+class AssetLoader
+{
+public:
+	// called by upload() once the asset is in GL (ok) or failed to load,
+	// asset is the target of the request
+	typedef void (*Done)(void* ctx, void* asset, const wchar_t* path, bool ok);
+
+	AssetLoader();
+	~AssetLoader();
+
+	bool init(int threads = 2);
+	// stops the workers, finished and waiting requests are dropped
+	void release();
+
+	void load_obj(Renderable* target, const wchar_t* path, bool swap_z, bool gen_tangent,
+		Done done = nullptr, void* ctx = nullptr);
+	// RGBA texture with mipmaps
+	void load_tex2d(glp::Tex2D* target, const wchar_t* path,
+		Done done = nullptr, void* ctx = nullptr);
+	// faces +x, -x, +y, -y, +z, -z, uploaded together
+	void load_tex_cube(glp::TexCube* target, const wchar_t* const paths[6],
+		Done done = nullptr, void* ctx = nullptr);
+
+	// GL part of finished assets until usec_budget is spent (at least one
+	// asset if any is ready), returns the number uploaded
+	int upload(double usec_budget);
+	// requested and not uploaded yet
+	size_t get_pending() const;
+
+private:
+	AssetLoader(const AssetLoader&);
+	AssetLoader& operator=(const AssetLoader&);
+
+	enum Kind
+	{
+		ASSET_OBJ,
+		ASSET_TEX_2D,
+		ASSET_TEX_CUBE
+	};
+
+	// RGBA8, bottom row first
+	struct Image
+	{
+		int width;
+		int height;
+		std::vector<unsigned char> texels;
+	};
+
+	struct Job
+	{
+		Kind kind;
+		void* target;
+		std::wstring paths[6];
+		bool swap_z;
+		bool gen_tangent;
+		Done done;
+		void* ctx;
+		bool ok;
+		Image images[6];
+	};
+
+	void request(Job* job);
+	void worker_main();
+	static bool decode(Job& job);
+	static bool decode_image(const wchar_t* path, Image& image);
+	static void finish(Job& job);
+
+	std::vector<std::thread> m_threads;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::vector<Job*> m_queue;    // oldest first
+	std::vector<Job*> m_finished; // oldest first
+	size_t m_pending;
+	bool m_stop;
+};
+
+#endif
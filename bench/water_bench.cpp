@@ -0,0 +1,398 @@
+// Headless throughput benchmark of WaterSim.
+//
+// For every grid size and every number of steps per frame, a surface is
+// driven through update_model() with simulated time (each frame advances
+// exactly steps_per_frame steps) and touched at pseudo-random cells from a
+// fixed seed, so runs are reproducible. Reported per configuration:
+// steps/s, cells/s, effective GB/s (the fields each step has to read and
+// write once, see bytes_per_cell_step()) and p50/p99 of the average step
+// time of a frame (frame time divided by the steps it ran; steps inside
+// one update_model() are not timed separately).
+// Mode world runs a WaterWorld of grid x grid cells in chunks of
+// WORLD_CHUNK_CELLS instead, with the focus flying across it and drops
+// around the focus; its rates count the resident (simulated) cells and
+// bytes_per_cell is the resident and dormant memory per world cell.
+//
+//   water_bench [--grids 128,256,512,1024] [--steps 1,4,16] [--frames 200]
+//               [--warmup 20] [--threads 0] [--mode double|fixed|sparse|blocked|world]
+//               [--isa scalar|sse4|avx2|avx512] [--seed 1] [--format json|csv]
+//               [--out file] [--help]
+
+#include "water_sim.h"
+#include "water_world.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+struct BenchOptions
+{
+	std::vector<int> grids;
+	std::vector<int> steps;
+	int frames;
+	int warmup;
+	int threads;
+	std::string mode;
+	std::string isa;
+	unsigned seed;
+	std::string format;
+	std::string out;
+	bool help;
+};
+
+static const char* BENCH_USAGE =
+	"usage: water_bench [--grids 128,256,512,1024] [--steps 1,4,16] [--frames 200]\n"
+	"                   [--warmup 20] [--threads 0] [--mode double|fixed|sparse|blocked|world]\n"
+	"                   [--isa scalar|sse4|avx2|avx512] [--seed 1] [--format json|csv]\n"
+	"                   [--out file] [--help]\n";
+
+static const int WORLD_CHUNK_CELLS = 64;
+static const int WORLD_MAX_RESIDENT = 16;
+
+struct BenchResult
+{
+	int grid;
+	int steps_per_frame;
+	int threads;
+	uint64_t steps;
+	double seconds;
+	double steps_per_sec;
+	double cells_per_sec;
+	double gb_per_sec;
+	double p50_avg_step_usec; // frame time/steps of the frame
+	double p99_avg_step_usec;
+	double bytes_per_cell;
+};
+
+static bool parse_list(const char* text, std::vector<int>& list)
+{
+	list.clear();
+	const char* p = text;
+	while (*p != '\0')
+	{
+		char* end = nullptr;
+		long value = strtol(p, &end, 10);
+		if (end == p || value <= 0)
+			return false;
+		list.push_back(int(value));
+		p = *end == ',' ? end + 1 : end;
+	}
+	return !list.empty();
+}
+
+static bool parse_isa(const std::string& name, WaveIsa& isa)
+{
+	for (int a = 0; a < WAVE_ISA_COUNT; a++)
+		if (name == wave_isa_name(WaveIsa(a)))
+		{
+			isa = WaveIsa(a);
+			return true;
+		}
+	return false;
+}
+
+// compulsory memory traffic of one cell update: u read, v read and
+// written, u_new written (the neighbouring rows come from cache)
+static double bytes_per_cell_step(const std::string& mode)
+{
+	return mode == "fixed" ? 4.0*sizeof(short) : 4.0*sizeof(double);
+}
+
+static double percentile(std::vector<double>& samples, double p)
+{
+	if (samples.empty())
+		return 0.0;
+	size_t index = std::min(samples.size() - 1, size_t(p*(samples.size() - 1) + 0.5));
+	std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+	return samples[index];
+}
+
+static bool run_world_config(const BenchOptions& opt, int grid, int steps_per_frame, BenchResult& result)
+{
+	const uint64_t step_usec = 10000;
+	const float cell_size = 8.0f/128;
+	int chunks = std::max(1, grid/WORLD_CHUNK_CELLS);
+	WaterWorld world(chunks, chunks, WORLD_CHUNK_CELLS, cell_size, 0.4f, 0.01f, 0.995f, step_usec);
+	world.get_governor().set_unlimited();
+	if (!world.set_thread_count(opt.threads, false))
+		return false;
+	if (!opt.isa.empty())
+	{
+		WaveIsa isa;
+		if (!parse_isa(opt.isa, isa) || isa > wave_detect_isa())
+		{
+			fprintf(stderr, "ISA %s is not supported.\n", opt.isa.c_str());
+			return false;
+		}
+		world.set_isa(isa);
+	}
+	if (!world.init(WORLD_MAX_RESIDENT))
+		return false;
+
+	// the focus crosses the world diagonally once over all frames
+	float size = chunks*WORLD_CHUNK_CELLS*cell_size;
+	float radius = 1.5f*WORLD_CHUNK_CELLS*cell_size;
+	std::mt19937 rng(opt.seed);
+	std::uniform_real_distribution<float> offset(-radius, radius);
+	std::uniform_real_distribution<double> distance(4.0*cell_size, 7.0*cell_size);
+
+	std::vector<double> samples;
+	samples.reserve(opt.frames);
+	uint64_t usec_time = 0;
+	uint64_t steps = 0;
+	double cell_steps = 0.0;
+	double seconds = 0.0;
+	world.update_model(usec_time);
+	int total = opt.warmup + opt.frames;
+	for (int frame = 0; frame < total; frame++)
+	{
+		float focus = size*(frame + 0.5f)/total;
+		world.set_focus(focus, focus, radius);
+		if (frame % 4 == 0)
+			world.touch(focus + offset(rng), focus + offset(rng), 0.04, distance(rng));
+
+		usec_time += steps_per_frame*step_usec;
+		double resident = double(world.get_resident_count())*WORLD_CHUNK_CELLS*WORLD_CHUNK_CELLS;
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		world.update_model(usec_time);
+		double usec = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+
+		int run = world.get_governor().get_stats().last_steps;
+		if (frame < opt.warmup || run <= 0)
+			continue;
+		steps += run;
+		cell_steps += resident*run;
+		seconds += usec*1.0e-6;
+		samples.push_back(usec/run);
+	}
+
+	double cells = double(chunks*WORLD_CHUNK_CELLS)*double(chunks*WORLD_CHUNK_CELLS);
+	result.grid = chunks*WORLD_CHUNK_CELLS;
+	result.steps_per_frame = steps_per_frame;
+	result.threads = world.get_thread_count();
+	result.steps = steps;
+	result.seconds = seconds;
+	result.steps_per_sec = seconds > 0.0 ? steps/seconds : 0.0;
+	result.cells_per_sec = seconds > 0.0 ? cell_steps/seconds : 0.0;
+	result.gb_per_sec = result.cells_per_sec*bytes_per_cell_step(opt.mode)*1.0e-9;
+	result.p50_avg_step_usec = percentile(samples, 0.50);
+	result.p99_avg_step_usec = percentile(samples, 0.99);
+	result.bytes_per_cell = (world.get_resident_bytes() + world.get_dormant_bytes())/cells;
+	return true;
+}
+
+static bool run_config(const BenchOptions& opt, int grid, int steps_per_frame, BenchResult& result)
+{
+	if (opt.mode == "world")
+		return run_world_config(opt, grid, steps_per_frame, result);
+
+	const uint64_t step_usec = 10000;
+	WaterSim water(8.0f, 8.0f, grid, grid, 0.4f, 0.01f, 0.995f, step_usec);
+	water.get_governor().set_unlimited();
+	if (!water.set_thread_count(opt.threads, false))
+		return false;
+	if (!opt.isa.empty())
+	{
+		WaveIsa isa;
+		if (!parse_isa(opt.isa, isa) || isa > wave_detect_isa())
+		{
+			fprintf(stderr, "ISA %s is not supported.\n", opt.isa.c_str());
+			return false;
+		}
+		water.set_isa(isa);
+	}
+	if (opt.mode == "fixed" && !water.set_fixed_point(true))
+		return false;
+	if (!water.init())
+		return false;
+	if (opt.mode == "sparse" && !water.set_sparse(true))
+		return false;
+	if (opt.mode == "blocked" && !water.set_temporal_blocking(std::max(steps_per_frame, 2)))
+		return false;
+
+	std::mt19937 rng(opt.seed);
+	std::uniform_int_distribution<int> cell(1, grid);
+	std::uniform_real_distribution<double> radius(4.0, 7.0);
+
+	std::vector<double> samples;
+	samples.reserve(opt.frames);
+	uint64_t usec_time = 0;
+	uint64_t steps = 0;
+	double seconds = 0.0;
+	water.update_model(usec_time, false);
+	for (int frame = 0; frame < opt.warmup + opt.frames; frame++)
+	{
+		// a drop every few frames, like rain on the surface
+		if (frame % 4 == 0)
+			water.queue_touch(cell(rng), cell(rng), 0.04, radius(rng));
+
+		usec_time += steps_per_frame*step_usec;
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		water.update_model(usec_time, false);
+		double usec = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+
+		int run = water.get_governor().get_stats().last_steps;
+		if (frame < opt.warmup || run <= 0)
+			continue;
+		steps += run;
+		seconds += usec*1.0e-6;
+		samples.push_back(usec/run);
+	}
+
+	double cells = double(grid)*double(grid);
+	result.grid = grid;
+	result.steps_per_frame = steps_per_frame;
+	result.threads = water.get_thread_count();
+	result.steps = steps;
+	result.seconds = seconds;
+	result.steps_per_sec = seconds > 0.0 ? steps/seconds : 0.0;
+	result.cells_per_sec = result.steps_per_sec*cells;
+	result.gb_per_sec = result.cells_per_sec*bytes_per_cell_step(opt.mode)*1.0e-9;
+	result.p50_avg_step_usec = percentile(samples, 0.50);
+	result.p99_avg_step_usec = percentile(samples, 0.99);
+	result.bytes_per_cell = water.get_bytes_per_cell();
+	return true;
+}
+
+static void write_results(FILE* f, const BenchOptions& opt, const std::vector<BenchResult>& results)
+{
+	const char* isa = opt.isa.empty() ? wave_isa_name(wave_detect_isa()) : opt.isa.c_str();
+	if (opt.format == "csv")
+	{
+		fprintf(f, "mode,isa,grid,steps_per_frame,threads,steps,seconds,steps_per_sec,cells_per_sec,gb_per_sec,p50_avg_step_usec,p99_avg_step_usec,bytes_per_cell\n");
+		for (size_t a = 0; a < results.size(); ++a)
+		{
+			const BenchResult& r = results[a];
+			fprintf(f, "%s,%s,%d,%d,%d,%llu,%.6f,%.1f,%.6e,%.3f,%.2f,%.2f,%.2f\n",
+				opt.mode.c_str(), isa, r.grid, r.steps_per_frame, r.threads,
+				(unsigned long long)r.steps, r.seconds, r.steps_per_sec, r.cells_per_sec,
+				r.gb_per_sec, r.p50_avg_step_usec, r.p99_avg_step_usec, r.bytes_per_cell);
+		}
+		return;
+	}
+
+	fprintf(f, "{\n  \"mode\": \"%s\",\n  \"isa\": \"%s\",\n  \"seed\": %u,\n  \"frames\": %d,\n  \"results\": [\n",
+		opt.mode.c_str(), isa, opt.seed, opt.frames);
+	for (size_t a = 0; a < results.size(); ++a)
+	{
+		const BenchResult& r = results[a];
+		fprintf(f, "    {\"grid\": %d, \"steps_per_frame\": %d, \"threads\": %d, \"steps\": %llu, "
+			"\"seconds\": %.6f, \"steps_per_sec\": %.1f, \"cells_per_sec\": %.6e, \"gb_per_sec\": %.3f, "
+			"\"p50_avg_step_usec\": %.2f, \"p99_avg_step_usec\": %.2f, \"bytes_per_cell\": %.2f}%s\n",
+			r.grid, r.steps_per_frame, r.threads, (unsigned long long)r.steps,
+			r.seconds, r.steps_per_sec, r.cells_per_sec, r.gb_per_sec,
+			r.p50_avg_step_usec, r.p99_avg_step_usec, r.bytes_per_cell, a + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+}
+
+static bool parse_args(int argc, char** argv, BenchOptions& opt)
+{
+	for (int a = 1; a < argc; a++)
+	{
+		std::string arg = argv[a];
+		if (arg == "--help" || arg == "-h")
+		{
+			opt.help = true;
+			return true;
+		}
+		if (a + 1 >= argc)
+		{
+			fprintf(stderr, "Missing value of %s.\n%s", arg.c_str(), BENCH_USAGE);
+			return false;
+		}
+		const char* value = argv[++a];
+		bool ok = true;
+		if (arg == "--grids")
+			ok = parse_list(value, opt.grids);
+		else if (arg == "--steps")
+			ok = parse_list(value, opt.steps);
+		else if (arg == "--frames")
+			ok = (opt.frames = atoi(value)) > 0;
+		else if (arg == "--warmup")
+			ok = (opt.warmup = atoi(value)) >= 0;
+		else if (arg == "--threads")
+			ok = (opt.threads = atoi(value)) >= 0;
+		else if (arg == "--mode")
+		{
+			opt.mode = value;
+			ok = opt.mode == "double" || opt.mode == "fixed" || opt.mode == "sparse" || opt.mode == "blocked" ||
+				opt.mode == "world";
+		}
+		else if (arg == "--isa")
+			opt.isa = value;
+		else if (arg == "--seed")
+			opt.seed = unsigned(strtoul(value, nullptr, 10));
+		else if (arg == "--format")
+		{
+			opt.format = value;
+			ok = opt.format == "json" || opt.format == "csv";
+		}
+		else if (arg == "--out")
+			opt.out = value;
+		else
+			ok = false;
+		if (!ok)
+		{
+			fprintf(stderr, "Invalid argument %s %s.\n%s", arg.c_str(), value, BENCH_USAGE);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions opt;
+	opt.grids.push_back(128);
+	opt.grids.push_back(256);
+	opt.grids.push_back(512);
+	opt.grids.push_back(1024);
+	opt.steps.push_back(1);
+	opt.steps.push_back(4);
+	opt.steps.push_back(16);
+	opt.frames = 200;
+	opt.warmup = 20;
+	opt.threads = 0;
+	opt.mode = "double";
+	opt.seed = 1;
+	opt.format = "json";
+	opt.help = false;
+	if (!parse_args(argc, argv, opt))
+		return 2;
+	if (opt.help)
+	{
+		fputs(BENCH_USAGE, stdout);
+		return 0;
+	}
+
+	std::vector<BenchResult> results;
+	for (size_t g = 0; g < opt.grids.size(); ++g)
+		for (size_t s = 0; s < opt.steps.size(); ++s)
+		{
+			BenchResult r;
+			if (!run_config(opt, opt.grids[g], opt.steps[s], r))
+			{
+				fprintf(stderr, "Benchmark of grid %d failed.\n", opt.grids[g]);
+				return 1;
+			}
+			results.push_back(r);
+			fprintf(stderr, "grid %5d  steps/frame %3d  %10.1f steps/s  %7.3f GB/s  avg step p50 %8.2f us  p99 %8.2f us\n",
+				r.grid, r.steps_per_frame, r.steps_per_sec, r.gb_per_sec, r.p50_avg_step_usec, r.p99_avg_step_usec);
+		}
+
+	FILE* f = stdout;
+	if (!opt.out.empty() && (f = fopen(opt.out.c_str(), "w")) == nullptr)
+	{
+		fprintf(stderr, "Can not open %s.\n", opt.out.c_str());
+		return 1;
+	}
+	write_results(f, opt, results);
+	if (f != stdout)
+		fclose(f);
+	return 0;
+}
@@ -1,13 +1,13 @@
-#version 330
-
-uniform samplerCube cubeMap;
-
-in vec3 texcoord;
-
-out vec4 rslt;
-
-void main(void)
-{ 
-    rslt = texture(cubeMap, texcoord);
-}
+#version 330
+
+uniform samplerCube cubeMap;
+
+in vec3 texcoord;
+
+out vec4 rslt;
+
+void main(void)
+{ 
+    rslt = texture(cubeMap, texcoord);
+}
     
\ No newline at end of file
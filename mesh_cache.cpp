@@ -0,0 +1,254 @@
+#include "mesh_cache.h"
+#include "water_field.h"
+#include "water_mapped_file.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static const char MESH_CACHE_MAGIC[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+
+
+static size_t align_up(size_t bytes)
+{
+	return (bytes + WATER_FIELD_ALIGNMENT - 1)/WATER_FIELD_ALIGNMENT*WATER_FIELD_ALIGNMENT;
+}
+
+// FNV-1a
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t bytes)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	for (size_t a = 0; a < bytes; ++a)
+	{
+		hash ^= p[a];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// section of count elements at offset, aligned and within the file
+static bool section_fits(uint64_t offset, uint64_t count, size_t element, size_t file_bytes)
+{
+	return offset % WATER_FIELD_ALIGNMENT == 0 && offset <= file_bytes &&
+		count <= (file_bytes - offset)/element;
+}
+
+static bool source_stamp(const char* source, uint64_t& bytes, uint64_t& mtime)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(source, GetFileExInfoStandard, &data))
+		return false;
+	bytes = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+	mtime = (uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat st;
+	if (stat(source, &st) != 0)
+		return false;
+	bytes = uint64_t(st.st_size);
+	mtime = uint64_t(st.st_mtime);
+#endif
+	return true;
+}
+
+static bool hash_source(MeshCacheKey& key)
+{
+	if (key.source_hash != 0)
+		return true;
+	WaterMappedFile file;
+	if (!file.open(key.source.c_str()))
+		return false;
+	key.source_hash = hash_bytes(0xcbf29ce484222325ull, file.data(), file.size());
+	return true;
+}
+
+bool mesh_cache_key(const char* source, bool swap_z, bool gen_tangent, MeshCacheKey& key)
+{
+	if (!source_stamp(source, key.source_bytes, key.source_mtime))
+	{
+		fprintf(stderr, "Can not open %s.\n", source);
+		return false;
+	}
+	uint32_t options[4] = { MESH_CACHE_VERSION, uint32_t(sizeof(Vertex)), swap_z ? 1u : 0u, gen_tangent ? 1u : 0u };
+	key.options = hash_bytes(0xcbf29ce484222325ull, options, sizeof(options));
+	key.source = source;
+	key.source_hash = 0;
+	key.path = source;
+	key.path += ".cache";
+	return true;
+}
+
+bool mesh_cache_load(MeshCacheKey& key, GeomData& geometry,
+	std::vector<MeshStats>& stats, bool& has_tangents)
+{
+	const char* path = key.path.c_str();
+	// a missing cache is the normal first run, not worth a message
+	FILE* probe = fopen(path, "rb");
+	if (probe == nullptr)
+		return false;
+	fclose(probe);
+
+	WaterMappedFile file;
+	if (!file.open(path))
+		return false;
+	const MeshCacheHeader* header = static_cast<const MeshCacheHeader*>(file.data());
+	if (file.size() < sizeof(MeshCacheHeader) ||
+		memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != MESH_CACHE_VERSION || header->header_bytes != sizeof(MeshCacheHeader) ||
+		header->vertex_bytes != sizeof(Vertex) || header->file_bytes != file.size())
+	{
+		fprintf(stderr, "%s is not a supported mesh cache, rebuilding it.\n", path);
+		return false;
+	}
+	if (header->options != key.options || header->source_bytes != key.source_bytes)
+		return false;
+	// same size, other time: the source is hashed to tell an edit from a touch
+	bool touched = header->source_mtime != key.source_mtime;
+	if (touched && (!hash_source(key) || header->source_hash != key.source_hash))
+		return false;
+
+	size_t file_bytes = file.size();
+	if (!section_fits(header->mesh_offset, header->mesh_count, sizeof(MeshCacheMesh), file_bytes) ||
+		!section_fits(header->vertex_offset, header->vertex_count, sizeof(Vertex), file_bytes) ||
+		!section_fits(header->triangle_offset, header->triangle_count, sizeof(Triangle), file_bytes) ||
+		!section_fits(header->quad_offset, header->quad_count, sizeof(Quad), file_bytes) ||
+		header->name_offset > file_bytes)
+	{
+		fprintf(stderr, "Mesh cache %s is damaged, rebuilding it.\n", path);
+		return false;
+	}
+	const char* base = static_cast<const char*>(file.data());
+	const MeshCacheMesh* meshes = reinterpret_cast<const MeshCacheMesh*>(base + header->mesh_offset);
+	const Vertex* vertices = reinterpret_cast<const Vertex*>(base + header->vertex_offset);
+	const Triangle* triangles = reinterpret_cast<const Triangle*>(base + header->triangle_offset);
+	const Quad* quads = reinterpret_cast<const Quad*>(base + header->quad_offset);
+	const char* names = base + header->name_offset;
+	uint64_t name_bytes = file_bytes - header->name_offset;
+	for (uint64_t m = 0; m < header->mesh_count; ++m)
+		if (meshes[m].triangle_count > header->triangle_count ||
+			meshes[m].first_triangle > header->triangle_count - meshes[m].triangle_count ||
+			meshes[m].quad_count > header->quad_count ||
+			meshes[m].first_quad > header->quad_count - meshes[m].quad_count ||
+			meshes[m].name_bytes > name_bytes ||
+			meshes[m].name_offset > name_bytes - meshes[m].name_bytes)
+		{
+			fprintf(stderr, "Mesh cache %s is damaged, rebuilding it.\n", path);
+			return false;
+		}
+
+	geometry.v.assign(vertices, vertices + header->vertex_count);
+	geometry.m.reserve(geometry.m.size() + size_t(header->mesh_count));
+	stats.resize(size_t(header->mesh_count));
+	for (uint64_t m = 0; m < header->mesh_count; ++m)
+	{
+		const MeshCacheMesh& src = meshes[m];
+		std::string name(names + src.name_offset, size_t(src.name_bytes));
+		Mesh* mesh = new Mesh(name.c_str());
+		mesh->t.assign(triangles + src.first_triangle, triangles + src.first_triangle + src.triangle_count);
+		mesh->q.assign(quads + src.first_quad, quads + src.first_quad + src.quad_count);
+		geometry.m.push_back(mesh);
+
+		stats[m].triangles = size_t(src.triangle_count);
+		stats[m].acmr_loaded = src.acmr_loaded;
+		stats[m].acmr_optimized = src.acmr_optimized;
+		stats[m].index_bytes = size_t(src.index_bytes);
+	}
+	has_tangents = header->has_tangents != 0;
+	file.close();
+
+	// the next start compares the new time stamp and skips the hash
+	if (touched)
+	{
+		FILE* f = fopen(path, "r+b");
+		if (f != nullptr)
+		{
+			if (fseek(f, long(offsetof(MeshCacheHeader, source_mtime)), SEEK_SET) == 0)
+				fwrite(&key.source_mtime, sizeof(key.source_mtime), 1, f);
+			fclose(f);
+		}
+	}
+	return true;
+}
+
+bool mesh_cache_save(MeshCacheKey& key, const GeomData& geometry,
+	const std::vector<MeshStats>& stats, bool has_tangents)
+{
+	if (!hash_source(key))
+		return false;
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.header_bytes = sizeof(MeshCacheHeader);
+	header.vertex_bytes = sizeof(Vertex);
+	header.has_tangents = has_tangents ? 1 : 0;
+	header.options = key.options;
+	header.source_bytes = key.source_bytes;
+	header.source_mtime = key.source_mtime;
+	header.source_hash = key.source_hash;
+	header.vertex_count = geometry.v.size();
+	header.mesh_count = geometry.m.size();
+	size_t name_bytes = 0;
+	for (size_t m = 0; m < geometry.m.size(); ++m)
+	{
+		header.triangle_count += geometry.m[m]->t.size();
+		header.quad_count += geometry.m[m]->q.size();
+		name_bytes += geometry.m[m]->material_name.size();
+	}
+	header.mesh_offset = align_up(sizeof(MeshCacheHeader));
+	header.vertex_offset = align_up(size_t(header.mesh_offset) + geometry.m.size()*sizeof(MeshCacheMesh));
+	header.triangle_offset = align_up(size_t(header.vertex_offset) + geometry.v.size()*sizeof(Vertex));
+	header.quad_offset = align_up(size_t(header.triangle_offset) + size_t(header.triangle_count)*sizeof(Triangle));
+	header.name_offset = align_up(size_t(header.quad_offset) + size_t(header.quad_count)*sizeof(Quad));
+	header.file_bytes = header.name_offset + name_bytes;
+
+	WaterMappedFile file;
+	if (!file.create(key.path.c_str(), size_t(header.file_bytes)))
+		return false;
+	char* base = static_cast<char*>(file.data());
+	MeshCacheMesh* meshes = reinterpret_cast<MeshCacheMesh*>(base + header.mesh_offset);
+	if (!geometry.v.empty())
+		memcpy(base + header.vertex_offset, &geometry.v.front(), geometry.v.size()*sizeof(Vertex));
+	Triangle* triangles = reinterpret_cast<Triangle*>(base + header.triangle_offset);
+	Quad* quads = reinterpret_cast<Quad*>(base + header.quad_offset);
+	char* names = base + header.name_offset;
+	size_t triangle = 0, quad = 0, name = 0;
+	for (size_t m = 0; m < geometry.m.size(); ++m)
+	{
+		const Mesh& src = *geometry.m[m];
+		MeshCacheMesh& dst = meshes[m];
+		memset(&dst, 0, sizeof(dst));
+		dst.first_triangle = triangle;
+		dst.triangle_count = src.t.size();
+		dst.first_quad = quad;
+		dst.quad_count = src.q.size();
+		dst.name_offset = name;
+		dst.name_bytes = src.material_name.size();
+		if (m < stats.size())
+		{
+			dst.index_bytes = stats[m].index_bytes;
+			dst.acmr_loaded = stats[m].acmr_loaded;
+			dst.acmr_optimized = stats[m].acmr_optimized;
+		}
+		if (!src.t.empty())
+			memcpy(triangles + triangle, &src.t.front(), src.t.size()*sizeof(Triangle));
+		if (!src.q.empty())
+			memcpy(quads + quad, &src.q.front(), src.q.size()*sizeof(Quad));
+		memcpy(names + name, src.material_name.data(), src.material_name.size());
+		triangle += src.t.size();
+		quad += src.q.size();
+		name += src.material_name.size();
+	}
+	// header last, so an interrupted write leaves no valid cache
+	memcpy(base, &header, sizeof(header));
+	file.close();
+	return true;
+}
@@ -0,0 +1,77 @@
+#ifndef meshcacheH
+#define meshcacheH
+
+#include "renderable.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary cache of a loaded OBJ: the final (optimized) Vertex array, the
+// triangles and quads of all meshes in one array each with a range per
+// mesh, and the mesh stats. It sits next to the source as
+// <source>.cache and is keyed by the loader options and the source: its
+// size and modification time are compared first, the source bytes are
+// hashed only when those differ, so an unchanged source costs one stat
+// and an edited source or other options rebuild the cache.
+// Sections start on WATER_FIELD_ALIGNMENT and are read straight from the
+// mapping. Values are in native byte order.
+
+static const uint32_t MESH_CACHE_VERSION = 2;
+
+struct MeshCacheHeader
+{
+	char magic[8];          // "MESHCACH"
+	uint32_t version;
+	uint32_t header_bytes;  // sizeof(MeshCacheHeader)
+	uint32_t vertex_bytes;  // sizeof(Vertex)
+	uint32_t has_tangents;
+	uint64_t options;       // MeshCacheKey::options
+	uint64_t source_bytes;
+	uint64_t source_mtime;
+	uint64_t source_hash;
+	uint64_t vertex_count;
+	uint64_t triangle_count;
+	uint64_t quad_count;
+	uint64_t mesh_count;
+	uint64_t mesh_offset;   // MeshCacheMesh[mesh_count]
+	uint64_t vertex_offset;
+	uint64_t triangle_offset;
+	uint64_t quad_offset;
+	uint64_t name_offset;   // material names, not terminated
+	uint64_t file_bytes;
+};
+
+struct MeshCacheMesh
+{
+	uint64_t first_triangle;
+	uint64_t triangle_count;
+	uint64_t first_quad;
+	uint64_t quad_count;
+	uint64_t name_offset;   // from MeshCacheHeader::name_offset
+	uint64_t name_bytes;
+	uint64_t index_bytes;   // MeshStats
+	double acmr_loaded;
+	double acmr_optimized;
+};
+
+struct MeshCacheKey
+{
+	std::string source;
+	std::string path;       // of the cache
+	uint64_t options;       // hash of the loader options and cache format
+	uint64_t source_bytes;
+	uint64_t source_mtime;  // in units of the platform file time
+	uint64_t source_hash;   // FNV-1a of the source, 0 until computed
+};
+
+// cache path and key of source loaded with the given options, false if
+// the source can not be found (then there is no cache either)
+bool mesh_cache_key(const char* source, bool swap_z, bool gen_tangent, MeshCacheKey& key);
+// fills geometry, stats and has_tangents if the cache of key is valid;
+// a cache whose source was only touched gets the new time stamp
+bool mesh_cache_load(MeshCacheKey& key, GeomData& geometry,
+	std::vector<MeshStats>& stats, bool& has_tangents);
+bool mesh_cache_save(MeshCacheKey& key, const GeomData& geometry,
+	const std::vector<MeshStats>& stats, bool has_tangents);
+
+#endif
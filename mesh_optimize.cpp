@@ -0,0 +1,163 @@
+#include "mesh_optimize.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+
+static float mesh_vertex_score(int cache_pos, unsigned live_triangles, int cache_size)
+{
+	if (live_triangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cache_pos >= 0 && cache_pos < 3)
+	{
+		// the last triangle's vertices: fixed score, so that strips are
+		// not favoured over fans
+		score = 0.75f;
+	}
+	else if (cache_pos >= 3 && cache_pos < cache_size)
+	{
+		float scaled = 1.0f - float(cache_pos - 3)/float(cache_size - 3);
+		score = std::pow(scaled, 1.5f);
+	}
+	// vertices with few triangles left are finished first
+	return score + 2.0f/std::sqrt(float(live_triangles));
+}
+
+void mesh_optimize_triangles(unsigned* indices, size_t index_count, size_t vertex_count,
+	int cache_size)
+{
+	size_t triangles = index_count/3;
+	if (triangles == 0)
+		return;
+	cache_size = std::max(cache_size, 4);
+
+	// triangles of every vertex, the live ones first
+	std::vector<unsigned> offsets(vertex_count + 1, 0);
+	for (size_t a = 0; a < triangles*3; ++a)
+		offsets[indices[a] + 1]++;
+	for (size_t v = 0; v < vertex_count; ++v)
+		offsets[v + 1] += offsets[v];
+	std::vector<unsigned> adjacency(triangles*3);
+	std::vector<unsigned> live(vertex_count, 0);
+	for (size_t t = 0; t < triangles; ++t)
+		for (int k = 0; k < 3; ++k)
+		{
+			unsigned v = indices[3*t + k];
+			adjacency[offsets[v] + live[v]++] = unsigned(t);
+		}
+
+	std::vector<int> cache_pos(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+	for (size_t v = 0; v < vertex_count; ++v)
+		vertex_score[v] = mesh_vertex_score(-1, live[v], cache_size);
+	std::vector<char> emitted(triangles, 0);
+
+	std::vector<unsigned> order;
+	order.reserve(triangles*3);
+	std::vector<unsigned> cache;
+	std::vector<unsigned> new_cache;
+	cache.reserve(cache_size + 3);
+	new_cache.reserve(cache_size + 3);
+
+	size_t scan = 0; // triangles before it are emitted
+	long long best = -1;
+	while (order.size() < triangles*3)
+	{
+		if (best < 0)
+		{
+			// nothing left around the cache: next triangle in input order
+			while (emitted[scan])
+				scan++;
+			best = (long long)scan;
+		}
+		size_t t = size_t(best);
+		emitted[t] = 1;
+
+		// the triangle's vertices move to the front of the cache
+		new_cache.clear();
+		for (int k = 0; k < 3; ++k)
+		{
+			unsigned v = indices[3*t + k];
+			order.push_back(v);
+			new_cache.push_back(v);
+
+			// drop t from the live triangles of v
+			unsigned* first = &adjacency[offsets[v]];
+			unsigned* last = first + live[v] - 1;
+			*std::find(first, last + 1, unsigned(t)) = *last;
+			*last = unsigned(t);
+			live[v]--;
+		}
+		for (size_t a = 0; a < cache.size(); ++a)
+			if (cache[a] != new_cache[0] && cache[a] != new_cache[1] && cache[a] != new_cache[2])
+				new_cache.push_back(cache[a]);
+
+		// scores of the cached and the evicted vertices, then of their
+		// triangles; the best of those is emitted next
+		for (size_t a = 0; a < new_cache.size(); ++a)
+		{
+			unsigned v = new_cache[a];
+			cache_pos[v] = a < size_t(cache_size) ? int(a) : -1;
+			vertex_score[v] = mesh_vertex_score(cache_pos[v], live[v], cache_size);
+		}
+		best = -1;
+		float best_score = -1.0f;
+		for (size_t a = 0; a < new_cache.size(); ++a)
+		{
+			unsigned v = new_cache[a];
+			for (unsigned n = 0; n < live[v]; ++n)
+			{
+				unsigned u = adjacency[offsets[v] + n];
+				float score = vertex_score[indices[3*u]] + vertex_score[indices[3*u + 1]] +
+					vertex_score[indices[3*u + 2]];
+				if (score > best_score)
+				{
+					best_score = score;
+					best = u;
+				}
+			}
+		}
+		if (new_cache.size() > size_t(cache_size))
+			new_cache.resize(cache_size);
+		cache.swap(new_cache);
+	}
+	std::copy(order.begin(), order.end(), indices);
+}
+
+unsigned mesh_remap_by_first_use(unsigned* indices, size_t index_count,
+	std::vector<unsigned>& remap, unsigned next)
+{
+	for (size_t a = 0; a < index_count; ++a)
+	{
+		unsigned& target = remap[indices[a]];
+		if (target == UINT_MAX)
+			target = next++;
+		indices[a] = target;
+	}
+	return next;
+}
+
+double mesh_acmr(const unsigned* indices, size_t index_count, size_t vertex_count,
+	int cache_size)
+{
+	size_t triangles = index_count/3;
+	if (triangles == 0)
+		return 0.0;
+
+	// FIFO: a vertex is in the cache while fewer than cache_size misses
+	// happened since its own
+	std::vector<size_t> stamp(vertex_count, 0);
+	size_t misses = 0;
+	for (size_t a = 0; a < triangles*3; ++a)
+	{
+		size_t& s = stamp[indices[a]];
+		if (s == 0 || misses - s >= size_t(cache_size))
+		{
+			misses++;
+			s = misses;
+		}
+	}
+	return double(misses)/double(triangles);
+}
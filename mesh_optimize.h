@@ -0,0 +1,29 @@
+#ifndef meshoptimizeH
+#define meshoptimizeH
+
+#include <cstddef>
+#include <vector>
+
+// Load-time reordering of indexed triangle lists (no GL dependency).
+// Indices are unsigned ints, three per triangle.
+
+// Reorders the triangles for the post-transform vertex cache with Tom
+// Forsyth's linear-speed algorithm (LRU cache model of cache_size
+// entries); vertices are not renumbered.
+void mesh_optimize_triangles(unsigned* indices, size_t index_count, size_t vertex_count,
+	int cache_size = 32);
+
+// Renumbers the vertices in order of first use (vertex fetch locality).
+// remap maps old to new numbers, UINT_MAX for vertices not used yet;
+// numbering continues from next, so several index lists sharing one
+// vertex array can be processed in turn. Returns the next free number.
+unsigned mesh_remap_by_first_use(unsigned* indices, size_t index_count,
+	std::vector<unsigned>& remap, unsigned next);
+
+// average cache miss ratio: vertices transformed per triangle with a
+// FIFO cache of cache_size entries (0.5 is ideal for large grids, 3 the
+// worst case)
+double mesh_acmr(const unsigned* indices, size_t index_count, size_t vertex_count,
+	int cache_size = 16);
+
+#endif
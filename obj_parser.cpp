@@ -0,0 +1,401 @@
+#include "obj_parser.h"
+#include "thread_pool.h"
+#include "water_mapped_file.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// below this a single chunk is parsed on the calling thread
+static const size_t OBJ_PARALLEL_BYTES = 256*1024;
+
+
+namespace {
+
+struct ChunkGroup
+{
+	std::string material_name;
+	size_t first_face;         // in the chunk
+};
+
+struct Chunk
+{
+	const char* begin;
+	const char* end;
+	std::vector<float> positions;
+	std::vector<float> tex_coords;
+	std::vector<float> normals;
+	std::vector<ObjCorner> corners;
+	std::vector<size_t> faces;      // first corner of every face
+	std::vector<ChunkGroup> groups;
+	// components (3*corner + k) given relative to the end of the list,
+	// resolved once the counts of the preceding chunks are known
+	std::vector<size_t> relative;
+	size_t line;                    // first line failing to parse, 0 if none
+
+	// offsets of the chunk in the merged arrays
+	size_t position_base;
+	size_t tex_coord_base;
+	size_t normal_base;
+	size_t corner_base;
+	size_t face_base;
+};
+
+struct ParseTask
+{
+	std::vector<Chunk>* chunks;
+	ObjData* obj;
+};
+
+}
+
+static inline bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* skip_space(const char* p, const char* end)
+{
+	while (p < end && is_space(*p))
+		++p;
+	return p;
+}
+
+// decimal float with optional sign, fraction and exponent; nullptr if
+// there is no number at p
+static const char* parse_float(const char* p, const char* end, float& value)
+{
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	// 19 digits fit into the mantissa, the rest only scale it
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+	for (; p < end && unsigned(*p - '0') < 10; ++p, any = true)
+		if (digits < 19)
+		{
+			mantissa = mantissa*10 + unsigned(*p - '0');
+			digits += mantissa != 0;
+		}
+		else
+			exponent++;
+	if (p < end && *p == '.')
+		for (++p; p < end && unsigned(*p - '0') < 10; ++p, any = true)
+			if (digits < 19)
+			{
+				mantissa = mantissa*10 + unsigned(*p - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+	if (!any)
+		return nullptr;
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* q = p + 1;
+		bool exponent_negative = false;
+		if (q < end && (*q == '-' || *q == '+'))
+			exponent_negative = *q++ == '-';
+		if (q < end && unsigned(*q - '0') < 10)
+		{
+			int e = 0;
+			for (; q < end && unsigned(*q - '0') < 10; ++q)
+				if (e < 10000)
+					e = e*10 + (*q - '0');
+			exponent += exponent_negative ? -e : e;
+			p = q;
+		}
+	}
+
+	double result = double(mantissa);
+	if (exponent < 0 && exponent >= -22)
+		result /= powers[-exponent];
+	else if (exponent > 0 && exponent <= 22)
+		result *= powers[exponent];
+	else if (exponent != 0)
+		result *= std::pow(10.0, double(exponent));
+	value = float(negative ? -result : result);
+	return p;
+}
+
+static const char* parse_int(const char* p, const char* end, int32_t& value)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	if (p >= end || unsigned(*p - '0') >= 10)
+		return nullptr;
+	int64_t v = 0;
+	for (; p < end && unsigned(*p - '0') < 10; ++p)
+		if (v < INT32_MAX)
+			v = v*10 + (*p - '0');
+	if (v > INT32_MAX)
+		v = INT32_MAX;
+	value = int32_t(negative ? -v : v);
+	return p;
+}
+
+// up to count floats, further ones (w of v, w of vt) are ignored
+static const char* parse_floats(const char* p, const char* end, std::vector<float>& out, int count)
+{
+	for (int k = 0; k < count; ++k)
+	{
+		p = skip_space(p, end);
+		float value;
+		const char* q = parse_float(p, end, value);
+		if (q == nullptr)
+		{
+			// vt may have only u
+			if (k == 0)
+				return nullptr;
+			value = 0.0f;
+		}
+		else
+			p = q;
+		out.push_back(value);
+	}
+	return p;
+}
+
+// 0-based index (1-based or negative from the end in the file) given
+// count elements before it in the chunk; component is 3*corner + k
+static int32_t resolve_index(Chunk& chunk, int32_t index, size_t count, size_t component)
+{
+	if (index > 0)
+		return index - 1;
+	chunk.relative.push_back(component);
+	return int32_t(int64_t(count) + index);
+}
+
+static const char* parse_face(Chunk& chunk, const char* p, const char* end)
+{
+	size_t first = chunk.corners.size();
+	for (;;)
+	{
+		p = skip_space(p, end);
+		if (p >= end || *p == '\n' || *p == '#')
+			break;
+		ObjCorner corner = { -1, -1, -1 };
+		int32_t index[3] = { 0, 0, 0 };
+		p = parse_int(p, end, index[0]);
+		if (p == nullptr || index[0] == 0)
+			return nullptr;
+		for (int k = 1; k < 3 && p < end && *p == '/'; ++k)
+		{
+			++p;
+			if (p < end && (*p == '/' || is_space(*p) || *p == '\n'))
+				continue; // a//c
+			p = parse_int(p, end, index[k]);
+			if (p == nullptr || index[k] == 0)
+				return nullptr;
+		}
+		size_t component = 3*chunk.corners.size();
+		corner.position = resolve_index(chunk, index[0], chunk.positions.size()/3, component);
+		if (index[1] != 0)
+			corner.tex_coord = resolve_index(chunk, index[1], chunk.tex_coords.size()/2, component + 1);
+		if (index[2] != 0)
+			corner.normal = resolve_index(chunk, index[2], chunk.normals.size()/3, component + 2);
+		chunk.corners.push_back(corner);
+	}
+	if (chunk.corners.size() - first < 3)
+		return nullptr;
+	chunk.faces.push_back(first);
+	return p;
+}
+
+static void parse_chunk(Chunk& chunk)
+{
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+	size_t line = 0;
+	while (p < end)
+	{
+		++line;
+		p = skip_space(p, end);
+		const char* q = p;
+		if (p + 1 < end && p[0] == 'v' && is_space(p[1]))
+			q = parse_floats(p + 1, end, chunk.positions, 3);
+		else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && is_space(p[2]))
+			q = parse_floats(p + 2, end, chunk.tex_coords, 2);
+		else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && is_space(p[2]))
+			q = parse_floats(p + 2, end, chunk.normals, 3);
+		else if (p + 1 < end && p[0] == 'f' && is_space(p[1]))
+			q = parse_face(chunk, p + 1, end);
+		else if (end - p > 6 && memcmp(p, "usemtl", 6) == 0 && is_space(p[6]))
+		{
+			const char* name = skip_space(p + 6, end);
+			const char* name_end = name;
+			while (name_end < end && *name_end != '\n')
+				++name_end;
+			while (name_end > name && is_space(name_end[-1]))
+				--name_end;
+			ChunkGroup group;
+			group.material_name.assign(name, name_end);
+			group.first_face = chunk.faces.size();
+			chunk.groups.push_back(group);
+			q = name_end;
+		}
+		if (q == nullptr)
+		{
+			chunk.line = line;
+			return;
+		}
+		const char* next = static_cast<const char*>(memchr(q, '\n', size_t(end - q)));
+		p = next ? next + 1 : end;
+	}
+}
+
+static void parse_task(void* ctx, int worker, int workers)
+{
+	ParseTask* task = static_cast<ParseTask*>(ctx);
+	for (size_t c = size_t(worker); c < task->chunks->size(); c += size_t(workers))
+		parse_chunk((*task->chunks)[c]);
+}
+
+static void copy_task(void* ctx, int worker, int workers)
+{
+	ParseTask* task = static_cast<ParseTask*>(ctx);
+	ObjData& obj = *task->obj;
+	for (size_t c = size_t(worker); c < task->chunks->size(); c += size_t(workers))
+	{
+		Chunk& chunk = (*task->chunks)[c];
+		// resolve relative indices before the corners move
+		for (size_t a = 0; a < chunk.relative.size(); ++a)
+		{
+			size_t r = chunk.relative[a];
+			ObjCorner& corner = chunk.corners[r/3];
+			int32_t& index = r % 3 == 0 ? corner.position : r % 3 == 1 ? corner.tex_coord : corner.normal;
+			size_t base = r % 3 == 0 ? chunk.position_base : r % 3 == 1 ? chunk.tex_coord_base : chunk.normal_base;
+			index += int32_t(base);
+			// before the first element: out of range, not "none"
+			if (index < 0)
+				index = INT32_MAX;
+		}
+		if (!chunk.positions.empty())
+			memcpy(&obj.positions[3*chunk.position_base], &chunk.positions.front(), chunk.positions.size()*sizeof(float));
+		if (!chunk.tex_coords.empty())
+			memcpy(&obj.tex_coords[2*chunk.tex_coord_base], &chunk.tex_coords.front(), chunk.tex_coords.size()*sizeof(float));
+		if (!chunk.normals.empty())
+			memcpy(&obj.normals[3*chunk.normal_base], &chunk.normals.front(), chunk.normals.size()*sizeof(float));
+		if (!chunk.corners.empty())
+			memcpy(&obj.corners[chunk.corner_base], &chunk.corners.front(), chunk.corners.size()*sizeof(ObjCorner));
+		for (size_t a = 0; a < chunk.faces.size(); ++a)
+			obj.faces[chunk.face_base + a] = chunk.corner_base + chunk.faces[a];
+		// the copies are not needed any more
+		std::vector<float>().swap(chunk.positions);
+		std::vector<float>().swap(chunk.tex_coords);
+		std::vector<float>().swap(chunk.normals);
+		std::vector<ObjCorner>().swap(chunk.corners);
+	}
+}
+
+bool obj_parse(const char* path, ObjData& obj, int threads)
+{
+	WaterMappedFile file;
+	if (!file.open(path))
+		return false;
+	const char* data = static_cast<const char*>(file.data());
+	size_t size = file.size();
+
+	ThreadPool pool;
+	int workers = 1;
+	if (size >= OBJ_PARALLEL_BYTES && threads != 1 && pool.init(threads, false))
+		workers = pool.get_thread_count();
+	std::vector<Chunk> chunks(static_cast<size_t>(workers));
+	const char* begin = data;
+	for (int c = 0; c < workers; ++c)
+	{
+		const char* end = data + size*size_t(c + 1)/size_t(workers);
+		if (end < begin)
+			end = begin;
+		// chunks end after a line break
+		const char* next = c + 1 < workers ? static_cast<const char*>(memchr(end, '\n', size_t(data + size - end))) : nullptr;
+		end = next ? next + 1 : data + size;
+		chunks[c].begin = begin;
+		chunks[c].end = end;
+		chunks[c].line = 0;
+		begin = end;
+	}
+
+	ParseTask task = { &chunks, &obj };
+	if (workers > 1)
+		pool.run(parse_task, &task);
+	else
+		parse_task(&task, 0, 1);
+
+	// place the chunks and join the groups; a chunk starting without
+	// usemtl continues the group of the one before
+	size_t positions = 0, tex_coords = 0, normals = 0, corners = 0, faces = 0, lines = 0;
+	obj.groups.clear();
+	for (size_t c = 0; c < chunks.size(); ++c)
+	{
+		Chunk& chunk = chunks[c];
+		if (chunk.line != 0)
+		{
+			// lines of earlier chunks are only counted on failure
+			for (size_t b = 0; b < c; ++b)
+				lines += size_t(std::count(chunks[b].begin, chunks[b].end, '\n'));
+			fprintf(stderr, "Invalid record at line %u of %s.\n", unsigned(lines + chunk.line), path);
+			return false;
+		}
+		chunk.position_base = positions;
+		chunk.tex_coord_base = tex_coords;
+		chunk.normal_base = normals;
+		chunk.corner_base = corners;
+		chunk.face_base = faces;
+		if (obj.groups.empty() && (chunk.groups.empty() ? !chunk.faces.empty() : chunk.groups.front().first_face != 0))
+		{
+			ObjGroup group = { std::string(), 0, 0 };
+			obj.groups.push_back(group);
+		}
+		for (size_t g = 0; g < chunk.groups.size(); ++g)
+		{
+			ObjGroup group = { chunk.groups[g].material_name, faces + chunk.groups[g].first_face, 0 };
+			obj.groups.push_back(group);
+		}
+		positions += chunk.positions.size()/3;
+		tex_coords += chunk.tex_coords.size()/2;
+		normals += chunk.normals.size()/3;
+		corners += chunk.corners.size();
+		faces += chunk.faces.size();
+	}
+	size_t kept = 0;
+	for (size_t g = 0; g < obj.groups.size(); ++g)
+	{
+		size_t next = g + 1 < obj.groups.size() ? obj.groups[g + 1].first_face : faces;
+		obj.groups[g].face_count = next - obj.groups[g].first_face;
+		if (obj.groups[g].face_count != 0)
+			obj.groups[kept++] = obj.groups[g];
+	}
+	obj.groups.resize(kept);
+
+	obj.positions.resize(3*positions);
+	obj.tex_coords.resize(2*tex_coords);
+	obj.normals.resize(3*normals);
+	obj.corners.resize(corners);
+	obj.faces.resize(faces + 1);
+	obj.faces[faces] = corners;
+	if (workers > 1)
+		pool.run(copy_task, &task);
+	else
+		copy_task(&task, 0, 1);
+
+	for (size_t a = 0; a < obj.corners.size(); ++a)
+	{
+		const ObjCorner& corner = obj.corners[a];
+		if (corner.position < 0 || size_t(corner.position) >= positions ||
+			corner.tex_coord >= int32_t(tex_coords) || corner.normal >= int32_t(normals) ||
+			corner.tex_coord < -1 || corner.normal < -1)
+		{
+			fprintf(stderr, "Face index out of range in %s.\n", path);
+			return false;
+		}
+	}
+	return true;
+}
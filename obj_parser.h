@@ -0,0 +1,43 @@
+#ifndef objparserH
+#define objparserH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Wavefront OBJ read into flat arrays: v, vt, vn and f records and the
+// material groups (usemtl), everything else is skipped. The file is
+// mapped and split into one chunk per worker on line boundaries; the
+// chunks are parsed in parallel and copied into place afterwards.
+
+struct ObjCorner
+{
+	int32_t position;  // 0-based indices, -1 if the face gives none
+	int32_t tex_coord;
+	int32_t normal;
+};
+
+// faces after one usemtl
+struct ObjGroup
+{
+	std::string material_name;
+	size_t first_face;
+	size_t face_count;
+};
+
+struct ObjData
+{
+	std::vector<float> positions;  // x, y, z
+	std::vector<float> tex_coords; // u, v
+	std::vector<float> normals;    // x, y, z
+	std::vector<ObjCorner> corners;
+	std::vector<size_t> faces;     // first corner of every face and the end
+	std::vector<ObjGroup> groups;  // without empty ones
+};
+
+// threads as for ThreadPool::init() (0: one per hardware thread); small
+// files are parsed on the calling thread only
+bool obj_parse(const char* path, ObjData& obj, int threads = 0);
+
+#endif
@@ -0,0 +1,112 @@
+#include "render_queue.h"
+#include "render_stats.h"
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+
+
+void RenderQueue::add(const glp::Program& program, const Renderable& renderable,
+	const math::Mat4x4f& model, const math::Mat4x4f& view)
+{
+	Item item;
+	item.program = &program;
+	item.renderable = &renderable;
+	// short points are decoded by the model matrix
+	item.model = model*renderable.get_point_transform();
+	item.model_view = view*item.model;
+
+	// distance along the view direction of the model origin; the bits of
+	// a non-negative float sort like its value
+	float depth = std::max(-item.model_view.m[11], 0.0f);
+	uint32_t depth_bits;
+	memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+	uint64_t key = state_id(&program, 0xff) << 56 |
+		state_id(&renderable.get_vertex_array(), 0xffff) << 24 |
+		uint64_t(depth_bits >> 8);
+	const GeomData& geometry = renderable.getGeometry();
+	for (size_t a = 0; a < geometry.m.size(); ++a)
+	{
+		if (geometry.m[a]->t.empty())
+			continue;
+		item.mesh = a;
+		uint64_t textures = state_id(renderable.texture_key(a), 0xffff) << 40;
+		m_order.push_back(std::make_pair(key | textures, uint32_t(m_items.size())));
+		m_items.push_back(item);
+	}
+}
+
+void RenderQueue::submit(UniformStream& uniforms)
+{
+	// equal keys keep the order they were added in
+	std::stable_sort(m_order.begin(), m_order.end(),
+		[](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b)
+		{ return a.first < b.first; });
+
+	const glp::Program* program = nullptr;
+	const glp::VertexArray* varray = nullptr;
+	const Renderable* textures = nullptr; // owner of the bound set
+	size_t textures_mesh = 0;
+	for (size_t a = 0; a < m_order.size(); ++a)
+	{
+		const Item& item = m_items[m_order[a].second];
+
+		render_stats_bind(item.program == program);
+		if (item.program != program)
+		{
+			program = item.program;
+			glp::Device::bind_program(*program);
+		}
+
+		const glp::VertexArray* item_varray = &item.renderable->get_vertex_array();
+		render_stats_bind(item_varray == varray);
+		if (item_varray != varray)
+		{
+			varray = item_varray;
+			glp::Device::bind_vertex_array(*varray);
+		}
+
+		const void* key = item.renderable->texture_key(item.mesh);
+		bool same = textures != nullptr ? textures->texture_key(textures_mesh) == key : key == nullptr;
+		render_stats_bind(same);
+		if (!same)
+		{
+			// a set replaces the previous one on the same units
+			if (key != nullptr)
+				item.renderable->bind_textures(item.mesh);
+			else
+				textures->unbind_textures(textures_mesh);
+			textures = key != nullptr ? item.renderable : nullptr;
+			textures_mesh = item.mesh;
+		}
+
+		uniforms.set_draw(item.model, item.model_view);
+		item.renderable->draw_mesh(item.mesh, 1);
+	}
+
+	if (textures != nullptr)
+		textures->unbind_textures(textures_mesh);
+	if (varray != nullptr)
+		glp::Device::unbind_vertex_array(*varray);
+	if (program != nullptr)
+		glp::Device::unbind_program(*program);
+	// once per queue instead of after every draw (debug builds only)
+	assert(glGetError() == GL_NO_ERROR);
+	clear();
+}
+
+void RenderQueue::clear()
+{
+	m_items.clear();
+	m_order.clear();
+}
+
+uint64_t RenderQueue::state_id(const void* state, uint64_t mask)
+{
+	std::unordered_map<const void*, uint64_t>::iterator it = m_ids.find(state);
+	if (it == m_ids.end())
+		it = m_ids.insert(std::make_pair(state, uint64_t(m_ids.size()))).first;
+	// ids beyond the field only make the order less ideal, binds are
+	// decided on the objects themselves
+	return it->second & mask;
+}
@@ -0,0 +1,48 @@
+#ifndef renderqueueH
+#define renderqueueH
+
+#include "renderable.h"
+#include "uniform_stream.h"
+#include "glplus.h"
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Scene draws collected during a frame and submitted sorted by state,
+// so that consecutive draws sharing a program, texture set or vertex
+// array bind it once. The sort key holds, from the most significant
+// bits: program (8), texture set (16), vertex array (16) and view depth
+// (24, front to back within equal state). Binds issued and skipped are
+// counted by render_stats_bind().
+class RenderQueue
+{
+public:
+	// one item per non-empty mesh of renderable
+	void add(const glp::Program& program, const Renderable& renderable,
+		const math::Mat4x4f& model, const math::Mat4x4f& view);
+	// draws the items in key order, the matrices of every item go to the
+	// Draw block of uniforms; the queue is empty afterwards
+	void submit(UniformStream& uniforms);
+	void clear();
+	size_t size() const { return m_items.size(); }
+
+private:
+	struct Item
+	{
+		const glp::Program* program;
+		const Renderable* renderable;
+		size_t mesh;
+		math::Mat4x4f model;
+		math::Mat4x4f model_view;
+	};
+
+	// small number per state object, stable over frames
+	uint64_t state_id(const void* state, uint64_t mask);
+
+	std::vector<Item> m_items;
+	std::vector<std::pair<uint64_t, uint32_t> > m_order; // key, item
+	std::unordered_map<const void*, uint64_t> m_ids;
+};
+
+#endif
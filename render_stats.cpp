@@ -0,0 +1,31 @@
+#include "render_stats.h"
+
+static RenderStats g_render_stats = { 0, 0, 0, 0 };
+
+
+void render_stats_draw(uint64_t instances)
+{
+	g_render_stats.draw_calls++;
+	g_render_stats.instances += instances;
+}
+
+void render_stats_bind(bool elided)
+{
+	if (elided)
+		g_render_stats.binds_elided++;
+	else
+		g_render_stats.binds++;
+}
+
+const RenderStats& render_stats_get()
+{
+	return g_render_stats;
+}
+
+void render_stats_reset()
+{
+	g_render_stats.draw_calls = 0;
+	g_render_stats.instances = 0;
+	g_render_stats.binds = 0;
+	g_render_stats.binds_elided = 0;
+}
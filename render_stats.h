@@ -0,0 +1,22 @@
+#ifndef renderstatsH
+#define renderstatsH
+
+#include <cstdint>
+
+// Counters of issued draw calls, kept by the code that calls glDraw*
+// (render thread only). They need no GL context, so the number of draws
+// of a renderer can be checked headless with stubbed GL entry points.
+struct RenderStats
+{
+	uint64_t draw_calls;
+	uint64_t instances;    // instances drawn, 1 per non-instanced draw
+	uint64_t binds;        // program, vertex array and texture set binds
+	uint64_t binds_elided; // binds skipped because the state was current
+};
+
+void render_stats_draw(uint64_t instances = 1);
+void render_stats_bind(bool elided);
+const RenderStats& render_stats_get();
+void render_stats_reset();
+
+#endif
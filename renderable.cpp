@@ -1,271 +1,657 @@
-#include "renderable.h"
-#include "glplusx.h"
-#include "glplusx_obj.h"
-#include "glplusx_tan.h"
-#include <assert.h>
-
-
-bool Renderable::load_plane(float x, float z, float h, float tu, float tv)
-{
-	stx::vector<math::Vec3f> P;
-	stx::vector<math::Vec2f> T;
-	stx::vector<math::Vec3f> N;
-	stx::vector<glpx::FaceIndexes*> INDS;
-
-	if (!glpx::generate_plane(x, z, h, tu, tv, P, T, N, INDS, true))
-		return false;
-
-	if (!generate_geometry(P, T, N, INDS, true))
-		return false;
-
-	for (size_t a = 0; a < INDS.size(); ++a)
-		delete INDS[a];
-	INDS.clear();
-
-	fill_buffers();
-	return true;
-}
-
-bool Renderable::load_grid(float x, float z, float h, uint grid_x, uint grid_z, float tu, float tv)
-{
-	stx::vector<math::Vec3f> P;
-	stx::vector<math::Vec2f> T;
-	stx::vector<math::Vec3f> N;
-	stx::vector<glpx::FaceIndexes*> INDS;
-
-	if (!glpx::generate_grid(x, z, h, grid_x, grid_z, tu, tv, P, T, N, INDS, true))
-		return false;
-
-	if (!generate_geometry(P, T, N, INDS, true))
-		return false;
-
-	for (size_t a = 0; a < INDS.size(); ++a)
-		delete INDS[a];
-	INDS.clear();
-
-	fill_buffers();
-	return true;
-}
-
-bool Renderable::load_box(float x, float y, float z)
-{
-	stx::vector<math::Vec3f> P;
-	stx::vector<math::Vec2f> T;
-	stx::vector<math::Vec3f> N;
-	stx::vector<glpx::FaceIndexes*> INDS;
-
-	if (!glpx::generate_box(x, y, z, P, T, N, INDS, true))
-		return false;
-
-	if (!generate_geometry(P, T, N, INDS, true))
-		return false;
-
-	for (size_t a = 0; a < INDS.size(); ++a)
-		delete INDS[a];
-	INDS.clear();
-
-	fill_buffers();
-	return true;
-}
-
-bool Renderable::load_obj(const wchar_t* fileName, bool swapZ, bool gen_tangent)
-{
-	stx::vector<math::Vec3f> P;
-	stx::vector<math::Vec2f> T;
-	stx::vector<math::Vec3f> N;
-	stx::vector<glpx::FaceIndexes*> INDS;
-
-	if (!glpx::read_obj_file(fileName, P, T, N, INDS, true))
-		return false;
-	//if (!glpx::generate_box(0.5f, 0.5f, 0.5f, P, T, N, INDS, true))
-	//	return false;
-	//if (!glpx::generate_cylinder(0.5f, 0.5f, 64, 1, P, T, N, INDS, true))
-	//	return false;
-
-	if (swapZ)
-	{
-		for (size_t a = 0; a < P.size(); ++a)
-			P[a].z = -P[a].z;
-		for (size_t a = 0; a < N.size(); ++a)
-			N[a].z = -N[a].z;
-	}
-
-	if (!generate_geometry(P, T, N, INDS, gen_tangent))
-		return false;
-
-	for (size_t a = 0; a < INDS.size(); ++a)
-		delete INDS[a];
-	INDS.clear();
-
-	if (m_geometry.v.empty())
-		return false;
-
-	fill_buffers();
-	return true;
-}
-
-bool Renderable::addTextures(const char* name, const wchar_t* texDiff,
-		const wchar_t* texNormal, const wchar_t* texHeight)
-{
-	TexSet* ts = new TexSet();
-
-	if (texDiff != nullptr) {
-		ts->m_texDiff.init();
-		if (!glpx::LoadTex2D_RGBA(ts->m_texDiff, texDiff))
-			return false;
-	}
-
-	if (texNormal != nullptr) {
-		ts->m_texNormal.init();
-		if (!glpx::LoadTex2D_RGBA(ts->m_texNormal, texNormal))
-			return false;
-	}
-
-	if (texHeight != nullptr) {
-		ts->m_texHeight.init();
-		if (!glpx::LoadTex2D_RGBA(ts->m_texHeight, texHeight))
-			return false;
-	}
-
-	m_textures.insert(std::make_pair(std::string(name), ts));
-	return true;
-}
-
-void Renderable::release()
-{
-}
-
-void Renderable::render(bool useTextures) const
-{
-	glp::Device::bind_vertex_array(m_varray);
-
-	for (size_t a = 0; a < m_geometry.m.size(); ++a)
-	{
-		const TexSet* ts = nullptr;
-		/*if (useTextures)
-		{
-			std::map<std::string, TexSet*>::const_iterator it = m_textures.find(m_geometry.m[a]->name);
-			if (it != m_textures.end()) ts = it->second;
-		}*/
-		ts = m_textures.begin()->second;
-
-		if (ts)
-		{
-			glp::Device::bind_tex(ts->m_texDiff, 0);
-			glp::Device::bind_tex(ts->m_texNormal, 1);
-			glp::Device::bind_tex(ts->m_texHeight, 2);
-		}
-
-		if (m_geometry.m[a]->t.empty())
-			continue;
-
-		glDrawElements(GL_TRIANGLES,
-			3*m_geometry.m[a]->t.size(),
-			GL_UNSIGNED_INT,
-			&m_geometry.m[a]->t.front());
-
-		if (ts)
-		{
-			glp::Device::unbind_tex(ts->m_texHeight, 2);
-			glp::Device::unbind_tex(ts->m_texNormal, 1);
-			glp::Device::unbind_tex(ts->m_texDiff, 0);
-		}
-	}
-
-	glp::Device::unbind_vertex_array(m_varray);
-	assert(glGetError() == GL_NO_ERROR);
-}
-
-
-bool Renderable::generate_geometry(
-		const glpx::ArrayVec3f& positions,
-		const glpx::ArrayVec2f& tex_coords,
-		const glpx::ArrayVec3f& normals,
-		const stx::vector<glpx::FaceIndexes*>& indexes,
-		bool gen_tangent)
-{
-	stx::vector<glpx::MeshIndexes> meshes;
-	stx::vector<glpx::VertexIndexes> vertexes;
-	glpx::generate_meshes(meshes, vertexes, indexes);
-
-	m_geometry.v.resize(vertexes.size());
-	for (size_t a = 0; a < vertexes.size(); ++a)
-	{
-		m_geometry.v[a].point = positions[vertexes[a].ix_position];
-		m_geometry.v[a].texcoord = tex_coords[vertexes[a].ix_tex_coord];
-		m_geometry.v[a].normal = normals[vertexes[a].ix_normal];
-	}
-
-	m_geometry.m.resize(meshes.size());
-	for (size_t m = 0; m < meshes.size(); ++m)
-	{
-		m_geometry.m[m] = new Mesh(indexes[m]->material_name.c_str());
-
-		m_geometry.m[m]->t.resize(meshes[m].triangles.size()/3);
-		for (size_t a = 0; a < m_geometry.m[m]->t.size(); ++a)
-		{
-			m_geometry.m[m]->t[a].v[0] = meshes[m].triangles[3*a + 0];
-			m_geometry.m[m]->t[a].v[1] = meshes[m].triangles[3*a + 1];
-			m_geometry.m[m]->t[a].v[2] = meshes[m].triangles[3*a + 2];
-		}
-
-		m_geometry.m[m]->q.resize(meshes[m].quads.size()/4);
-		for (size_t a = 0; a < m_geometry.m[m]->q.size(); ++a)
-		{
-			m_geometry.m[m]->q[a].v[0] = meshes[m].quads[4*a + 0];
-			m_geometry.m[m]->q[a].v[1] = meshes[m].quads[4*a + 1];
-			m_geometry.m[m]->q[a].v[2] = meshes[m].quads[4*a + 2];
-			m_geometry.m[m]->q[a].v[3] = meshes[m].quads[4*a + 3];
-		}
-	}
-
-	if (gen_tangent) 
-	{
-		for (size_t a = 0; a < m_geometry.m.size(); ++a)
-		{
-			if (!glpx::generate_tangents(
-				m_geometry.v.size(), sizeof(Vertex),
-				m_geometry.v.front().point.m,
-				m_geometry.v.front().texcoord.m,
-				m_geometry.v.front().normal.m,
-				m_geometry.v.front().tgtU.m,
-				m_geometry.v.front().tgtV.m,
-				m_geometry.m[a]->t.size(),
-				sizeof(Triangle),
-				m_geometry.m[a]->t.front().v, false))
-				return false;
-		}
-	}
-
-	return true;
-}
-
-void Renderable::fill_buffers()
-{
-	m_vbuff.init();
-	m_vbuff.buffer_data(m_geometry.v.size()*sizeof(Vertex),
-		glp::Buffer::UM_STATIC_DRAW, &m_geometry.v.front());
-
-	m_varray.init();
-
-	glp::Device::bind_vertex_array(m_varray);
-
-	glp::Device::bind_buffer(m_vbuff);
-	//glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene->m_ib);
-
-	glEnableVertexAttribArray(ATTR_LOC_POINT);
-	glEnableVertexAttribArray(ATTR_LOC_COORD);
-	glEnableVertexAttribArray(ATTR_LOC_NORMAL);
-	glEnableVertexAttribArray(ATTR_LOC_TGT_U);
-	glEnableVertexAttribArray(ATTR_LOC_TGT_V);
-	glVertexAttribPointer(ATTR_LOC_POINT, 3, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, point));
-	glVertexAttribPointer(ATTR_LOC_COORD, 2, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, texcoord));
-	glVertexAttribPointer(ATTR_LOC_NORMAL, 3, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-	glVertexAttribPointer(ATTR_LOC_TGT_U, 3, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, tgtU));
-	glVertexAttribPointer(ATTR_LOC_TGT_V, 3, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, tgtV));
-
-	glp::Device::unbind_vertex_array(m_varray);
-	glp::Device::unbind_buffer(m_vbuff);
-
-	assert(glGetError() == GL_NO_ERROR);
-}
+#include "renderable.h"
+#include "glplusx.h"
+#include "glplusx_obj.h"
+#include "glplusx_tan.h"
+#include "render_stats.h"
+#include "mesh_cache.h"
+#include "mesh_optimize.h"
+#include <assert.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+bool Renderable::load_plane(float x, float z, float h, float tu, float tv)
+{
+	stx::vector<math::Vec3f> P;
+	stx::vector<math::Vec2f> T;
+	stx::vector<math::Vec3f> N;
+	stx::vector<glpx::FaceIndexes*> INDS;
+
+	if (!glpx::generate_plane(x, z, h, tu, tv, P, T, N, INDS, true))
+		return false;
+
+	if (!generate_geometry(P, T, N, INDS, true))
+		return false;
+
+	for (size_t a = 0; a < INDS.size(); ++a)
+		delete INDS[a];
+	INDS.clear();
+
+	prepare_buffers();
+	fill_buffers();
+	return true;
+}
+
+bool Renderable::load_grid(float x, float z, float h, uint grid_x, uint grid_z, float tu, float tv)
+{
+	stx::vector<math::Vec3f> P;
+	stx::vector<math::Vec2f> T;
+	stx::vector<math::Vec3f> N;
+	stx::vector<glpx::FaceIndexes*> INDS;
+
+	if (!glpx::generate_grid(x, z, h, grid_x, grid_z, tu, tv, P, T, N, INDS, true))
+		return false;
+
+	if (!generate_geometry(P, T, N, INDS, true))
+		return false;
+
+	for (size_t a = 0; a < INDS.size(); ++a)
+		delete INDS[a];
+	INDS.clear();
+
+	prepare_buffers();
+	fill_buffers();
+	return true;
+}
+
+bool Renderable::load_box(float x, float y, float z)
+{
+	stx::vector<math::Vec3f> P;
+	stx::vector<math::Vec2f> T;
+	stx::vector<math::Vec3f> N;
+	stx::vector<glpx::FaceIndexes*> INDS;
+
+	if (!glpx::generate_box(x, y, z, P, T, N, INDS, true))
+		return false;
+
+	if (!generate_geometry(P, T, N, INDS, true))
+		return false;
+
+	for (size_t a = 0; a < INDS.size(); ++a)
+		delete INDS[a];
+	INDS.clear();
+
+	prepare_buffers();
+	fill_buffers();
+	return true;
+}
+
+bool Renderable::load_obj(const wchar_t* fileName, bool swapZ, bool gen_tangent)
+{
+	if (!load_obj_geometry(fileName, swapZ, gen_tangent))
+		return false;
+	fill_buffers();
+	return true;
+}
+
+bool Renderable::load_obj_geometry(const wchar_t* fileName, bool swapZ, bool gen_tangent)
+{
+	// the mapped files take narrow paths; assets are named in ASCII
+	size_t length = wcstombs(nullptr, fileName, 0);
+	if (length == size_t(-1))
+	{
+		fwprintf(stderr, L"Can not convert path %ls.\n", fileName);
+		return false;
+	}
+	std::string path(length, '\0');
+	wcstombs(&path[0], fileName, length);
+
+	MeshCacheKey cache_key;
+	bool use_cache = mesh_cache_key(path.c_str(), swapZ, gen_tangent, cache_key);
+	if (use_cache && mesh_cache_load(cache_key, m_geometry, m_mesh_stats, m_has_tangents))
+	{
+		if (m_geometry.v.empty())
+			return false;
+		prepare_buffers();
+		return true;
+	}
+
+	ObjData obj;
+	if (!obj_parse(path.c_str(), obj))
+		return false;
+
+	if (swapZ)
+	{
+		for (size_t a = 2; a < obj.positions.size(); a += 3)
+			obj.positions[a] = -obj.positions[a];
+		for (size_t a = 2; a < obj.normals.size(); a += 3)
+			obj.normals[a] = -obj.normals[a];
+	}
+
+	if (!generate_geometry(obj, gen_tangent))
+		return false;
+
+	if (m_geometry.v.empty())
+		return false;
+
+	// a cache that can not be written only costs the next start
+	if (use_cache && !mesh_cache_save(cache_key, m_geometry, m_mesh_stats, m_has_tangents))
+		fprintf(stderr, "Writing mesh cache %s failed.\n", cache_key.path.c_str());
+
+	prepare_buffers();
+	return true;
+}
+
+Renderable::TexSet* Renderable::addTextureSet(const char* name)
+{
+	TexSet* ts = new TexSet();
+	m_textures.insert(std::make_pair(std::string(name), ts));
+	return ts;
+}
+
+bool Renderable::addTextures(const char* name, const wchar_t* texDiff,
+		const wchar_t* texNormal, const wchar_t* texHeight)
+{
+	TexSet* ts = new TexSet();
+
+	if (texDiff != nullptr) {
+		ts->m_texDiff.init();
+		if (!glpx::LoadTex2D_RGBA(ts->m_texDiff, texDiff))
+			return false;
+	}
+
+	if (texNormal != nullptr) {
+		ts->m_texNormal.init();
+		if (!glpx::LoadTex2D_RGBA(ts->m_texNormal, texNormal))
+			return false;
+	}
+
+	if (texHeight != nullptr) {
+		ts->m_texHeight.init();
+		if (!glpx::LoadTex2D_RGBA(ts->m_texHeight, texHeight))
+			return false;
+	}
+
+	m_textures.insert(std::make_pair(std::string(name), ts));
+	return true;
+}
+
+void Renderable::set_vertex_format(uint attribs, bool short_points)
+{
+	m_attribs = attribs | VA_POINT;
+	m_short_points = short_points;
+}
+
+void Renderable::release()
+{
+	if (m_ibuff != 0)
+		glDeleteBuffers(1, &m_ibuff);
+	m_ibuff = 0;
+}
+
+void Renderable::render(bool useTextures) const
+{
+	draw(useTextures, 1);
+}
+
+void Renderable::render_instanced(bool useTextures, int instances) const
+{
+	if (instances > 0)
+		draw(useTextures, instances);
+}
+
+void Renderable::draw(bool useTextures, int instances) const
+{
+	glp::Device::bind_vertex_array(m_varray);
+
+	for (size_t a = 0; a < m_geometry.m.size(); ++a)
+	{
+		bind_textures(a);
+		if (m_geometry.m[a]->t.empty())
+			continue;
+		draw_mesh(a, instances);
+		unbind_textures(a);
+	}
+
+	glp::Device::unbind_vertex_array(m_varray);
+	assert(glGetError() == GL_NO_ERROR);
+}
+
+const void* Renderable::texture_key(size_t a) const
+{
+	// every mesh uses the first set, there is no lookup by material yet
+	return m_textures.empty() ? nullptr : m_textures.begin()->second;
+}
+
+void Renderable::bind_textures(size_t a) const
+{
+	const TexSet* ts = static_cast<const TexSet*>(texture_key(a));
+	if (ts)
+	{
+		glp::Device::bind_tex(ts->m_texDiff, 0);
+		glp::Device::bind_tex(ts->m_texNormal, 1);
+		glp::Device::bind_tex(ts->m_texHeight, 2);
+	}
+}
+
+void Renderable::unbind_textures(size_t a) const
+{
+	const TexSet* ts = static_cast<const TexSet*>(texture_key(a));
+	if (ts)
+	{
+		glp::Device::unbind_tex(ts->m_texHeight, 2);
+		glp::Device::unbind_tex(ts->m_texNormal, 1);
+		glp::Device::unbind_tex(ts->m_texDiff, 0);
+	}
+}
+
+void Renderable::draw_mesh(size_t a, int instances) const
+{
+	const IndexRange& range = m_ranges[a];
+	if (instances == 1)
+		glDrawElements(GL_TRIANGLES, range.count, m_index_type,
+			(void*)range.offset);
+	else
+		glDrawElementsInstanced(GL_TRIANGLES, range.count, m_index_type,
+			(void*)range.offset, instances);
+	render_stats_draw(instances);
+}
+
+
+bool Renderable::generate_geometry(
+		const glpx::ArrayVec3f& positions,
+		const glpx::ArrayVec2f& tex_coords,
+		const glpx::ArrayVec3f& normals,
+		const stx::vector<glpx::FaceIndexes*>& indexes,
+		bool gen_tangent)
+{
+	stx::vector<glpx::MeshIndexes> meshes;
+	stx::vector<glpx::VertexIndexes> vertexes;
+	glpx::generate_meshes(meshes, vertexes, indexes);
+
+	m_geometry.v.resize(vertexes.size());
+	for (size_t a = 0; a < vertexes.size(); ++a)
+	{
+		m_geometry.v[a].point = positions[vertexes[a].ix_position];
+		m_geometry.v[a].texcoord = tex_coords[vertexes[a].ix_tex_coord];
+		m_geometry.v[a].normal = normals[vertexes[a].ix_normal];
+	}
+
+	m_geometry.m.resize(meshes.size());
+	for (size_t m = 0; m < meshes.size(); ++m)
+	{
+		m_geometry.m[m] = new Mesh(indexes[m]->material_name.c_str());
+
+		m_geometry.m[m]->t.resize(meshes[m].triangles.size()/3);
+		for (size_t a = 0; a < m_geometry.m[m]->t.size(); ++a)
+		{
+			m_geometry.m[m]->t[a].v[0] = meshes[m].triangles[3*a + 0];
+			m_geometry.m[m]->t[a].v[1] = meshes[m].triangles[3*a + 1];
+			m_geometry.m[m]->t[a].v[2] = meshes[m].triangles[3*a + 2];
+		}
+
+		m_geometry.m[m]->q.resize(meshes[m].quads.size()/4);
+		for (size_t a = 0; a < m_geometry.m[m]->q.size(); ++a)
+		{
+			m_geometry.m[m]->q[a].v[0] = meshes[m].quads[4*a + 0];
+			m_geometry.m[m]->q[a].v[1] = meshes[m].quads[4*a + 1];
+			m_geometry.m[m]->q[a].v[2] = meshes[m].quads[4*a + 2];
+			m_geometry.m[m]->q[a].v[3] = meshes[m].quads[4*a + 3];
+		}
+	}
+
+	return finish_geometry(gen_tangent);
+}
+
+bool Renderable::generate_geometry(const ObjData& obj, bool gen_tangent)
+{
+	// one vertex per distinct (position, tex_coord, normal), found in an
+	// open addressing table of vertex indices
+	size_t table_size = 16;
+	while (table_size < 2*obj.corners.size())
+		table_size *= 2;
+	std::vector<uint> table(table_size, UINT_MAX);
+	std::vector<uint> corner_vertex(obj.corners.size());
+	std::vector<const ObjCorner*> vertex_corner;
+	vertex_corner.reserve(obj.positions.size()/3);
+	for (size_t a = 0; a < obj.corners.size(); ++a)
+	{
+		const ObjCorner& c = obj.corners[a];
+		uint32_t hash = uint32_t(c.position)*0x9e3779b1u ^ uint32_t(c.tex_coord)*0x85ebca77u ^ uint32_t(c.normal)*0xc2b2ae3du;
+		size_t slot = (hash ^ hash >> 15) & (table_size - 1);
+		for (;; slot = (slot + 1) & (table_size - 1))
+		{
+			if (table[slot] == UINT_MAX)
+			{
+				table[slot] = uint(vertex_corner.size());
+				vertex_corner.push_back(&c);
+				break;
+			}
+			const ObjCorner& d = *vertex_corner[table[slot]];
+			if (d.position == c.position && d.tex_coord == c.tex_coord && d.normal == c.normal)
+				break;
+		}
+		corner_vertex[a] = table[slot];
+	}
+
+	m_geometry.v.resize(vertex_corner.size());
+	for (size_t a = 0; a < vertex_corner.size(); ++a)
+	{
+		const ObjCorner& c = *vertex_corner[a];
+		Vertex& v = m_geometry.v[a];
+		const float* p = &obj.positions[3*size_t(c.position)];
+		v.point = math::Vec3f(p[0], p[1], p[2]);
+		if (c.tex_coord >= 0)
+			v.texcoord = math::Vec2f(obj.tex_coords[2*size_t(c.tex_coord)], obj.tex_coords[2*size_t(c.tex_coord) + 1]);
+		if (c.normal >= 0)
+		{
+			const float* n = &obj.normals[3*size_t(c.normal)];
+			v.normal = math::Vec3f(n[0], n[1], n[2]);
+		}
+	}
+
+	// one mesh per material, polygons as triangle fans
+	std::map<std::string, Mesh*> by_material;
+	for (size_t g = 0; g < obj.groups.size(); ++g)
+	{
+		const ObjGroup& group = obj.groups[g];
+		Mesh*& mesh = by_material[group.material_name];
+		if (mesh == nullptr)
+		{
+			mesh = new Mesh(group.material_name.c_str());
+			m_geometry.m.push_back(mesh);
+		}
+		for (size_t f = group.first_face; f < group.first_face + group.face_count; ++f)
+			for (size_t a = obj.faces[f] + 2; a < obj.faces[f + 1]; ++a)
+			{
+				Triangle t = {{ corner_vertex[obj.faces[f]], corner_vertex[a - 1], corner_vertex[a] }};
+				mesh->t.push_back(t);
+			}
+	}
+
+	return finish_geometry(gen_tangent);
+}
+
+bool Renderable::finish_geometry(bool gen_tangent)
+{
+	if (gen_tangent) 
+	{
+		for (size_t a = 0; a < m_geometry.m.size(); ++a)
+		{
+			if (!glpx::generate_tangents(
+				m_geometry.v.size(), sizeof(Vertex),
+				m_geometry.v.front().point.m,
+				m_geometry.v.front().texcoord.m,
+				m_geometry.v.front().normal.m,
+				m_geometry.v.front().tgtU.m,
+				m_geometry.v.front().tgtV.m,
+				m_geometry.m[a]->t.size(),
+				sizeof(Triangle),
+				m_geometry.m[a]->t.front().v, false))
+				return false;
+		}
+	}
+
+	m_has_tangents = gen_tangent;
+	optimize_geometry();
+	return true;
+}
+
+void Renderable::optimize_geometry()
+{
+	size_t vertex_count = m_geometry.v.size();
+	std::vector<unsigned> indices;
+	std::vector<unsigned> remap(vertex_count, UINT_MAX);
+	unsigned next = 0;
+
+	m_mesh_stats.resize(m_geometry.m.size());
+	for (size_t m = 0; m < m_geometry.m.size(); ++m)
+	{
+		stx::vector<Triangle>& t = m_geometry.m[m]->t;
+		indices.resize(3*t.size());
+		for (size_t a = 0; a < t.size(); ++a)
+			for (int k = 0; k < 3; ++k)
+				indices[3*a + k] = t[a].v[k];
+
+		MeshStats& stats = m_mesh_stats[m];
+		stats.triangles = t.size();
+		stats.acmr_loaded = indices.empty() ? 0.0 : mesh_acmr(&indices.front(), indices.size(), vertex_count);
+		if (!indices.empty())
+		{
+			mesh_optimize_triangles(&indices.front(), indices.size(), vertex_count);
+			// vertices shared between meshes keep the number of their
+			// first use in an earlier mesh
+			next = mesh_remap_by_first_use(&indices.front(), indices.size(), remap, next);
+		}
+		stats.acmr_optimized = indices.empty() ? 0.0 : mesh_acmr(&indices.front(), indices.size(), vertex_count);
+		stats.index_bytes = indices.size()*(vertex_count <= 0x10000 ? 2 : 4);
+
+		for (size_t a = 0; a < t.size(); ++a)
+			for (int k = 0; k < 3; ++k)
+				t[a].v[k] = indices[3*a + k];
+	}
+
+	// vertices of no triangle (quads only) go last, in their old order
+	for (size_t v = 0; v < vertex_count; ++v)
+		if (remap[v] == UINT_MAX)
+			remap[v] = next++;
+	for (size_t m = 0; m < m_geometry.m.size(); ++m)
+	{
+		stx::vector<Quad>& q = m_geometry.m[m]->q;
+		for (size_t a = 0; a < q.size(); ++a)
+			for (int k = 0; k < 4; ++k)
+				q[a].v[k] = remap[q[a].v[k]];
+	}
+	stx::vector<Vertex> v(vertex_count);
+	for (size_t a = 0; a < vertex_count; ++a)
+		v[remap[a]] = m_geometry.v[a];
+	m_geometry.v.swap(v);
+}
+
+static uint16_t float_to_half(float value)
+{
+	uint32_t f;
+	memcpy(&f, &value, sizeof(f));
+	uint16_t sign = uint16_t((f >> 16) & 0x8000);
+	int exponent = int((f >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = f & 0x7fffff;
+	if (exponent >= 31)
+		return uint16_t(sign | 0x7c00); // overflow and inf/nan as inf
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+			return sign;
+		// subnormal, rounded to nearest
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		return uint16_t(sign | ((mantissa + (1u << (shift - 1))) >> shift));
+	}
+	// rounding may carry into the exponent, which is still correct
+	return uint16_t(sign | ((uint32_t(exponent) << 10) + ((mantissa + 0x1000) >> 13)));
+}
+
+static uint32_t pack_snorm_10_10_10(const math::Vec3f& v)
+{
+	const float c[3] = { v.x, v.y, v.z };
+	uint32_t packed = 0;
+	for (int k = 0; k < 3; ++k)
+	{
+		float f = std::min(std::max(c[k], -1.0f), 1.0f);
+		int q = int(std::floor(f*511.0f + 0.5f));
+		packed |= (uint32_t(q) & 0x3ff) << (10*k);
+	}
+	return packed;
+}
+
+static int16_t float_to_snorm16(float value)
+{
+	float f = std::min(std::max(value, -1.0f), 1.0f);
+	return int16_t(std::floor(f*32767.0f + 0.5f));
+}
+
+size_t Renderable::vertex_layout(uint& attribs, size_t& coord_offset,
+	size_t& normal_offset, size_t& tangent_offset) const
+{
+	// layout from the attributes in use, attributes 4 byte aligned
+	attribs = m_attribs;
+	if (!m_has_tangents)
+		attribs &= ~uint(VA_TANGENTS);
+	size_t offset = m_short_points ? 4*sizeof(int16_t) : 3*sizeof(float);
+	coord_offset = offset;
+	if (attribs & VA_COORD)
+		offset += 2*sizeof(uint16_t);
+	normal_offset = offset;
+	if (attribs & VA_NORMAL)
+		offset += sizeof(uint32_t);
+	tangent_offset = offset;
+	if (attribs & VA_TANGENTS)
+		offset += 2*sizeof(uint32_t);
+	return offset;
+}
+
+void Renderable::prepare_buffers()
+{
+	uint attribs;
+	size_t point_offset = 0, coord_offset, normal_offset, tangent_offset;
+	m_vertex_bytes = vertex_layout(attribs, coord_offset, normal_offset, tangent_offset);
+
+	// short points: uniform scale around the bounding box centre
+	math::Vec3f lo(0.0f), hi(0.0f);
+	for (size_t a = 0; a < m_geometry.v.size(); ++a)
+	{
+		const math::Vec3f& p = m_geometry.v[a].point;
+		if (a == 0)
+			lo = hi = p;
+		lo = math::Vec3f(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+		hi = math::Vec3f(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+	}
+	math::Vec3f centre((lo.x + hi.x)*0.5f, (lo.y + hi.y)*0.5f, (lo.z + hi.z)*0.5f);
+	float extent = std::max(std::max(hi.x - lo.x, hi.y - lo.y), hi.z - lo.z)*0.5f;
+	if (extent <= 0.0f)
+		extent = 1.0f;
+	m_point_transform = math::Mat4x4f(math::Mat4x4f::I);
+	if (m_short_points)
+	{
+		m_point_transform.m[0] = m_point_transform.m[5] = m_point_transform.m[10] = extent;
+		m_point_transform.m[3] = centre.x;
+		m_point_transform.m[7] = centre.y;
+		m_point_transform.m[11] = centre.z;
+	}
+
+	std::vector<unsigned char>& vertices = m_vertex_data;
+	vertices.assign(m_geometry.v.size()*m_vertex_bytes, 0);
+	for (size_t a = 0; a < m_geometry.v.size(); ++a)
+	{
+		const Vertex& v = m_geometry.v[a];
+		unsigned char* dst = vertices.empty() ? nullptr : &vertices[a*m_vertex_bytes];
+		if (m_short_points)
+		{
+			int16_t p[4] = {
+				float_to_snorm16((v.point.x - centre.x)/extent),
+				float_to_snorm16((v.point.y - centre.y)/extent),
+				float_to_snorm16((v.point.z - centre.z)/extent), 0 };
+			memcpy(dst + point_offset, p, sizeof(p));
+		}
+		else
+			memcpy(dst + point_offset, v.point.m, 3*sizeof(float));
+		if (attribs & VA_COORD)
+		{
+			uint16_t t[2] = { float_to_half(v.texcoord.x), float_to_half(v.texcoord.y) };
+			memcpy(dst + coord_offset, t, sizeof(t));
+		}
+		if (attribs & VA_NORMAL)
+		{
+			uint32_t n = pack_snorm_10_10_10(v.normal);
+			memcpy(dst + normal_offset, &n, sizeof(n));
+		}
+		if (attribs & VA_TANGENTS)
+		{
+			uint32_t t[2] = { pack_snorm_10_10_10(v.tgtU), pack_snorm_10_10_10(v.tgtV) };
+			memcpy(dst + tangent_offset, t, sizeof(t));
+		}
+	}
+
+	// indices of all meshes in one element buffer, recorded in the
+	// vertex array, so draws no longer send them from client memory
+	bool short_indices = m_geometry.v.size() <= 0x10000;
+	size_t index_size = short_indices ? sizeof(uint16_t) : sizeof(uint32_t);
+	m_index_type = short_indices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	m_ranges.resize(m_geometry.m.size());
+	std::vector<unsigned char>& indices = m_index_data;
+	indices.clear();
+	for (size_t m = 0; m < m_geometry.m.size(); ++m)
+	{
+		const stx::vector<Triangle>& t = m_geometry.m[m]->t;
+		m_ranges[m].offset = indices.size();
+		m_ranges[m].count = GLsizei(3*t.size());
+		indices.resize(indices.size() + 3*t.size()*index_size);
+		unsigned char* dst = indices.empty() ? nullptr : &indices[m_ranges[m].offset];
+		for (size_t a = 0; a < t.size(); ++a)
+			for (int k = 0; k < 3; ++k)
+			{
+				if (short_indices)
+				{
+					uint16_t index = uint16_t(t[a].v[k]);
+					memcpy(dst, &index, sizeof(index));
+				}
+				else
+				{
+					uint32_t index = uint32_t(t[a].v[k]);
+					memcpy(dst, &index, sizeof(index));
+				}
+				dst += index_size;
+			}
+	}
+}
+
+void Renderable::fill_buffers()
+{
+	uint attribs;
+	size_t point_offset = 0, coord_offset, normal_offset, tangent_offset;
+	vertex_layout(attribs, coord_offset, normal_offset, tangent_offset);
+
+	m_vbuff.init();
+	m_vbuff.buffer_data(m_vertex_data.size(),
+		glp::Buffer::UM_STATIC_DRAW, m_vertex_data.empty() ? nullptr : &m_vertex_data.front());
+
+	m_varray.init();
+
+	glp::Device::bind_vertex_array(m_varray);
+
+	glp::Device::bind_buffer(m_vbuff);
+
+	// disabled attributes read the default (0, 0, 0, 1)
+	GLsizei stride = GLsizei(m_vertex_bytes);
+	glEnableVertexAttribArray(ATTR_LOC_POINT);
+	if (m_short_points)
+		glVertexAttribPointer(ATTR_LOC_POINT, 3, GL_SHORT, GL_TRUE, stride, (void*)point_offset);
+	else
+		glVertexAttribPointer(ATTR_LOC_POINT, 3, GL_FLOAT, GL_FALSE, stride, (void*)point_offset);
+	if (attribs & VA_COORD)
+	{
+		glEnableVertexAttribArray(ATTR_LOC_COORD);
+		glVertexAttribPointer(ATTR_LOC_COORD, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)coord_offset);
+	}
+	if (attribs & VA_NORMAL)
+	{
+		glEnableVertexAttribArray(ATTR_LOC_NORMAL);
+		glVertexAttribPointer(ATTR_LOC_NORMAL, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)normal_offset);
+	}
+	if (attribs & VA_TANGENTS)
+	{
+		glEnableVertexAttribArray(ATTR_LOC_TGT_U);
+		glEnableVertexAttribArray(ATTR_LOC_TGT_V);
+		glVertexAttribPointer(ATTR_LOC_TGT_U, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)tangent_offset);
+		glVertexAttribPointer(ATTR_LOC_TGT_V, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(tangent_offset + sizeof(uint32_t)));
+	}
+
+	glGenBuffers(1, &m_ibuff);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibuff);
+	if (!m_index_data.empty())
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_index_data.size(), &m_index_data.front(), GL_STATIC_DRAW);
+
+	glp::Device::unbind_vertex_array(m_varray);
+	glp::Device::unbind_buffer(m_vbuff);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	// the packed copies are in the buffers now
+	std::vector<unsigned char>().swap(m_vertex_data);
+	std::vector<unsigned char>().swap(m_index_data);
+
+	assert(glGetError() == GL_NO_ERROR);
+}
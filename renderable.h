@@ -1,92 +1,182 @@
-#ifndef renderableH
-#define renderableH
-
-#include "glplus.h"
-#include "glplusx.h"
-#include "glplusx_obj.h"
-#include <map>
-#include <string>
-
-
-struct Vertex
-{
-	Vertex(): point(0.0f), texcoord(0.0f),
-		normal(0.0f), tgtU(0.0f), tgtV(0.0f) {}
-	math::Vec3f point;
-	math::Vec2f texcoord;
-	math::Vec3f normal;
-	math::Vec3f tgtU;
-	math::Vec3f tgtV;
-};
-
-struct Triangle
-{
-	uint v[3];
-};
-
-struct Quad
-{
-	uint v[4];
-};
-
-struct Mesh
-{
-	Mesh(const char* name): material_name(name) {}
-	stx::string material_name;
-	stx::vector<Triangle> t;
-	stx::vector<Quad> q;
-};
-
-struct GeomData
-{
-	stx::vector<Vertex> v;
-	stx::vector<Mesh*> m;
-};
-
-
-class Renderable
-{
-public:
-	bool load_plane(float x, float z, float h, float tu, float tv);
-	bool load_grid(float x, float z, float h, uint grid_x, uint grid_z, float tu, float tv);
-	bool load_box(float x, float y, float z);
-	bool load_obj(const wchar_t* fileName, bool swapZ, bool gen_tangent);
-
-	void release();
-
-	bool addTextures(const char* name, const wchar_t* texDiff,
-		const wchar_t* texNormal, const wchar_t* texHeight);
-
-	void render(bool useTextures) const;
-	const GeomData& getGeometry() const {return m_geometry;}
-
-	static const GLuint ATTR_LOC_POINT  = 0;
-	static const GLuint ATTR_LOC_COORD  = 1;
-	static const GLuint ATTR_LOC_NORMAL = 2;
-	static const GLuint ATTR_LOC_TGT_U  = 3;
-	static const GLuint ATTR_LOC_TGT_V  = 4;
-
-private:
-	struct TexSet
-	{
-		glp::Tex2D m_texDiff;
-		glp::Tex2D m_texNormal;
-		glp::Tex2D m_texHeight;
-	};
-
-	bool generate_geometry(
-		const glpx::ArrayVec3f& positions,
-		const glpx::ArrayVec2f& tex_coords,
-		const glpx::ArrayVec3f& normals,
-		const stx::vector<glpx::FaceIndexes*>& indexes,
-		bool gen_tangent); // added as it was failing for pool.obj
-	void fill_buffers();
-
-	GeomData m_geometry;
-	glp::VertexBuffer m_vbuff;
-	glp::VertexArray m_varray;
-	std::map<std::string, TexSet*> m_textures;
-};
-
-
-#endif
+#ifndef renderableH
+#define renderableH
+
+#include "glplus.h"
+#include "glplusx.h"
+#include "glplusx_obj.h"
+#include "obj_parser.h"
+#include <map>
+#include <string>
+#include <vector>
+
+
+struct Vertex
+{
+	Vertex(): point(0.0f), texcoord(0.0f),
+		normal(0.0f), tgtU(0.0f), tgtV(0.0f) {}
+	math::Vec3f point;
+	math::Vec2f texcoord;
+	math::Vec3f normal;
+	math::Vec3f tgtU;
+	math::Vec3f tgtV;
+};
+
+struct Triangle
+{
+	uint v[3];
+};
+
+struct Quad
+{
+	uint v[4];
+};
+
+struct Mesh
+{
+	Mesh(const char* name): material_name(name) {}
+	stx::string material_name;
+	stx::vector<Triangle> t;
+	stx::vector<Quad> q;
+};
+
+struct GeomData
+{
+	stx::vector<Vertex> v;
+	stx::vector<Mesh*> m;
+};
+
+// post-transform cache behaviour of a mesh, measured at load
+struct MeshStats
+{
+	size_t triangles;
+	double acmr_loaded;    // as generated or read
+	double acmr_optimized; // after the triangle reordering
+	size_t index_bytes;    // in the element buffer (2 or 4 per index)
+};
+
+
+class Renderable
+{
+public:
+	Renderable(): m_ibuff(0), m_index_type(GL_UNSIGNED_INT),
+		m_attribs(VA_ALL), m_short_points(false), m_has_tangents(false), m_vertex_bytes(0),
+		m_point_transform(math::Mat4x4f::I) {}
+
+	// attributes kept in the vertex buffer (point is always there)
+	enum VertexAttrib
+	{
+		VA_POINT    = 1,
+		VA_COORD    = 2,
+		VA_NORMAL   = 4,
+		VA_TANGENTS = 8, // tgtU and tgtV, only if the loader made them
+		VA_ALL      = 15
+	};
+	// vertex format of the next load_*(): texture coordinates are half
+	// floats, normals and tangents signed normalized 10:10:10:2; with
+	// short_points positions are 16 bit signed normalized in the bounding
+	// cube and get_point_transform() has to be applied on the model matrix
+	// (a uniform scale, so normals stay orthogonal)
+	void set_vertex_format(uint attribs, bool short_points = false);
+	const math::Mat4x4f& get_point_transform() const {return m_point_transform;}
+	// bytes of one vertex in the vertex buffer
+	size_t get_vertex_bytes() const {return m_vertex_bytes;}
+
+	bool load_plane(float x, float z, float h, float tu, float tv);
+	bool load_grid(float x, float z, float h, uint grid_x, uint grid_z, float tu, float tv);
+	bool load_box(float x, float y, float z);
+	// the parsed and optimized geometry is kept in <fileName>.cache
+	// (mesh_cache.h) and read from there while the source is unchanged
+	bool load_obj(const wchar_t* fileName, bool swapZ, bool gen_tangent);
+	// load_obj() in two steps: the geometry and the packed buffers without
+	// GL (any thread), then the upload on the GL thread
+	bool load_obj_geometry(const wchar_t* fileName, bool swapZ, bool gen_tangent);
+	void fill_buffers();
+
+	void release();
+
+	struct TexSet
+	{
+		glp::Tex2D m_texDiff;
+		glp::Tex2D m_texNormal;
+		glp::Tex2D m_texHeight;
+	};
+
+	bool addTextures(const char* name, const wchar_t* texDiff,
+		const wchar_t* texNormal, const wchar_t* texHeight);
+	// empty set, its textures are filled by the caller (AssetLoader)
+	TexSet* addTextureSet(const char* name);
+
+	void render(bool useTextures) const;
+	// instances copies in one draw call, the vertex program tells them
+	// apart by gl_InstanceID
+	void render_instanced(bool useTextures, int instances) const;
+	const GeomData& getGeometry() const {return m_geometry;}
+	// one entry per mesh of getGeometry()
+	const std::vector<MeshStats>& getMeshStats() const {return m_mesh_stats;}
+
+	// pieces of render() for RenderQueue, which binds only what changes
+	// between sorted draws: the vertex array, the textures of mesh a
+	// (units 0..2, texture_key() tells sets apart) and the draw itself
+	const glp::VertexArray& get_vertex_array() const {return m_varray;}
+	const void* texture_key(size_t a) const;
+	void bind_textures(size_t a) const;
+	void unbind_textures(size_t a) const;
+	// glDrawElements of mesh a with the vertex array and textures bound
+	void draw_mesh(size_t a, int instances) const;
+
+	static const GLuint ATTR_LOC_POINT  = 0;
+	static const GLuint ATTR_LOC_COORD  = 1;
+	static const GLuint ATTR_LOC_NORMAL = 2;
+	static const GLuint ATTR_LOC_TGT_U  = 3;
+	static const GLuint ATTR_LOC_TGT_V  = 4;
+
+private:
+	void draw(bool useTextures, int instances) const;
+
+	bool generate_geometry(
+		const glpx::ArrayVec3f& positions,
+		const glpx::ArrayVec2f& tex_coords,
+		const glpx::ArrayVec3f& normals,
+		const stx::vector<glpx::FaceIndexes*>& indexes,
+		bool gen_tangent); // added as it was failing for pool.obj
+	bool generate_geometry(const ObjData& obj, bool gen_tangent);
+	// tangents and optimize_geometry()
+	bool finish_geometry(bool gen_tangent);
+	// triangles reordered for the vertex cache, vertices in order of
+	// first use
+	void optimize_geometry();
+	// attributes in the vertex buffer and their offsets (the point is at
+	// 0), returns the vertex size
+	size_t vertex_layout(uint& attribs, size_t& coord_offset,
+		size_t& normal_offset, size_t& tangent_offset) const;
+	// packs m_vertex_data and m_index_data for fill_buffers()
+	void prepare_buffers();
+
+	struct IndexRange
+	{
+		size_t offset; // bytes into m_ibuff
+		GLsizei count;
+	};
+
+	GeomData m_geometry;
+	std::vector<MeshStats> m_mesh_stats;
+	glp::VertexBuffer m_vbuff;
+	glp::VertexArray m_varray;
+	// indices of all meshes, 16 bit when the vertex count allows
+	GLuint m_ibuff;
+	GLenum m_index_type;
+	std::vector<IndexRange> m_ranges;
+	// buffer contents between prepare_buffers() and fill_buffers()
+	std::vector<unsigned char> m_vertex_data;
+	std::vector<unsigned char> m_index_data;
+	// vertex format (set_vertex_format())
+	uint m_attribs;
+	bool m_short_points;
+	bool m_has_tangents;
+	size_t m_vertex_bytes;
+	math::Mat4x4f m_point_transform;
+	std::map<std::string, TexSet*> m_textures;
+};
+
+
+#endif
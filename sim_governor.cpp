@@ -0,0 +1,134 @@
+#include "sim_governor.h"
+#include <algorithm>
+#include <climits>
+
+
+SimGovernor::SimGovernor(uint64_t usec_step_time)
+{
+	m_step = usec_step_time > 0 ? usec_step_time : 1;
+	m_simulation_time = 0;
+	m_last_call = 0;
+	m_budget = BUDGET_UNLIMITED;
+	m_overflow = OVERFLOW_DROP;
+	m_max_steps = 0;
+	m_usec_budget = 0;
+	m_frame_start = std::chrono::steady_clock::now();
+	reset_stats();
+}
+
+void SimGovernor::set_step_budget(int max_steps)
+{
+	m_budget = BUDGET_STEPS;
+	m_max_steps = std::max(1, max_steps);
+}
+
+void SimGovernor::set_time_budget(uint64_t usec)
+{
+	m_budget = BUDGET_TIME;
+	m_usec_budget = usec;
+}
+
+void SimGovernor::set_unlimited()
+{
+	m_budget = BUDGET_UNLIMITED;
+}
+
+void SimGovernor::set_overflow(Overflow overflow)
+{
+	m_overflow = overflow;
+}
+
+void SimGovernor::reset(uint64_t usec_time)
+{
+	m_simulation_time = 0;
+	m_last_call = usec_time;
+}
+
+void SimGovernor::reset_stats()
+{
+	m_stats.frames = 0;
+	m_stats.steps = 0;
+	m_stats.overloaded_frames = 0;
+	m_stats.dropped_usec = 0;
+	m_stats.last_steps = 0;
+	m_stats.avg_step_usec = 0.0;
+}
+
+int SimGovernor::frame_limit() const
+{
+	switch (m_budget)
+	{
+	case BUDGET_STEPS:
+		return m_max_steps;
+	case BUDGET_TIME:
+		// nothing measured yet: one step, the estimate converges quickly
+		if (m_stats.avg_step_usec <= 0.0)
+			return 1;
+		return std::max(1, int(double(m_usec_budget)/m_stats.avg_step_usec));
+	default:
+		return -1;
+	}
+}
+
+int SimGovernor::begin_frame(uint64_t usec_time)
+{
+	m_simulation_time += (usec_time - m_last_call);
+	m_last_call = usec_time;
+	m_stats.frames++;
+	m_frame_start = std::chrono::steady_clock::now();
+
+	// same as counting "while (m_simulation_time > m_step)" iterations
+	uint64_t pending = m_simulation_time > m_step ? (m_simulation_time - 1)/m_step : 0;
+	int limit = frame_limit();
+
+	uint64_t granted = pending;
+	if (limit >= 0 && pending > uint64_t(limit))
+	{
+		granted = uint64_t(limit);
+		m_stats.overloaded_frames++;
+
+		uint64_t keep = m_simulation_time - pending*m_step; // below one step
+		if (m_overflow == OVERFLOW_SLOW_MOTION)
+			keep += std::min(pending - granted, granted)*m_step;
+		uint64_t after = m_simulation_time - granted*m_step;
+		m_stats.dropped_usec += after - keep;
+		m_simulation_time = keep + granted*m_step;
+	}
+	m_simulation_time -= granted*m_step;
+
+	// steps are counted in int, a backlog beyond that (unlimited budget,
+	// huge time jump) is dropped like an overflow
+	if (granted > uint64_t(INT_MAX))
+	{
+		m_stats.overloaded_frames++;
+		m_stats.dropped_usec += (granted - uint64_t(INT_MAX))*m_step;
+		granted = uint64_t(INT_MAX);
+	}
+
+	m_stats.steps += granted;
+	m_stats.last_steps = int(granted);
+	return int(granted);
+}
+
+int SimGovernor::begin_forced_step()
+{
+	m_simulation_time = 1;
+	m_frame_start = std::chrono::steady_clock::now();
+	m_stats.steps++;
+	m_stats.last_steps = 1;
+	return 1;
+}
+
+void SimGovernor::end_frame(int steps_run)
+{
+	if (steps_run <= 0)
+		return;
+
+	double usec = std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - m_frame_start).count();
+	double per_step = usec/steps_run;
+	if (m_stats.avg_step_usec <= 0.0)
+		m_stats.avg_step_usec = per_step;
+	else
+		m_stats.avg_step_usec = 0.8*m_stats.avg_step_usec + 0.2*per_step;
+}
@@ -0,0 +1,86 @@
+#ifndef simgovernorH
+#define simgovernorH
+
+#include <chrono>
+#include <cstdint>
+
+struct SimGovernorStats
+{
+	uint64_t frames;          // begin_frame() calls
+	uint64_t steps;           // simulation steps granted
+	uint64_t overloaded_frames; // frames in which the budget was hit
+	uint64_t dropped_usec;    // real time that was never simulated
+	int last_steps;           // steps granted in the last frame
+	double avg_step_usec;     // measured wall time of one step
+};
+
+// Decides how many fixed simulation steps a frame may run.
+// Elapsed real time is accumulated as before, but the number of catch-up
+// steps per frame is bounded, either by a fixed count or by a wall-clock
+// budget (the step cost is measured with a steady high resolution clock),
+// so one late frame can not make the next ones late too.
+class SimGovernor
+{
+public:
+	enum Budget
+	{
+		BUDGET_UNLIMITED, // old behaviour, catch up everything
+		BUDGET_STEPS,     // at most max_steps per frame
+		BUDGET_TIME       // as many steps as fit into usec per frame
+	};
+	enum Overflow
+	{
+		// excess time is discarded at once, simulation skips ahead
+		OVERFLOW_DROP,
+		// at most one more frame budget is kept as backlog, the simulation
+		// runs at the budget rate (slow motion) and catches up after short
+		// hitches, anything beyond is discarded
+		OVERFLOW_SLOW_MOTION
+	};
+
+	explicit SimGovernor(uint64_t usec_step_time);
+
+	void set_step_budget(int max_steps);
+	void set_time_budget(uint64_t usec);
+	void set_unlimited();
+	void set_overflow(Overflow overflow);
+	Budget get_budget() const { return m_budget; }
+	Overflow get_overflow() const { return m_overflow; }
+
+	// adds real time elapsed since the previous call, returns steps to run
+	int begin_frame(uint64_t usec_time);
+	// one step regardless of time, the backlog is discarded (touch path)
+	int begin_forced_step();
+	// steps actually run since begin_*(), updates the step cost estimate
+	void end_frame(int steps_run);
+
+	// drops the time not simulated yet, the next begin_frame() counts from
+	// usec_time (pass get_last_call() to keep the caller's clock)
+	void reset(uint64_t usec_time);
+	uint64_t get_last_call() const { return m_last_call; }
+	const SimGovernorStats& get_stats() const { return m_stats; }
+	void reset_stats();
+
+	uint64_t get_step_time() const { return m_step; }
+	void set_step_time(uint64_t usec) { m_step = usec > 0 ? usec : 1; }
+	// real time not simulated yet (less than one step unless over budget)
+	uint64_t get_accumulated_time() const { return m_simulation_time; }
+	void set_accumulated_time(uint64_t usec) { m_simulation_time = usec; }
+
+private:
+	int frame_limit() const;
+
+	uint64_t m_step;
+	uint64_t m_simulation_time;
+	uint64_t m_last_call;
+
+	Budget m_budget;
+	Overflow m_overflow;
+	int m_max_steps;
+	uint64_t m_usec_budget;
+
+	std::chrono::steady_clock::time_point m_frame_start;
+	SimGovernorStats m_stats;
+};
+
+#endif
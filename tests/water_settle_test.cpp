@@ -0,0 +1,93 @@
+// Long-run check of the CPU solver: after one touch the mean level must
+// stay where it was and the surface must come to rest, in double mode and
+// in fixed-point mode with every row kernel the CPU supports.
+// Exits with 1 and prints the failing configuration otherwise.
+
+#include "water_sim.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static const int GRID_X = 400;
+static const int GRID_Z = 200;
+static const int STEPS = 4000;
+static const double STRENGTH = 0.05;
+
+struct SettleResult
+{
+	double mean_before;
+	double mean_after;
+	double amplitude; // largest distance from the mean after STEPS
+	double flicker;   // largest height change of one more step
+};
+
+static double mean_of(const std::vector<float>& heights)
+{
+	double sum = 0.0;
+	for (size_t a = 0; a < heights.size(); ++a)
+		sum += heights[a];
+	return sum/heights.size();
+}
+
+static bool run(bool fixed, WaveIsa isa, SettleResult& result)
+{
+	WaterSim water(8.0f, 4.0f, GRID_X, GRID_Z, 0.4f, 0.01f, 0.995f, 10000);
+	water.set_isa(isa);
+	if (!water.set_fixed_point(fixed) || !water.init())
+		return false;
+
+	std::vector<float> heights(size_t(GRID_X)*GRID_Z);
+	std::vector<float> next(heights.size());
+	water.copy_heights(&heights.front());
+	result.mean_before = mean_of(heights);
+	water.touch(100, 60, STRENGTH, 8.0);
+	for (int s = 0; s < STEPS; s++)
+		water.update_model(0, true);
+
+	water.copy_heights(&heights.front());
+	result.mean_after = mean_of(heights);
+	result.amplitude = 0.0;
+	for (size_t a = 0; a < heights.size(); ++a)
+		result.amplitude = std::max(result.amplitude, fabs(heights[a] - result.mean_after));
+
+	water.update_model(0, true);
+	water.copy_heights(&next.front());
+	result.flicker = 0.0;
+	for (size_t a = 0; a < heights.size(); ++a)
+		result.flicker = std::max(result.flicker, double(fabs(next[a] - heights[a])));
+	return true;
+}
+
+static bool check(const char* name, bool fixed, WaveIsa isa)
+{
+	SettleResult r;
+	if (!run(fixed, isa, r))
+	{
+		printf("%s: initialization failed\n", name);
+		return false;
+	}
+	// fixed point: the mean within one height unit (1/16384 by default),
+	// waves down to a few units and at most a one unit flicker left
+	double unit = 1.0/16384.0;
+	double mean_limit = fixed ? unit : 1.0e-5;
+	double amplitude_limit = fixed ? 0.05*STRENGTH : 0.002*STRENGTH;
+	double flicker_limit = fixed ? 1.5*unit : 1.0e-6;
+	bool ok = fabs(r.mean_after - r.mean_before) <= mean_limit &&
+		r.amplitude <= amplitude_limit && r.flicker <= flicker_limit;
+	printf("%s %s: mean %.3g -> %.3g, amplitude %.3g, flicker %.3g\n", ok ? "ok  " : "FAIL",
+		name, r.mean_before, r.mean_after, r.amplitude, r.flicker);
+	return ok;
+}
+
+int main()
+{
+	bool ok = check("double", false, wave_detect_isa());
+	for (int a = 0; a <= int(wave_detect_isa()); a++)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "fixed %s", wave_isa_name(WaveIsa(a)));
+		ok = check(name, true, WaveIsa(a)) && ok;
+	}
+	return ok ? 0 : 1;
+}
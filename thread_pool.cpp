@@ -0,0 +1,164 @@
+#include "thread_pool.h"
+#include <cstdio>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+static bool pin_thread(std::thread::native_handle_type handle, int core)
+{
+#ifdef _WIN32
+	int bits = int(sizeof(DWORD_PTR)*8);
+	DWORD_PTR mask = DWORD_PTR(1) << (core % bits);
+	return SetThreadAffinityMask((HANDLE)handle, mask) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core % CPU_SETSIZE, &set);
+	return pthread_setaffinity_np(handle, sizeof(set), &set) == 0;
+#else
+	(void)handle;
+	(void)core;
+	return false;
+#endif
+}
+
+
+ThreadPool::ThreadPool()
+{
+	m_thread_count = 1;
+	m_pinned = false;
+	m_job = 0;
+	m_quit = false;
+	m_task = nullptr;
+	m_ctx = nullptr;
+	m_done = 0;
+	m_barrier_count = 0;
+	m_barrier_gen = 0;
+}
+
+ThreadPool::~ThreadPool()
+{
+	release();
+}
+
+int ThreadPool::hardware_threads()
+{
+	int n = int(std::thread::hardware_concurrency());
+	return n > 0 ? n : 1;
+}
+
+bool ThreadPool::init(int threads, bool pin_threads)
+{
+	release();
+	if (threads < 0)
+	{
+		fprintf(stderr, "Invalid number of threads.\n");
+		return false;
+	}
+	if (threads == 0)
+		threads = hardware_threads();
+
+	m_thread_count = threads;
+	m_pinned = pin_threads;
+	m_quit = false;
+	m_job = 0;
+
+	// the calling thread is worker 0 and is never pinned,
+	// it usually is the render thread
+	for (int w = 1; w < m_thread_count; w++)
+	{
+		m_threads.push_back(std::thread(&ThreadPool::worker_loop, this, w));
+		if (m_pinned && !pin_thread(m_threads.back().native_handle(), w))
+			fprintf(stderr, "Pinning of worker thread %d failed.\n", w);
+	}
+	return true;
+}
+
+void ThreadPool::release()
+{
+	if (!m_threads.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_wake.notify_all();
+		for (size_t a = 0; a < m_threads.size(); ++a)
+			m_threads[a].join();
+		m_threads.clear();
+	}
+	m_thread_count = 1;
+	m_pinned = false;
+}
+
+void ThreadPool::run(Task task, void* ctx)
+{
+	if (m_thread_count <= 1)
+	{
+		task(ctx, 0, 1);
+		return;
+	}
+
+	m_done.store(0);
+	m_barrier_count.store(0);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = task;
+		m_ctx = ctx;
+		++m_job;
+	}
+	m_wake.notify_all();
+
+	task(ctx, 0, m_thread_count);
+
+	while (m_done.load(std::memory_order_acquire) != m_thread_count - 1)
+		std::this_thread::yield();
+}
+
+void ThreadPool::barrier()
+{
+	if (m_thread_count <= 1)
+		return;
+
+	unsigned gen = m_barrier_gen.load(std::memory_order_acquire);
+	if (m_barrier_count.fetch_add(1, std::memory_order_acq_rel) + 1 == m_thread_count)
+	{
+		m_barrier_count.store(0, std::memory_order_relaxed);
+		m_barrier_gen.fetch_add(1, std::memory_order_release);
+	}
+	else
+	{
+		while (m_barrier_gen.load(std::memory_order_acquire) == gen)
+			std::this_thread::yield();
+	}
+}
+
+void ThreadPool::worker_loop(int worker)
+{
+	unsigned seen = 0;
+	for (;;)
+	{
+		Task task;
+		void* ctx;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (!m_quit && m_job == seen)
+				m_wake.wait(lock);
+			if (m_quit)
+				return;
+			seen = m_job;
+			task = m_task;
+			ctx = m_ctx;
+		}
+
+		task(ctx, worker, m_thread_count);
+		m_done.fetch_add(1, std::memory_order_release);
+	}
+}
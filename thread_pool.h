@@ -0,0 +1,59 @@
+#ifndef threadpoolH
+#define threadpoolH
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads for data-parallel simulation steps.
+// run() executes the same task on every worker (the calling thread is
+// worker 0) and returns when all of them have finished. Inside a task the
+// workers can synchronise with barrier(), e.g. between simulation sub-steps.
+class ThreadPool
+{
+public:
+	typedef void (*Task)(void* ctx, int worker, int workers);
+
+	ThreadPool();
+	~ThreadPool();
+
+	// threads includes the calling thread, 0 means one per hardware thread;
+	// with pin_threads worker n is bound to logical core n
+	bool init(int threads, bool pin_threads);
+	void release();
+
+	void run(Task task, void* ctx);
+	// must be reached by all workers of the current run()
+	void barrier();
+
+	int get_thread_count() const { return m_thread_count; }
+	bool get_pinned() const { return m_pinned; }
+	static int hardware_threads();
+
+private:
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void worker_loop(int worker);
+
+	int m_thread_count;
+	bool m_pinned;
+	std::vector<std::thread> m_threads;
+
+	// job hand-off
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	unsigned m_job;
+	bool m_quit;
+	Task m_task;
+	void* m_ctx;
+	std::atomic<int> m_done;
+
+	// sense-reversing barrier
+	std::atomic<int> m_barrier_count;
+	std::atomic<unsigned> m_barrier_gen;
+};
+
+#endif
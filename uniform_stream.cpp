@@ -0,0 +1,198 @@
+#include "uniform_stream.h"
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+
+
+static GLuint uniform_program_name(const glp::Program& program)
+{
+	// glp::Program does not expose its GL name
+	glp::Device::bind_program(program);
+	GLint name = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &name);
+	return GLuint(name);
+}
+
+void uniform_bind_blocks(const glp::Program& program)
+{
+	GLuint name = uniform_program_name(program);
+	GLuint camera = glGetUniformBlockIndex(name, "Camera");
+	if (camera != GL_INVALID_INDEX)
+		glUniformBlockBinding(name, camera, UNIFORM_BINDING_CAMERA);
+	GLuint draw = glGetUniformBlockIndex(name, "Draw");
+	if (draw != GL_INVALID_INDEX)
+		glUniformBlockBinding(name, draw, UNIFORM_BINDING_DRAW);
+	glp::Device::unbind_program(program);
+}
+
+GLint uniform_location(const glp::Program& program, const char* name)
+{
+	GLint location = glGetUniformLocation(uniform_program_name(program), name);
+	glp::Device::unbind_program(program);
+	return location;
+}
+
+bool gl_has_buffer_storage()
+{
+	GLint major = 0;
+	GLint minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major > 4 || (major == 4 && minor >= 4))
+		return true;
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint a = 0; a < count; a++)
+	{
+		const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(a)));
+		if (name != nullptr && strcmp(name, "GL_ARB_buffer_storage") == 0)
+			return true;
+	}
+	return false;
+}
+
+
+UniformStream::UniformStream()
+{
+	m_buffer = 0;
+	m_ptr = nullptr;
+	m_chunk_bytes = 0;
+	m_chunks = 0;
+	m_align = 256;
+	m_chunk = 0;
+	m_used = 0;
+	memset(&m_camera, 0, sizeof(m_camera));
+	m_camera_set = false;
+}
+
+bool UniformStream::init(GLsizeiptr chunk_bytes, int chunks)
+{
+	release();
+	GLint align = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+	m_align = align > 0 ? align : 256;
+	// whole aligned slots, room for the camera and at least one draw
+	GLsizeiptr slot = (GLsizeiptr(sizeof(UniformCamera)) + m_align - 1)/m_align*m_align;
+	m_chunk_bytes = std::max(chunk_bytes, 2*slot)/m_align*m_align;
+	m_chunks = std::max(chunks, 2);
+
+	GLsizeiptr bytes = m_chunk_bytes*m_chunks;
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	bool persistent = gl_has_buffer_storage();
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+	if (persistent)
+	{
+		glBufferStorage(GL_UNIFORM_BUFFER, bytes, nullptr, flags);
+		m_ptr = static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, bytes, flags));
+	}
+	else
+		glBufferData(GL_UNIFORM_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	if (persistent && m_ptr == nullptr)
+	{
+		fprintf(stderr, "Mapping of uniform buffer failed.\n");
+		release();
+		return false;
+	}
+	m_fences.assign(m_chunks, nullptr);
+	m_chunk = 0;
+	m_used = 0;
+	m_camera_set = false;
+	return true;
+}
+
+void UniformStream::release()
+{
+	for (size_t a = 0; a < m_fences.size(); ++a)
+		if (m_fences[a] != nullptr)
+			glDeleteSync(m_fences[a]);
+	m_fences.clear();
+	if (m_ptr != nullptr)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		m_ptr = nullptr;
+	}
+	if (m_buffer != 0)
+		glDeleteBuffers(1, &m_buffer);
+	m_buffer = 0;
+}
+
+void UniformStream::set_camera(const math::Mat4x4f& proj, const math::Mat4x4f& view,
+	const math::Mat4x4f& view_rot, const math::Vec3f& viewer_pos)
+{
+	memcpy(m_camera.proj, proj.m, sizeof(m_camera.proj));
+	memcpy(m_camera.view, view.m, sizeof(m_camera.view));
+	memcpy(m_camera.view_rot, view_rot.m, sizeof(m_camera.view_rot));
+	memcpy(m_camera.viewer_pos, viewer_pos.m, 3*sizeof(float));
+	m_camera.viewer_pos[3] = 1.0f;
+	m_camera_set = true;
+	push(UNIFORM_BINDING_CAMERA, &m_camera, sizeof(m_camera));
+}
+
+void UniformStream::set_draw(const math::Mat4x4f& model, const math::Mat4x4f& model_view)
+{
+	UniformDraw draw;
+	memcpy(draw.model, model.m, sizeof(draw.model));
+	memcpy(draw.model_view, model_view.m, sizeof(draw.model_view));
+	push(UNIFORM_BINDING_DRAW, &draw, sizeof(draw));
+}
+
+void UniformStream::push(GLuint binding, const void* data, GLsizeiptr bytes)
+{
+	if (m_buffer == 0)
+		return;
+	GLsizeiptr slot = (bytes + m_align - 1)/m_align*m_align;
+	if (m_used + slot > m_chunk_bytes)
+		next_chunk();
+	GLintptr offset = GLintptr(m_chunk)*m_chunk_bytes + m_used;
+	write(offset, data, bytes);
+	m_used += slot;
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_buffer, offset, bytes);
+}
+
+void UniformStream::write(GLintptr offset, const void* data, GLsizeiptr bytes)
+{
+	if (m_ptr != nullptr)
+	{
+		memcpy(m_ptr + offset, data, bytes);
+		return;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, bytes, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformStream::next_chunk()
+{
+	// draws issued so far are the last ones reading the current chunk
+	if (m_ptr != nullptr)
+		m_fences[m_chunk] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_chunk = (m_chunk + 1) % m_chunks;
+	m_used = 0;
+	if (m_ptr == nullptr && m_chunk == 0)
+	{
+		// new storage for the next round, the driver keeps the old one
+		// alive until the draws reading it have run
+		glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, m_chunk_bytes*m_chunks, nullptr, GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	if (m_fences[m_chunk] != nullptr)
+	{
+		glClientWaitSync(m_fences[m_chunk], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+		glDeleteSync(m_fences[m_chunk]);
+		m_fences[m_chunk] = nullptr;
+	}
+	if (m_camera_set)
+	{
+		// the camera range of the previous chunk may be overwritten
+		// before the draws of this one have run
+		GLintptr offset = GLintptr(m_chunk)*m_chunk_bytes;
+		write(offset, &m_camera, sizeof(m_camera));
+		m_used = (GLsizeiptr(sizeof(m_camera)) + m_align - 1)/m_align*m_align;
+		glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BINDING_CAMERA, m_buffer, offset, sizeof(m_camera));
+	}
+}
@@ -0,0 +1,96 @@
+#ifndef uniformstreamH
+#define uniformstreamH
+
+#include "glplus.h"
+#include <vector>
+
+// Binding points of the uniform blocks shared by the shaders. Every
+// program that uses the camera or per-draw matrices declares, verbatim:
+//
+//   layout(std140, row_major) uniform Camera
+//   {
+//   	mat4 proj;
+//   	mat4 view;      // inverse camera transform
+//   	mat4 viewRot;   // its rotation only (skybox)
+//   	vec3 viewerPos;
+//   };
+//   layout(std140, row_major) uniform Draw
+//   {
+//   	mat4 model;
+//   	mat4 modelView;
+//   };
+//
+// and calls uniform_bind_blocks() once after link(). Matrices are stored
+// as math::Mat4x4f keeps them (row_major), as uniform_mat4x4(..., true).
+static const GLuint UNIFORM_BINDING_CAMERA = 0;
+static const GLuint UNIFORM_BINDING_DRAW = 1;
+
+struct UniformCamera
+{
+	float proj[16];
+	float view[16];
+	float view_rot[16];
+	float viewer_pos[4];
+};
+
+struct UniformDraw
+{
+	float model[16];
+	float model_view[16];
+};
+
+// connects the Camera and Draw blocks of program (where declared) to
+// their binding points; call once after link()
+void uniform_bind_blocks(const glp::Program& program);
+// location of a uniform that changes after link (glUniform*), resolved
+// once so that the render path needs no string lookups
+GLint uniform_location(const glp::Program& program, const char* name);
+// persistently mapped buffers (glBufferStorage) are available: GL 4.4 or
+// ARB_buffer_storage; the 3.3 context may have neither
+bool gl_has_buffer_storage();
+
+// Uniform blocks streamed through one persistently mapped uniform buffer
+// (GL 4.4 / ARB_buffer_storage). The buffer is split in chunks; blocks
+// are appended to the current chunk and bound with glBindBufferRange,
+// a full chunk is fenced and the next one is reused once the GPU is
+// done with it. Without buffer storage the blocks are written with
+// glBufferSubData and the buffer is orphaned (glBufferData) whenever the
+// ring wraps around, so no fences are needed. The camera is written once per frame (and repeated at
+// the start of every chunk, so it stays valid when chunks wrap around);
+// the matrices of every draw get their own range.
+class UniformStream
+{
+public:
+	UniformStream();
+
+	bool init(GLsizeiptr chunk_bytes = 64*1024, int chunks = 4);
+	void release();
+
+	// start of a frame: camera of all following draws
+	void set_camera(const math::Mat4x4f& proj, const math::Mat4x4f& view,
+		const math::Mat4x4f& view_rot, const math::Vec3f& viewer_pos);
+	// matrices of the next draw (model_view = view*model)
+	void set_draw(const math::Mat4x4f& model, const math::Mat4x4f& model_view);
+
+private:
+	UniformStream(const UniformStream&);
+	UniformStream& operator=(const UniformStream&);
+
+	// copies data into the current chunk and binds it
+	void push(GLuint binding, const void* data, GLsizeiptr bytes);
+	void write(GLintptr offset, const void* data, GLsizeiptr bytes);
+	void next_chunk();
+
+	GLuint m_buffer;
+	char* m_ptr;        // nullptr without buffer storage
+	GLsizeiptr m_chunk_bytes;
+	int m_chunks;
+	GLsizeiptr m_align; // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	int m_chunk;
+	GLsizeiptr m_used;  // bytes of the current chunk
+	std::vector<GLsync> m_fences;
+	UniformCamera m_camera;
+	bool m_camera_set;
+};
+
+#endif
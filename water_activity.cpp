@@ -0,0 +1,152 @@
+#include "water_activity.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+
+WaterActivityMask::WaterActivityMask()
+{
+	m_rows = 0;
+	m_cols = 0;
+	m_tile_size = 0;
+	m_tiles_x = 0;
+	m_tiles_z = 0;
+	m_active_count = 0;
+	m_stepped_count = 0;
+}
+
+bool WaterActivityMask::init(int rows, int cols, int tile_size)
+{
+	release();
+	if (rows <= 0 || cols <= 0 || tile_size <= 0)
+	{
+		fprintf(stderr, "Invalid parameters of activity mask.\n");
+		return false;
+	}
+
+	m_rows = rows;
+	m_cols = cols;
+	m_tile_size = tile_size;
+	m_tiles_x = (rows + tile_size - 1)/tile_size;
+	m_tiles_z = (cols + tile_size - 1)/tile_size;
+	m_active.assign(m_tiles_x*m_tiles_z, 0);
+	m_stepped.assign(m_tiles_x*m_tiles_z, 0);
+	m_prev_stepped.assign(m_tiles_x*m_tiles_z, 0);
+	m_spans.resize(m_tiles_x);
+	return true;
+}
+
+void WaterActivityMask::release()
+{
+	m_active.clear();
+	m_stepped.clear();
+	m_prev_stepped.clear();
+	m_spans.clear();
+	m_tiles_x = 0;
+	m_tiles_z = 0;
+	m_active_count = 0;
+	m_stepped_count = 0;
+}
+
+void WaterActivityMask::wake(int i0, int i1, int j0, int j1)
+{
+	// halo cells belong to the outermost tiles
+	i0 = std::max(i0, 1);
+	j0 = std::max(j0, 1);
+	i1 = std::min(i1, m_rows + 1);
+	j1 = std::min(j1, m_cols + 1);
+	if (i0 >= i1 || j0 >= j1)
+		return;
+
+	for (int tx = (i0 - 1)/m_tile_size; tx <= (i1 - 2)/m_tile_size; tx++)
+		for (int tz = (j0 - 1)/m_tile_size; tz <= (j1 - 2)/m_tile_size; tz++)
+			m_active[tx*m_tiles_z + tz] = 1;
+}
+
+void WaterActivityMask::wake_all()
+{
+	std::fill(m_active.begin(), m_active.end(), 1);
+	m_active_count = get_tile_count();
+}
+
+void WaterActivityMask::plan(int steps, const WaterField& u, WaterField& u_new)
+{
+	// a wave moves at most one cell per step
+	int reach = std::max(1, (steps + m_tile_size - 1)/m_tile_size);
+
+	std::fill(m_stepped.begin(), m_stepped.end(), 0);
+	for (int tx = 0; tx < m_tiles_x; tx++)
+		for (int tz = 0; tz < m_tiles_z; tz++)
+		{
+			if (!m_active[tx*m_tiles_z + tz])
+				continue;
+			int x1 = std::min(m_tiles_x - 1, tx + reach);
+			int z1 = std::min(m_tiles_z - 1, tz + reach);
+			for (int x = std::max(0, tx - reach); x <= x1; x++)
+				memset(&m_stepped[x*m_tiles_z + std::max(0, tz - reach)], 1, z1 - std::max(0, tz - reach) + 1);
+		}
+
+	m_stepped_count = 0;
+	for (int tx = 0; tx < m_tiles_x; tx++)
+	{
+		m_spans[tx].clear();
+		int i0 = 1 + tx*m_tile_size;
+		int i1 = std::min(m_rows + 1, i0 + m_tile_size);
+		for (int tz = 0; tz < m_tiles_z; tz++)
+		{
+			int t = tx*m_tiles_z + tz;
+			int j0 = 1 + tz*m_tile_size;
+			int j1 = std::min(m_cols + 1, j0 + m_tile_size);
+			if (m_stepped[t])
+			{
+				m_stepped_count++;
+				if (!m_spans[tx].empty() && m_spans[tx].back().second == j0)
+					m_spans[tx].back().second = j1;
+				else
+					m_spans[tx].push_back(std::make_pair(j0, j1));
+			}
+			else if (m_prev_stepped[t])
+			{
+				for (int i = i0; i < i1; i++)
+					memcpy(u_new.row(i) + j0, u.row(i) + j0, (j1 - j0)*sizeof(double));
+			}
+		}
+	}
+}
+
+void WaterActivityMask::update_row(int tile_row, const WaterField& u, const WaterField& v, double rest, double threshold)
+{
+	int i0 = 1 + tile_row*m_tile_size;
+	int i1 = std::min(m_rows + 1, i0 + m_tile_size);
+	for (int tz = 0; tz < m_tiles_z; tz++)
+	{
+		int t = tile_row*m_tiles_z + tz;
+		if (!m_stepped[t])
+		{
+			m_active[t] = 0;
+			continue;
+		}
+		int j0 = 1 + tz*m_tile_size;
+		int j1 = std::min(m_cols + 1, j0 + m_tile_size);
+		bool active = false;
+		for (int i = i0; i < i1 && !active; i++)
+		{
+			const double* ur = u.row(i);
+			const double* vr = v.row(i);
+			for (int j = j0; j < j1; j++)
+				if (fabs(ur[j] - rest) > threshold || fabs(vr[j]) > threshold)
+				{
+					active = true;
+					break;
+				}
+		}
+		m_active[t] = active ? 1 : 0;
+	}
+}
+
+void WaterActivityMask::finish_update()
+{
+	m_prev_stepped = m_stepped;
+	m_active_count = int(std::count(m_active.begin(), m_active.end(), 1));
+}
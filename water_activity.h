@@ -0,0 +1,60 @@
+#ifndef wateractivityH
+#define wateractivityH
+
+#include "water_field.h"
+#include <utility>
+#include <vector>
+
+// Activity mask of the CPU wave solver for sparse stepping.
+// The grid is divided in square tiles; a tile is active while some cell
+// differs from the rest level (|u - rest|) or moves (|v|) by more than
+// a threshold. Only active tiles and tiles within reach of a wave are
+// stepped, so still water costs nothing.
+class WaterActivityMask
+{
+public:
+	WaterActivityMask();
+
+	bool init(int rows, int cols, int tile_size);
+	void release();
+
+	// marks tiles overlapping grid cells [i0, i1) x [j0, j1) as active
+	void wake(int i0, int i1, int j0, int j1);
+	void wake_all();
+
+	// selects tiles to step in the next steps steps: active tiles and
+	// every tile a wave can reach from them meanwhile (at least neighbours);
+	// tiles that fall asleep get u copied to u_new so that both buffers
+	// hold the same frozen state
+	void plan(int steps, const WaterField& u, WaterField& u_new);
+	// column ranges [first, second) of stepped cells in given tile row
+	const std::vector<std::pair<int, int> >& get_spans(int tile_row) const { return m_spans[tile_row]; }
+	int get_tile_row(int i) const { return (i - 1)/m_tile_size; }
+
+	// re-evaluates activity of the stepped tiles of tile_row, can be
+	// called for different tile rows in parallel
+	void update_row(int tile_row, const WaterField& u, const WaterField& v, double rest, double threshold);
+	// after all rows were updated
+	void finish_update();
+
+	int get_tile_size() const { return m_tile_size; }
+	int get_tile_rows() const { return m_tiles_x; }
+	int get_tile_count() const { return m_tiles_x*m_tiles_z; }
+	int get_active_count() const { return m_active_count; }
+	int get_stepped_count() const { return m_stepped_count; }
+
+private:
+	int m_rows;
+	int m_cols;
+	int m_tile_size;
+	int m_tiles_x;
+	int m_tiles_z;
+	std::vector<unsigned char> m_active;
+	std::vector<unsigned char> m_stepped;
+	std::vector<unsigned char> m_prev_stepped;
+	std::vector<std::vector<std::pair<int, int> > > m_spans;
+	int m_active_count;
+	int m_stepped_count;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "water_checkpoint.h"
+#include "water_field.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char WATER_CHECKPOINT_MAGIC[8] = { 'W', 'A', 'T', 'E', 'R', 'C', 'K', 'P' };
+
+
+static bool is_positive(double value)
+{
+	return std::isfinite(value) && value > 0.0;
+}
+
+static size_t align_up(size_t bytes)
+{
+	return (bytes + WATER_FIELD_ALIGNMENT - 1)/WATER_FIELD_ALIGNMENT*WATER_FIELD_ALIGNMENT;
+}
+
+size_t water_checkpoint_layout(WaterCheckpointHeader& header, uint32_t kind,
+	uint32_t element_bytes, int grid_x, int grid_z, size_t field_bytes)
+{
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, WATER_CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = WATER_CHECKPOINT_VERSION;
+	header.kind = kind;
+	header.header_bytes = sizeof(WaterCheckpointHeader);
+	header.element_bytes = element_bytes;
+	header.grid_x = grid_x;
+	header.grid_z = grid_z;
+	header.field_bytes = field_bytes;
+	header.u_offset = align_up(sizeof(WaterCheckpointHeader));
+	header.v_offset = align_up(header.u_offset + field_bytes);
+	return size_t(header.v_offset + field_bytes);
+}
+
+const WaterCheckpointHeader* water_checkpoint_header(const WaterMappedFile& file,
+	const char* path, uint32_t kind_a, uint32_t kind_b)
+{
+	const WaterCheckpointHeader* header = static_cast<const WaterCheckpointHeader*>(file.data());
+	if (file.size() < sizeof(WaterCheckpointHeader) ||
+		memcmp(header->magic, WATER_CHECKPOINT_MAGIC, sizeof(header->magic)) != 0)
+	{
+		fprintf(stderr, "%s is not a water checkpoint.\n", path);
+		return nullptr;
+	}
+	if (header->version != WATER_CHECKPOINT_VERSION || header->header_bytes != sizeof(WaterCheckpointHeader))
+	{
+		fprintf(stderr, "Unsupported version %u of water checkpoint %s.\n", header->version, path);
+		return nullptr;
+	}
+	if (header->kind != kind_a && header->kind != kind_b)
+	{
+		fprintf(stderr, "Water checkpoint %s was saved by another solver.\n", path);
+		return nullptr;
+	}
+	// offsets and sizes are compared without sums that could wrap
+	if (header->u_offset > file.size() || header->field_bytes > file.size() - header->u_offset ||
+		header->v_offset > file.size() || header->field_bytes > file.size() - header->v_offset)
+	{
+		fprintf(stderr, "Water checkpoint %s is truncated.\n", path);
+		return nullptr;
+	}
+	// the loaders assign these before any step, so nothing they derive
+	// from the parameters may see a zero, a NaN or an infinity
+	if (!is_positive(header->dim_x) || !is_positive(header->dim_z) ||
+		!is_positive(header->wave_speed) || !is_positive(header->dt) ||
+		!std::isfinite(header->damp_factor) || header->damp_factor < 0.0 || header->damp_factor > 1.0 ||
+		!std::isfinite(header->rest_level) ||
+		(header->kind == WATER_CHECKPOINT_CPU16 && !is_positive(header->fixed_scale)))
+	{
+		fprintf(stderr, "Water checkpoint %s has invalid simulation parameters.\n", path);
+		return nullptr;
+	}
+	return header;
+}
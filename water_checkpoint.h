@@ -0,0 +1,56 @@
+#ifndef watercheckpointH
+#define watercheckpointH
+
+#include "water_mapped_file.h"
+#include <cstddef>
+#include <cstdint>
+
+// Checkpoint file of a water simulation, written and read through a
+// memory mapping. A fixed header is followed by the height and velocity
+// fields, each starting on a cache line and stored exactly as they are
+// laid out in memory (WaterField with halo and row padding, or the RGBA
+// float texels of the GPU textures), so restoring is one copy per field.
+// Values are in native byte order.
+
+static const uint32_t WATER_CHECKPOINT_VERSION = 1;
+
+enum WaterCheckpointKind
+{
+	WATER_CHECKPOINT_CPU = 1,   // WaterSim, double fields
+	WATER_CHECKPOINT_CPU16 = 2, // WaterSim, fixed-point fields
+	WATER_CHECKPOINT_GPU = 3    // WaterSurface, RGBA float textures
+};
+
+struct WaterCheckpointHeader
+{
+	char magic[8];           // "WATERCKP"
+	uint32_t version;
+	uint32_t kind;           // WaterCheckpointKind
+	uint32_t header_bytes;   // sizeof(WaterCheckpointHeader)
+	uint32_t element_bytes;  // bytes per stored value
+	int32_t grid_x;
+	int32_t grid_z;
+	uint64_t field_bytes;    // bytes of each field
+	uint64_t u_offset;       // heights
+	uint64_t v_offset;       // velocities
+	double dim_x;
+	double dim_z;
+	double wave_speed;
+	double dt;
+	double damp_factor;
+	double rest_level;       // added to stored heights at readback
+	double fixed_scale;      // height of one fixed-point unit
+	uint64_t usec_step_time;
+	uint64_t usec_accumulated; // simulation time not stepped yet
+};
+
+// fills magic, version, sizes and field offsets, returns the file size
+size_t water_checkpoint_layout(WaterCheckpointHeader& header, uint32_t kind,
+	uint32_t element_bytes, int grid_x, int grid_z, size_t field_bytes);
+// header of a mapped checkpoint of the given kinds (kind_b may repeat
+// kind_a), or nullptr if the file is not one, is truncated or holds
+// parameters no solver can run with
+const WaterCheckpointHeader* water_checkpoint_header(const WaterMappedFile& file,
+	const char* path, uint32_t kind_a, uint32_t kind_b);
+
+#endif
@@ -0,0 +1,27 @@
+#include "water_field.h"
+#include <cstdlib>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+
+void* water_aligned_alloc(size_t bytes)
+{
+#ifdef _WIN32
+	return _aligned_malloc(bytes, WATER_FIELD_ALIGNMENT);
+#else
+	void* ptr = nullptr;
+	if (posix_memalign(&ptr, WATER_FIELD_ALIGNMENT, bytes) != 0)
+		return nullptr;
+	return ptr;
+#endif
+}
+
+void water_aligned_free(void* ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
@@ -0,0 +1,193 @@
+#ifndef waterfieldH
+#define waterfieldH
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+static const size_t WATER_FIELD_ALIGNMENT = 64; // bytes, one cache line
+
+void* water_aligned_alloc(size_t bytes);
+void water_aligned_free(void* ptr);
+
+// Scalar field of the CPU wave solver (heights or velocities).
+// The whole field lives in a single cache-line aligned allocation:
+// rows are padded to a fixed pitch, and the simulated area is surrounded
+// by a one cell ghost halo (row/column 0 and rows+1/cols+1), so that
+// the 5-point stencil never has to branch on the borders.
+// The first interior cell of every row (column 1) is cache-line aligned.
+template <class T>
+class WaterFieldT
+{
+public:
+	static const size_t ALIGNMENT = WATER_FIELD_ALIGNMENT;
+
+	WaterFieldT();
+	~WaterFieldT();
+
+	// rows x cols is the simulated area, the halo is added internally
+	bool init(int rows, int cols);
+	void release();
+
+	void fill(T value);
+	// copy the outermost simulated cells into the ghost halo
+	void clamp_edges();
+	// same for simulated rows [row_begin, row_end) only, the top/bottom
+	// halo row is written by the band that contains row 1/rows
+	void clamp_edges(int row_begin, int row_end);
+	// exchange storage with other field of the same size (u <-> u_new)
+	void swap(WaterFieldT& other);
+
+	// i in [0, rows + 1], j in [0, cols + 1]
+	T* row(int i) { return m_origin + i*m_pitch; }
+	const T* row(int i) const { return m_origin + i*m_pitch; }
+	T& at(int i, int j) { return m_origin[i*m_pitch + j]; }
+	T at(int i, int j) const { return m_origin[i*m_pitch + j]; }
+
+	int get_rows() const { return m_rows; }
+	int get_cols() const { return m_cols; }
+	// distance (in elements) between two consecutive rows
+	size_t get_pitch() const { return m_pitch; }
+	// allocated bytes including halo and padding
+	size_t get_bytes() const { return m_bytes; }
+	// get_bytes() of a field initialized with rows x cols
+	static size_t layout_bytes(int rows, int cols);
+	// the whole allocation (get_bytes() long), its layout depends only on
+	// rows, cols and T, so it can be saved and restored as one block
+	void* data() { return m_memory; }
+	const void* data() const { return m_memory; }
+
+private:
+	WaterFieldT(const WaterFieldT&);
+	WaterFieldT& operator=(const WaterFieldT&);
+
+	static const size_t PER_LINE = WATER_FIELD_ALIGNMENT/sizeof(T);
+
+	int m_rows;
+	int m_cols;
+	size_t m_pitch;
+	size_t m_bytes;
+	void* m_memory;
+	T* m_origin; // element (0, 0), i.e. top-left halo cell
+};
+
+typedef WaterFieldT<double> WaterField;
+// fixed-point heights/velocities
+typedef WaterFieldT<short> WaterField16;
+
+
+template <class T>
+WaterFieldT<T>::WaterFieldT()
+{
+	m_rows = 0;
+	m_cols = 0;
+	m_pitch = 0;
+	m_bytes = 0;
+	m_memory = nullptr;
+	m_origin = nullptr;
+}
+
+template <class T>
+WaterFieldT<T>::~WaterFieldT()
+{
+	release();
+}
+
+template <class T>
+bool WaterFieldT<T>::init(int rows, int cols)
+{
+	release();
+	if (rows <= 0 || cols <= 0)
+	{
+		fprintf(stderr, "Invalid dimensions of water field.\n");
+		return false;
+	}
+
+	// every row starts PER_LINE - 1 elements before a cache line,
+	// so the left halo cell is the last element of the previous line
+	// and the first simulated cell is aligned
+	size_t lead = PER_LINE - 1;
+	size_t width = lead + size_t(cols) + 2;
+	m_pitch = (width + PER_LINE - 1)/PER_LINE*PER_LINE;
+	m_bytes = layout_bytes(rows, cols);
+
+	m_memory = water_aligned_alloc(m_bytes);
+	if (m_memory == nullptr)
+	{
+		fprintf(stderr, "Allocation of water field failed.\n");
+		m_bytes = 0;
+		m_pitch = 0;
+		return false;
+	}
+	memset(m_memory, 0, m_bytes);
+
+	m_rows = rows;
+	m_cols = cols;
+	m_origin = static_cast<T*>(m_memory) + lead;
+	return true;
+}
+
+template <class T>
+size_t WaterFieldT<T>::layout_bytes(int rows, int cols)
+{
+	size_t width = PER_LINE - 1 + size_t(cols) + 2;
+	size_t pitch = (width + PER_LINE - 1)/PER_LINE*PER_LINE;
+	return pitch*(size_t(rows) + 2)*sizeof(T);
+}
+
+template <class T>
+void WaterFieldT<T>::release()
+{
+	if (m_memory != nullptr)
+		water_aligned_free(m_memory);
+	m_memory = nullptr;
+	m_origin = nullptr;
+	m_rows = 0;
+	m_cols = 0;
+	m_pitch = 0;
+	m_bytes = 0;
+}
+
+template <class T>
+void WaterFieldT<T>::fill(T value)
+{
+	for (int i = 0; i < m_rows + 2; i++)
+		std::fill(row(i), row(i) + m_cols + 2, value);
+}
+
+template <class T>
+void WaterFieldT<T>::clamp_edges()
+{
+	clamp_edges(1, m_rows + 1);
+}
+
+template <class T>
+void WaterFieldT<T>::clamp_edges(int row_begin, int row_end)
+{
+	// left/right halo: two elements per row, the row is in cache anyway
+	for (int i = row_begin; i < row_end; i++)
+	{
+		T* r = row(i);
+		r[0] = r[1];
+		r[m_cols + 1] = r[m_cols];
+	}
+	// top/bottom halo: contiguous copies (corners included)
+	if (row_begin <= 1 && row_end > 1)
+		memcpy(row(0), row(1), (m_cols + 2)*sizeof(T));
+	if (row_begin <= m_rows && row_end > m_rows)
+		memcpy(row(m_rows + 1), row(m_rows), (m_cols + 2)*sizeof(T));
+}
+
+template <class T>
+void WaterFieldT<T>::swap(WaterFieldT& other)
+{
+	std::swap(m_rows, other.m_rows);
+	std::swap(m_cols, other.m_cols);
+	std::swap(m_pitch, other.m_pitch);
+	std::swap(m_bytes, other.m_bytes);
+	std::swap(m_memory, other.m_memory);
+	std::swap(m_origin, other.m_origin);
+}
+
+#endif
@@ -0,0 +1,51 @@
+#include "water_impulse.h"
+#include <cmath>
+#include <algorithm>
+#define M_PI 3.14159265358979323846
+
+
+WaterStamp::WaterStamp()
+{
+	m_distance = -1.0;
+	m_cell_size_x = 0.0;
+	m_cell_size_z = 0.0;
+	m_x0 = m_x1 = 0;
+	m_z0 = m_z1 = 0;
+}
+
+void WaterStamp::prepare(double distance, double cell_size_x, double cell_size_z)
+{
+	if (distance == m_distance && cell_size_x == m_cell_size_x && cell_size_z == m_cell_size_z)
+		return;
+	m_distance = distance;
+	m_cell_size_x = cell_size_x;
+	m_cell_size_z = cell_size_z;
+
+	// same window and falloff as the per-cell evaluation it replaces,
+	// cells outside distance get exactly zero and are left out
+	if (distance <= 0.0)
+	{
+		m_x0 = m_x1 = 0;
+		m_z0 = m_z1 = 0;
+		m_weights.clear();
+		return;
+	}
+	int nx = int(floor(distance/cell_size_x));
+	int nz = int(floor(distance/cell_size_z));
+	m_x0 = -std::min(nx, WATER_TOUCH_CELLS);
+	m_x1 = std::min(nx, WATER_TOUCH_CELLS - 1) + 1;
+	m_z0 = -std::min(nz, WATER_TOUCH_CELLS);
+	m_z1 = std::min(nz, WATER_TOUCH_CELLS - 1) + 1;
+
+	m_weights.resize((m_x1 - m_x0)*(m_z1 - m_z0));
+	for (int dx = m_x0; dx < m_x1; dx++)
+		for (int dz = m_z0; dz < m_z1; dz++)
+		{
+			double x_dist = dx*cell_size_x;
+			double z_dist = dz*cell_size_z;
+			double dist = sqrt(x_dist*x_dist + z_dist*z_dist);
+			if (dist <= distance) dist = dist/distance;
+			else dist = 1.0;
+			m_weights[(dx - m_x0)*(m_z1 - m_z0) + dz - m_z0] = (cos(dist * M_PI) + 1.0) / 2.0;
+		}
+}
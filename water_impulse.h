@@ -0,0 +1,46 @@
+#ifndef waterimpulseH
+#define waterimpulseH
+
+#include <vector>
+
+// brush of touch(): cells up to this far from the touch point are affected
+static const int WATER_TOUCH_CELLS = 10;
+
+// one queued touch, grid coordinates
+struct WaterImpulse
+{
+	int x;
+	int y;
+	double strength;
+	double distance;
+};
+
+// Cosine falloff brush, weight = (cos(pi*d/distance) + 1)/2 inside distance.
+// Weights are computed once and reused while distance and cell sizes stay
+// the same (mouse drags), so a touch costs a multiply per affected cell.
+class WaterStamp
+{
+public:
+	WaterStamp();
+
+	void prepare(double distance, double cell_size_x, double cell_size_z);
+
+	// non-zero weights lie in [x0, x1) x [z0, z1) relative to the touch point
+	int get_x0() const { return m_x0; }
+	int get_x1() const { return m_x1; }
+	int get_z0() const { return m_z0; }
+	int get_z1() const { return m_z1; }
+	double weight(int dx, int dz) const { return m_weights[(dx - m_x0)*(m_z1 - m_z0) + dz - m_z0]; }
+
+private:
+	double m_distance;
+	double m_cell_size_x;
+	double m_cell_size_z;
+	int m_x0;
+	int m_x1;
+	int m_z0;
+	int m_z1;
+	std::vector<double> m_weights;
+};
+
+#endif
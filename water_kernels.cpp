@@ -0,0 +1,203 @@
+#include "water_kernels.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define WAVE_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+WaveCoeffs wave_make_coeffs(double wave_speed, double dt, double damp_factor,
+	double cell_size_x, double cell_size_z)
+{
+	WaveCoeffs k;
+	k.force = wave_speed*wave_speed*dt/(cell_size_x*cell_size_z); // c^2*dt/h^2
+	k.damp = damp_factor;
+	k.dt = dt;
+	return k;
+}
+
+void wave_row_scalar(
+	const double* u_up, const double* u, const double* u_down,
+	double* v, double* u_new, int count, const WaveCoeffs& k)
+{
+	for (int j = 0; j < count; j++)
+	{
+		double lap = u_up[j] + u_down[j] + u[j - 1] + u[j + 1] - 4.0*u[j];
+		double vel = (v[j] + lap*k.force)*k.damp;
+		v[j] = vel;
+		u_new[j] = u[j] + vel*k.dt;
+	}
+}
+
+WaveCoeffs16 wave_make_coeffs16(const WaveCoeffs& k)
+{
+	WaveCoeffs16 k16;
+	// largest shift the multiplier still fits in 15 bits with
+	double f = k.force*k.dt*double(1 << WAVE_VEL_FRAC_BITS);
+	k16.force_shift = 15;
+	while (k16.force_shift > 0 && f*double(1 << k16.force_shift) > 32767.0)
+		k16.force_shift--;
+	k16.force = std::min(32767, int(floor(f*double(1 << k16.force_shift) + 0.5)));
+	k16.damp = std::min(32767, std::max(0, int(floor(k.damp*32768.0 + 0.5))));
+	return k16;
+}
+
+short wave_to_fixed(double value, double scale)
+{
+	double q = floor(value/scale + 0.5);
+	return short(std::min(32767.0, std::max(-32768.0, q)));
+}
+
+void wave_fixed_to_float(const short* src, float* dst, int count, float scale, float offset)
+{
+	for (int j = 0; j < count; j++)
+		dst[j] = float(src[j])*scale + offset;
+}
+
+void wave_row16_scalar(
+	const short* u_up, const short* u, const short* u_down,
+	short* v, short* u_new, int count, const WaveCoeffs16& k)
+{
+	for (int j = 0; j < count; j++)
+	{
+		int c = u[j];
+		int lap = wave_sat16(u_up[j] + u_down[j] + u[j - 1] + u[j + 1] - 4*c);
+		int vel = wave_sat16(v[j] + wave_round_shift(lap*k.force, k.force_shift));
+		vel = wave_trunc_shift(vel*k.damp, 15);
+		v[j] = short(vel);
+		u_new[j] = short(wave_sat16(c + wave_round_shift(vel, WAVE_VEL_FRAC_BITS)));
+	}
+}
+
+#ifdef WAVE_X86
+
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuidex(r, leaf, subleaf);
+	for (int a = 0; a < 4; a++)
+		regs[a] = (unsigned int)r[a];
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long xgetbv0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int lo, hi;
+	__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return (unsigned long long)hi << 32 | lo;
+#endif
+}
+
+static WaveIsa detect_x86()
+{
+	unsigned int r[4];
+	cpuid(0, 0, r);
+	unsigned int max_leaf = r[0];
+	if (max_leaf < 1)
+		return WAVE_ISA_SCALAR;
+
+	cpuid(1, 0, r);
+	bool sse41 = (r[2] & (1u << 19)) != 0;
+	bool osxsave = (r[2] & (1u << 27)) != 0;
+	bool avx = (r[2] & (1u << 28)) != 0;
+	if (!sse41)
+		return WAVE_ISA_SCALAR;
+
+	// AVX state (XMM|YMM) must be enabled by the OS
+	if (!avx || !osxsave)
+		return WAVE_ISA_SSE4;
+	unsigned long long xcr0 = xgetbv0();
+	if ((xcr0 & 0x6) != 0x6 || max_leaf < 7)
+		return WAVE_ISA_SSE4;
+
+	cpuid(7, 0, r);
+	bool avx2 = (r[1] & (1u << 5)) != 0;
+	bool avx512f = (r[1] & (1u << 16)) != 0;
+	if (!avx2)
+		return WAVE_ISA_SSE4;
+
+	// opmask, ZMM_Hi256 and Hi16_ZMM state
+	if (avx512f && (xcr0 & 0xe0) == 0xe0)
+		return WAVE_ISA_AVX512;
+	return WAVE_ISA_AVX2;
+}
+
+#endif
+
+WaveIsa wave_detect_isa()
+{
+	static WaveIsa detected = WAVE_ISA_COUNT;
+	if (detected != WAVE_ISA_COUNT)
+		return detected;
+
+	WaveIsa isa = WAVE_ISA_SCALAR;
+#ifdef WAVE_X86
+	isa = detect_x86();
+#endif
+	// fall back if an implementation was not compiled in
+	if (isa == WAVE_ISA_AVX512 && wave_row_kernel_avx512() == nullptr)
+		isa = WAVE_ISA_AVX2;
+	if (isa == WAVE_ISA_AVX2 && wave_row_kernel_avx2() == nullptr)
+		isa = WAVE_ISA_SSE4;
+	if (isa == WAVE_ISA_SSE4 && wave_row_kernel_sse4() == nullptr)
+		isa = WAVE_ISA_SCALAR;
+
+	detected = isa;
+	return detected;
+}
+
+WaveRowKernel wave_get_row_kernel(WaveIsa isa)
+{
+	if (isa > wave_detect_isa())
+		isa = wave_detect_isa();
+
+	WaveRowKernel kernel = nullptr;
+	switch (isa)
+	{
+	case WAVE_ISA_AVX512: kernel = wave_row_kernel_avx512(); break;
+	case WAVE_ISA_AVX2: kernel = wave_row_kernel_avx2(); break;
+	case WAVE_ISA_SSE4: kernel = wave_row_kernel_sse4(); break;
+	default: break;
+	}
+	return kernel != nullptr ? kernel : wave_row_scalar;
+}
+
+WaveRowKernel16 wave_get_row_kernel16(WaveIsa isa)
+{
+	if (isa > wave_detect_isa())
+		isa = wave_detect_isa();
+
+	WaveRowKernel16 kernel = nullptr;
+	switch (isa)
+	{
+	case WAVE_ISA_AVX512: kernel = wave_row16_kernel_avx512(); break;
+	case WAVE_ISA_AVX2: kernel = wave_row16_kernel_avx2(); break;
+	case WAVE_ISA_SSE4: kernel = wave_row16_kernel_sse4(); break;
+	default: break;
+	}
+	return kernel != nullptr ? kernel : wave_row16_scalar;
+}
+
+const char* wave_isa_name(WaveIsa isa)
+{
+	switch (isa)
+	{
+	case WAVE_ISA_SCALAR: return "scalar";
+	case WAVE_ISA_SSE4: return "sse4";
+	case WAVE_ISA_AVX2: return "avx2";
+	case WAVE_ISA_AVX512: return "avx512";
+	default: return "unknown";
+	}
+}
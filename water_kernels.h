@@ -0,0 +1,112 @@
+#ifndef waterkernelsH
+#define waterkernelsH
+
+// Row kernels of the CPU wave equation step (5-point Laplacian,
+// velocity update and damping) with runtime CPU dispatch.
+//
+// Every implementation performs exactly the same IEEE operations in the
+// same order for each cell (no FMA contraction, no reassociation), so
+// results are bit-identical between ISA levels and between runs.
+
+enum WaveIsa
+{
+	WAVE_ISA_SCALAR = 0,
+	WAVE_ISA_SSE4,
+	WAVE_ISA_AVX2,
+	WAVE_ISA_AVX512,
+	WAVE_ISA_COUNT
+};
+
+// coefficients precomputed once per surface
+struct WaveCoeffs
+{
+	double force; // c^2*dt/(h_x*h_z)
+	double damp;  // damping factor applied to velocity
+	double dt;
+};
+
+// Processes count consecutive cells; all pointers point at the first one.
+// u_up/u_down are the rows above/below, u[-1] and u[count] must be valid.
+//   v     = (v + lap(u)*force)*damp
+//   u_new = u + v*dt
+typedef void (*WaveRowKernel)(
+	const double* u_up, const double* u, const double* u_down,
+	double* v, double* u_new, int count, const WaveCoeffs& k);
+
+WaveCoeffs wave_make_coeffs(double wave_speed, double dt, double damp_factor,
+	double cell_size_x, double cell_size_z);
+
+// best ISA supported by both the CPU and the OS
+WaveIsa wave_detect_isa();
+// kernel for isa (which must not exceed wave_detect_isa())
+WaveRowKernel wave_get_row_kernel(WaveIsa isa);
+const char* wave_isa_name(WaveIsa isa);
+
+// per-ISA implementations, nullptr when not compiled in
+void wave_row_scalar(
+	const double* u_up, const double* u, const double* u_down,
+	double* v, double* u_new, int count, const WaveCoeffs& k);
+WaveRowKernel wave_row_kernel_sse4();
+WaveRowKernel wave_row_kernel_avx2();
+WaveRowKernel wave_row_kernel_avx512();
+
+
+// Fixed-point variant: heights are int16 in units of a surface chosen
+// scale, velocities are stored as the height change of one step in
+// 1/2^WAVE_VEL_FRAC_BITS of that unit. All arithmetic saturates to int16
+// and rounds identically in every implementation (bit-identical results).
+static const int WAVE_VEL_FRAC_BITS = 4;
+
+struct WaveCoeffs16
+{
+	int force;       // force*dt*2^WAVE_VEL_FRAC_BITS in Q(force_shift)
+	int force_shift;
+	int damp;        // Q15
+};
+
+//   lap   = sat(lap(u))
+//   v     = (sat(v + lap*force)*damp)
+//   u_new = sat(u + v/2^WAVE_VEL_FRAC_BITS)
+// Shifts round half away from zero (wave_round_shift()), so positive and
+// negative waves lose the same and the mean level does not drift; the
+// damping product is truncated toward zero (wave_trunc_shift()), so small
+// velocities decay to 0 instead of being rounded back to themselves.
+typedef void (*WaveRowKernel16)(
+	const short* u_up, const short* u, const short* u_down,
+	short* v, short* u_new, int count, const WaveCoeffs16& k);
+
+WaveCoeffs16 wave_make_coeffs16(const WaveCoeffs& k);
+
+inline int wave_sat16(int x)
+{
+	return x < -32768 ? -32768 : (x > 32767 ? 32767 : x);
+}
+
+// x/2^shift rounded half away from zero; (x >> 31) is -1 for negative x
+inline int wave_round_shift(int x, int shift)
+{
+	if (shift <= 0)
+		return x;
+	return (x + (1 << (shift - 1)) + (x >> 31)) >> shift;
+}
+
+// x/2^shift truncated toward zero
+inline int wave_trunc_shift(int x, int shift)
+{
+	return (x + ((x >> 31) & ((1 << shift) - 1))) >> shift;
+}
+WaveRowKernel16 wave_get_row_kernel16(WaveIsa isa);
+
+// conversions between fixed-point and real heights/velocities
+// (offset is the level of a zero height)
+short wave_to_fixed(double value, double scale);
+void wave_fixed_to_float(const short* src, float* dst, int count, float scale, float offset);
+
+void wave_row16_scalar(
+	const short* u_up, const short* u, const short* u_down,
+	short* v, short* u_new, int count, const WaveCoeffs16& k);
+WaveRowKernel16 wave_row16_kernel_sse4();
+WaveRowKernel16 wave_row16_kernel_avx2();
+WaveRowKernel16 wave_row16_kernel_avx512();
+
+#endif
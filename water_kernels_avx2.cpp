@@ -0,0 +1,112 @@
+#include "water_kernels.h"
+
+// AVX2 row kernels (double and int16), built with the ISA enabled per
+// function so that the rest of the program does not require it; selected at
+// runtime by wave_get_row_kernel()/wave_get_row_kernel16().
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#if defined(__GNUC__)
+#define WAVE_TARGET __attribute__((target("avx2")))
+#else
+#define WAVE_TARGET
+#endif
+
+WAVE_TARGET
+static void wave_row_avx2(
+	const double* u_up, const double* u, const double* u_down,
+	double* v, double* u_new, int count, const WaveCoeffs& k)
+{
+	const __m256d force = _mm256_set1_pd(k.force);
+	const __m256d damp = _mm256_set1_pd(k.damp);
+	const __m256d dt = _mm256_set1_pd(k.dt);
+	const __m256d four = _mm256_set1_pd(4.0);
+
+	int j = 0;
+	for (; j + 4 <= count; j += 4)
+	{
+		// same operation order as wave_row_scalar()
+		__m256d c = _mm256_loadu_pd(u + j);
+		__m256d lap = _mm256_add_pd(_mm256_loadu_pd(u_up + j), _mm256_loadu_pd(u_down + j));
+		lap = _mm256_add_pd(lap, _mm256_loadu_pd(u + j - 1));
+		lap = _mm256_add_pd(lap, _mm256_loadu_pd(u + j + 1));
+		lap = _mm256_sub_pd(lap, _mm256_mul_pd(four, c));
+		__m256d vel = _mm256_mul_pd(_mm256_add_pd(_mm256_loadu_pd(v + j), _mm256_mul_pd(lap, force)), damp);
+		_mm256_storeu_pd(v + j, vel);
+		_mm256_storeu_pd(u_new + j, _mm256_add_pd(c, _mm256_mul_pd(vel, dt)));
+	}
+	if (j < count)
+		wave_row_scalar(u_up + j, u + j, u_down + j, v + j, u_new + j, count - j, k);
+}
+
+#define WAVE_LD(p) _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(p)))
+
+WAVE_TARGET
+static void wave_row16_avx2(
+	const short* u_up, const short* u, const short* u_down,
+	short* v, short* u_new, int count, const WaveCoeffs16& k)
+{
+	const __m256i kf = _mm256_set1_epi32(k.force);
+	const __m256i half = _mm256_set1_epi32(k.force_shift > 0 ? 1 << (k.force_shift - 1) : 0);
+	// sign correction of the rounding, none without a shift
+	const __m256i neg = _mm256_set1_epi32(k.force_shift > 0 ? -1 : 0);
+	const __m128i sf = _mm_cvtsi32_si128(k.force_shift);
+	const __m256i kd = _mm256_set1_epi32(k.damp);
+	const __m256i lo = _mm256_set1_epi32(-32768);
+	const __m256i hi = _mm256_set1_epi32(32767);
+	const __m256i damp_low = _mm256_set1_epi32((1 << 15) - 1);
+	const __m256i vel_half = _mm256_set1_epi32(1 << (WAVE_VEL_FRAC_BITS - 1));
+
+	int j = 0;
+	for (; j + 8 <= count; j += 8)
+	{
+		// 32-bit lanes, same rounding and saturation as wave_row16_scalar()
+		__m256i c = WAVE_LD(u + j);
+		__m256i lap = _mm256_add_epi32(_mm256_add_epi32(WAVE_LD(u_up + j), WAVE_LD(u_down + j)),
+			_mm256_add_epi32(WAVE_LD(u + j - 1), WAVE_LD(u + j + 1)));
+		lap = _mm256_sub_epi32(lap, _mm256_slli_epi32(c, 2));
+		lap = _mm256_min_epi32(_mm256_max_epi32(lap, lo), hi);
+		__m256i f = _mm256_mullo_epi32(lap, kf);
+		f = _mm256_add_epi32(_mm256_add_epi32(f, half), _mm256_and_si256(_mm256_srai_epi32(f, 31), neg));
+		f = _mm256_sra_epi32(f, sf);
+		__m256i vel = _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(WAVE_LD(v + j), f), lo), hi);
+		__m256i p = _mm256_mullo_epi32(vel, kd);
+		vel = _mm256_srai_epi32(_mm256_add_epi32(p, _mm256_and_si256(_mm256_srai_epi32(p, 31), damp_low)), 15);
+		__m256i h = _mm256_add_epi32(_mm256_add_epi32(vel, vel_half), _mm256_srai_epi32(vel, 31));
+		__m256i un = _mm256_add_epi32(c, _mm256_srai_epi32(h, WAVE_VEL_FRAC_BITS));
+		// packs saturates like wave_sat16()
+		_mm_storeu_si128((__m128i*)(v + j),
+			_mm_packs_epi32(_mm256_castsi256_si128(vel), _mm256_extracti128_si256(vel, 1)));
+		_mm_storeu_si128((__m128i*)(u_new + j),
+			_mm_packs_epi32(_mm256_castsi256_si128(un), _mm256_extracti128_si256(un, 1)));
+	}
+	if (j < count)
+		wave_row16_scalar(u_up + j, u + j, u_down + j, v + j, u_new + j, count - j, k);
+}
+
+#undef WAVE_LD
+
+WaveRowKernel wave_row_kernel_avx2()
+{
+	return wave_row_avx2;
+}
+
+WaveRowKernel16 wave_row16_kernel_avx2()
+{
+	return wave_row16_avx2;
+}
+
+#else
+
+WaveRowKernel wave_row_kernel_avx2()
+{
+	return nullptr;
+}
+
+WaveRowKernel16 wave_row16_kernel_avx2()
+{
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,110 @@
+#include "water_kernels.h"
+
+// AVX-512 row kernels (double and int16), built with the ISA enabled per
+// function so that the rest of the program does not require it; selected at
+// runtime by wave_get_row_kernel()/wave_get_row_kernel16().
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#if defined(__GNUC__)
+#define WAVE_TARGET __attribute__((target("avx512f")))
+#else
+#define WAVE_TARGET
+#endif
+
+WAVE_TARGET
+static void wave_row_avx512(
+	const double* u_up, const double* u, const double* u_down,
+	double* v, double* u_new, int count, const WaveCoeffs& k)
+{
+	const __m512d force = _mm512_set1_pd(k.force);
+	const __m512d damp = _mm512_set1_pd(k.damp);
+	const __m512d dt = _mm512_set1_pd(k.dt);
+	const __m512d four = _mm512_set1_pd(4.0);
+
+	int j = 0;
+	for (; j + 8 <= count; j += 8)
+	{
+		// same operation order as wave_row_scalar()
+		__m512d c = _mm512_loadu_pd(u + j);
+		__m512d lap = _mm512_add_pd(_mm512_loadu_pd(u_up + j), _mm512_loadu_pd(u_down + j));
+		lap = _mm512_add_pd(lap, _mm512_loadu_pd(u + j - 1));
+		lap = _mm512_add_pd(lap, _mm512_loadu_pd(u + j + 1));
+		lap = _mm512_sub_pd(lap, _mm512_mul_pd(four, c));
+		__m512d vel = _mm512_mul_pd(_mm512_add_pd(_mm512_loadu_pd(v + j), _mm512_mul_pd(lap, force)), damp);
+		_mm512_storeu_pd(v + j, vel);
+		_mm512_storeu_pd(u_new + j, _mm512_add_pd(c, _mm512_mul_pd(vel, dt)));
+	}
+	if (j < count)
+		wave_row_scalar(u_up + j, u + j, u_down + j, v + j, u_new + j, count - j, k);
+}
+
+#define WAVE_LD(p) _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(p)))
+
+WAVE_TARGET
+static void wave_row16_avx512(
+	const short* u_up, const short* u, const short* u_down,
+	short* v, short* u_new, int count, const WaveCoeffs16& k)
+{
+	const __m512i kf = _mm512_set1_epi32(k.force);
+	const __m512i half = _mm512_set1_epi32(k.force_shift > 0 ? 1 << (k.force_shift - 1) : 0);
+	// sign correction of the rounding, none without a shift
+	const __m512i neg = _mm512_set1_epi32(k.force_shift > 0 ? -1 : 0);
+	const __m128i sf = _mm_cvtsi32_si128(k.force_shift);
+	const __m512i kd = _mm512_set1_epi32(k.damp);
+	const __m512i lo = _mm512_set1_epi32(-32768);
+	const __m512i hi = _mm512_set1_epi32(32767);
+	const __m512i damp_low = _mm512_set1_epi32((1 << 15) - 1);
+	const __m512i vel_half = _mm512_set1_epi32(1 << (WAVE_VEL_FRAC_BITS - 1));
+
+	int j = 0;
+	for (; j + 16 <= count; j += 16)
+	{
+		// 32-bit lanes, same rounding and saturation as wave_row16_scalar()
+		__m512i c = WAVE_LD(u + j);
+		__m512i lap = _mm512_add_epi32(_mm512_add_epi32(WAVE_LD(u_up + j), WAVE_LD(u_down + j)),
+			_mm512_add_epi32(WAVE_LD(u + j - 1), WAVE_LD(u + j + 1)));
+		lap = _mm512_sub_epi32(lap, _mm512_slli_epi32(c, 2));
+		lap = _mm512_min_epi32(_mm512_max_epi32(lap, lo), hi);
+		__m512i f = _mm512_mullo_epi32(lap, kf);
+		f = _mm512_add_epi32(_mm512_add_epi32(f, half), _mm512_and_si512(_mm512_srai_epi32(f, 31), neg));
+		f = _mm512_sra_epi32(f, sf);
+		__m512i vel = _mm512_min_epi32(_mm512_max_epi32(_mm512_add_epi32(WAVE_LD(v + j), f), lo), hi);
+		__m512i p = _mm512_mullo_epi32(vel, kd);
+		vel = _mm512_srai_epi32(_mm512_add_epi32(p, _mm512_and_si512(_mm512_srai_epi32(p, 31), damp_low)), 15);
+		__m512i h = _mm512_add_epi32(_mm512_add_epi32(vel, vel_half), _mm512_srai_epi32(vel, 31));
+		__m512i un = _mm512_add_epi32(c, _mm512_srai_epi32(h, WAVE_VEL_FRAC_BITS));
+		// saturating narrowing, like wave_sat16()
+		_mm256_storeu_si256((__m256i*)(v + j), _mm512_cvtsepi32_epi16(vel));
+		_mm256_storeu_si256((__m256i*)(u_new + j), _mm512_cvtsepi32_epi16(un));
+	}
+	if (j < count)
+		wave_row16_scalar(u_up + j, u + j, u_down + j, v + j, u_new + j, count - j, k);
+}
+
+#undef WAVE_LD
+
+WaveRowKernel wave_row_kernel_avx512()
+{
+	return wave_row_avx512;
+}
+
+WaveRowKernel16 wave_row16_kernel_avx512()
+{
+	return wave_row16_avx512;
+}
+
+#else
+
+WaveRowKernel wave_row_kernel_avx512()
+{
+	return nullptr;
+}
+
+WaveRowKernel16 wave_row16_kernel_avx512()
+{
+	return nullptr;
+}
+
+#endif
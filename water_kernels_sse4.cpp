@@ -0,0 +1,121 @@
+#include "water_kernels.h"
+
+// SSE4.1 row kernels (double and int16), built with the ISA enabled per
+// function so that the rest of the program does not require it; selected at
+// runtime by wave_get_row_kernel()/wave_get_row_kernel16().
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <smmintrin.h>
+
+#if defined(__GNUC__)
+#define WAVE_TARGET __attribute__((target("sse4.1")))
+#else
+#define WAVE_TARGET
+#endif
+
+WAVE_TARGET
+static void wave_row_sse4(
+	const double* u_up, const double* u, const double* u_down,
+	double* v, double* u_new, int count, const WaveCoeffs& k)
+{
+	const __m128d force = _mm_set1_pd(k.force);
+	const __m128d damp = _mm_set1_pd(k.damp);
+	const __m128d dt = _mm_set1_pd(k.dt);
+	const __m128d four = _mm_set1_pd(4.0);
+
+	int j = 0;
+	for (; j + 2 <= count; j += 2)
+	{
+		// same operation order as wave_row_scalar()
+		__m128d c = _mm_loadu_pd(u + j);
+		__m128d lap = _mm_add_pd(_mm_loadu_pd(u_up + j), _mm_loadu_pd(u_down + j));
+		lap = _mm_add_pd(lap, _mm_loadu_pd(u + j - 1));
+		lap = _mm_add_pd(lap, _mm_loadu_pd(u + j + 1));
+		lap = _mm_sub_pd(lap, _mm_mul_pd(four, c));
+		__m128d vel = _mm_mul_pd(_mm_add_pd(_mm_loadu_pd(v + j), _mm_mul_pd(lap, force)), damp);
+		_mm_storeu_pd(v + j, vel);
+		_mm_storeu_pd(u_new + j, _mm_add_pd(c, _mm_mul_pd(vel, dt)));
+	}
+	if (j < count)
+		wave_row_scalar(u_up + j, u + j, u_down + j, v + j, u_new + j, count - j, k);
+}
+
+WAVE_TARGET
+static inline __m128i wave16_sse4(__m128i up, __m128i dn, __m128i l, __m128i r, __m128i c,
+	__m128i* vel, __m128i kf, __m128i half, __m128i neg, __m128i sf, __m128i kd)
+{
+	// 32-bit lanes, same rounding and saturation as wave_row16_scalar()
+	const __m128i lo = _mm_set1_epi32(-32768);
+	const __m128i hi = _mm_set1_epi32(32767);
+	const __m128i damp_low = _mm_set1_epi32((1 << 15) - 1);
+	const __m128i vel_half = _mm_set1_epi32(1 << (WAVE_VEL_FRAC_BITS - 1));
+	__m128i lap = _mm_add_epi32(_mm_add_epi32(up, dn), _mm_add_epi32(l, r));
+	lap = _mm_sub_epi32(lap, _mm_slli_epi32(c, 2));
+	lap = _mm_min_epi32(_mm_max_epi32(lap, lo), hi);
+	__m128i f = _mm_mullo_epi32(lap, kf);
+	f = _mm_add_epi32(_mm_add_epi32(f, half), _mm_and_si128(_mm_srai_epi32(f, 31), neg));
+	f = _mm_sra_epi32(f, sf);
+	__m128i v = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(*vel, f), lo), hi);
+	__m128i p = _mm_mullo_epi32(v, kd);
+	v = _mm_srai_epi32(_mm_add_epi32(p, _mm_and_si128(_mm_srai_epi32(p, 31), damp_low)), 15);
+	*vel = v;
+	__m128i h = _mm_add_epi32(_mm_add_epi32(v, vel_half), _mm_srai_epi32(v, 31));
+	return _mm_add_epi32(c, _mm_srai_epi32(h, WAVE_VEL_FRAC_BITS));
+}
+
+#define WAVE_LO(p) _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)(p)))
+
+WAVE_TARGET
+static void wave_row16_sse4(
+	const short* u_up, const short* u, const short* u_down,
+	short* v, short* u_new, int count, const WaveCoeffs16& k)
+{
+	const __m128i kf = _mm_set1_epi32(k.force);
+	const __m128i half = _mm_set1_epi32(k.force_shift > 0 ? 1 << (k.force_shift - 1) : 0);
+	// sign correction of the rounding, none without a shift
+	const __m128i neg = _mm_set1_epi32(k.force_shift > 0 ? -1 : 0);
+	const __m128i sf = _mm_cvtsi32_si128(k.force_shift);
+	const __m128i kd = _mm_set1_epi32(k.damp);
+
+	int j = 0;
+	for (; j + 8 <= count; j += 8)
+	{
+		__m128i v0 = WAVE_LO(v + j);
+		__m128i v1 = WAVE_LO(v + j + 4);
+		__m128i n0 = wave16_sse4(WAVE_LO(u_up + j), WAVE_LO(u_down + j),
+			WAVE_LO(u + j - 1), WAVE_LO(u + j + 1), WAVE_LO(u + j), &v0, kf, half, neg, sf, kd);
+		__m128i n1 = wave16_sse4(WAVE_LO(u_up + j + 4), WAVE_LO(u_down + j + 4),
+			WAVE_LO(u + j + 3), WAVE_LO(u + j + 5), WAVE_LO(u + j + 4), &v1, kf, half, neg, sf, kd);
+		// packs saturates like wave_sat16()
+		_mm_storeu_si128((__m128i*)(v + j), _mm_packs_epi32(v0, v1));
+		_mm_storeu_si128((__m128i*)(u_new + j), _mm_packs_epi32(n0, n1));
+	}
+	if (j < count)
+		wave_row16_scalar(u_up + j, u + j, u_down + j, v + j, u_new + j, count - j, k);
+}
+
+#undef WAVE_LO
+
+WaveRowKernel wave_row_kernel_sse4()
+{
+	return wave_row_sse4;
+}
+
+WaveRowKernel16 wave_row16_kernel_sse4()
+{
+	return wave_row16_sse4;
+}
+
+#else
+
+WaveRowKernel wave_row_kernel_sse4()
+{
+	return nullptr;
+}
+
+WaveRowKernel16 wave_row16_kernel_sse4()
+{
+	return nullptr;
+}
+
+#endif
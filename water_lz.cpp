@@ -0,0 +1,133 @@
+#include "water_lz.h"
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+static const int LZ_MIN_MATCH = 4;
+static const int LZ_HASH_BITS = 13;
+static const size_t LZ_MAX_OFFSET = 65535;
+
+
+static uint32_t read32(const unsigned char* p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static unsigned char* write_length(unsigned char* op, size_t length)
+{
+	while (length >= 255)
+	{
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (unsigned char)length;
+	return op;
+}
+
+static unsigned char* write_sequence(unsigned char* op, const unsigned char* literals,
+	size_t literal_count, size_t offset, size_t match)
+{
+	size_t match_code = match > 0 ? match - LZ_MIN_MATCH : 0;
+	*op++ = (unsigned char)((literal_count < 15 ? literal_count : 15) << 4 | (match_code < 15 ? match_code : 15));
+	if (literal_count >= 15)
+		op = write_length(op, literal_count - 15);
+	if (literal_count > 0)
+		memcpy(op, literals, literal_count);
+	op += literal_count;
+	if (match == 0)
+		return op;
+	*op++ = (unsigned char)(offset & 0xff);
+	*op++ = (unsigned char)(offset >> 8);
+	if (match_code >= 15)
+		op = write_length(op, match_code - 15);
+	return op;
+}
+
+size_t water_lz_bound(size_t bytes)
+{
+	return bytes + bytes/255 + 16;
+}
+
+size_t water_lz_compress(const unsigned char* src, size_t bytes, unsigned char* dst)
+{
+	// positions + 1 of the last sequence with each hash, 0 = none
+	std::vector<uint32_t> table(size_t(1) << LZ_HASH_BITS, 0);
+	unsigned char* op = dst;
+	size_t anchor = 0;
+	size_t ip = 0;
+	size_t misses = 0;
+	while (ip + LZ_MIN_MATCH <= bytes)
+	{
+		uint32_t sequence = read32(src + ip);
+		uint32_t hash = (sequence*2654435761u) >> (32 - LZ_HASH_BITS);
+		size_t ref = table[hash];
+		table[hash] = uint32_t(ip + 1);
+		if (ref == 0 || ip - (ref - 1) > LZ_MAX_OFFSET || read32(src + ref - 1) != sequence)
+		{
+			// incompressible data is skipped faster and faster
+			ip += 1 + (misses++ >> 6);
+			continue;
+		}
+		ref--;
+		size_t match = LZ_MIN_MATCH;
+		while (ip + match < bytes && src[ref + match] == src[ip + match])
+			match++;
+		op = write_sequence(op, src + anchor, ip - anchor, ip - ref, match);
+		ip += match;
+		anchor = ip;
+		misses = 0;
+	}
+	op = write_sequence(op, src + anchor, bytes - anchor, 0, 0);
+	return size_t(op - dst);
+}
+
+static bool read_length(const unsigned char*& ip, const unsigned char* end, size_t& length)
+{
+	unsigned char byte;
+	do
+	{
+		if (ip >= end)
+			return false;
+		byte = *ip++;
+		length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+bool water_lz_decompress(const unsigned char* src, size_t bytes, unsigned char* dst, size_t dst_bytes)
+{
+	const unsigned char* ip = src;
+	const unsigned char* end = src + bytes;
+	size_t op = 0;
+	while (ip < end)
+	{
+		unsigned char token = *ip++;
+		size_t literal_count = token >> 4;
+		if (literal_count == 15 && !read_length(ip, end, literal_count))
+			return false;
+		if (literal_count > size_t(end - ip) || literal_count > dst_bytes - op)
+			return false;
+		memcpy(dst + op, ip, literal_count);
+		ip += literal_count;
+		op += literal_count;
+		if (ip == end)
+			break;
+
+		if (end - ip < 2)
+			return false;
+		size_t offset = ip[0] | size_t(ip[1]) << 8;
+		ip += 2;
+		size_t match = token & 15;
+		if (match == 15 && !read_length(ip, end, match))
+			return false;
+		match += LZ_MIN_MATCH;
+		if (offset == 0 || offset > op || match > dst_bytes - op)
+			return false;
+		// the match may overlap the bytes it produces
+		for (size_t a = 0; a < match; a++, op++)
+			dst[op] = dst[op - offset];
+	}
+	return op == dst_bytes;
+}
@@ -0,0 +1,20 @@
+#ifndef waterlzH
+#define waterlzH
+
+#include <cstddef>
+
+// Small LZ77 byte compressor in the spirit of LZ4 (greedy matching with a
+// hash of 4-byte sequences, 64 KB window, no entropy coder), fast enough
+// to run per recorded frame. A block is a list of sequences: a token with
+// the literal and match lengths (4 bits each, 255-byte extensions), the
+// literals, a 16-bit little-endian offset and the match; the last
+// sequence has literals only.
+
+// worst case size of a compressed block of bytes
+size_t water_lz_bound(size_t bytes);
+// compresses src into dst (water_lz_bound(bytes) long), returns its size
+size_t water_lz_compress(const unsigned char* src, size_t bytes, unsigned char* dst);
+// decompresses exactly dst_bytes, false if the block is damaged
+bool water_lz_decompress(const unsigned char* src, size_t bytes, unsigned char* dst, size_t dst_bytes);
+
+#endif
@@ -0,0 +1,158 @@
+#include "water_mapped_file.h"
+#include <cstdio>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+WaterMappedFile::WaterMappedFile()
+{
+	m_data = nullptr;
+	m_size = 0;
+#ifdef _WIN32
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+#else
+	m_fd = -1;
+#endif
+}
+
+WaterMappedFile::~WaterMappedFile()
+{
+	close();
+}
+
+bool WaterMappedFile::open(const char* path)
+{
+	return map(path, 0, false);
+}
+
+bool WaterMappedFile::create(const char* path, size_t bytes)
+{
+	if (bytes == 0)
+	{
+		fprintf(stderr, "Can not map empty file %s.\n", path);
+		return false;
+	}
+	return map(path, bytes, true);
+}
+
+#ifdef _WIN32
+
+bool WaterMappedFile::map(const char* path, size_t bytes, bool writable)
+{
+	close();
+	m_file = CreateFileA(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+		FILE_SHARE_READ, nullptr, writable ? CREATE_ALWAYS : OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "Can not open %s.\n", path);
+		return false;
+	}
+	if (!writable)
+	{
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+		{
+			fprintf(stderr, "Can not map empty file %s.\n", path);
+			close();
+			return false;
+		}
+		bytes = size_t(size.QuadPart);
+	}
+
+	// the mapping of a new file extends it to bytes
+	unsigned long long size64 = bytes;
+	m_mapping = CreateFileMappingA(m_file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+		DWORD(size64 >> 32), DWORD(size64 & 0xffffffffu), nullptr);
+	if (m_mapping != nullptr)
+		m_data = MapViewOfFile(m_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, bytes);
+	if (m_data == nullptr)
+	{
+		fprintf(stderr, "Mapping of %s failed.\n", path);
+		close();
+		return false;
+	}
+	m_size = bytes;
+	return true;
+}
+
+void WaterMappedFile::close()
+{
+	if (m_data != nullptr)
+		UnmapViewOfFile(m_data);
+	if (m_mapping != nullptr)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_data = nullptr;
+	m_size = 0;
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool WaterMappedFile::map(const char* path, size_t bytes, bool writable)
+{
+	close();
+	m_fd = writable ? ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : ::open(path, O_RDONLY);
+	if (m_fd < 0)
+	{
+		fprintf(stderr, "Can not open %s.\n", path);
+		return false;
+	}
+	if (writable)
+	{
+		if (ftruncate(m_fd, off_t(bytes)) != 0)
+		{
+			fprintf(stderr, "Can not resize %s.\n", path);
+			close();
+			return false;
+		}
+	}
+	else
+	{
+		struct stat st;
+		if (fstat(m_fd, &st) != 0 || st.st_size == 0)
+		{
+			fprintf(stderr, "Can not map empty file %s.\n", path);
+			close();
+			return false;
+		}
+		bytes = size_t(st.st_size);
+	}
+
+	void* data = mmap(nullptr, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED)
+	{
+		fprintf(stderr, "Mapping of %s failed.\n", path);
+		close();
+		return false;
+	}
+	m_data = data;
+	m_size = bytes;
+	return true;
+}
+
+void WaterMappedFile::close()
+{
+	if (m_data != nullptr)
+		munmap(m_data, m_size);
+	if (m_fd >= 0)
+		::close(m_fd);
+	m_data = nullptr;
+	m_size = 0;
+	m_fd = -1;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef watermappedfileH
+#define watermappedfileH
+
+#include <cstddef>
+
+// Whole file mapped into memory (MapViewOfFile/mmap), used by
+// checkpoints and recordings so that loading is a plain memory read.
+class WaterMappedFile
+{
+public:
+	WaterMappedFile();
+	~WaterMappedFile();
+
+	// maps an existing file read-only
+	bool open(const char* path);
+	// creates (or truncates) the file with bytes size, mapped read-write;
+	// the data reaches the file on close()
+	bool create(const char* path, size_t bytes);
+	void close();
+
+	void* data() { return m_data; }
+	const void* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool is_open() const { return m_data != nullptr; }
+
+private:
+	WaterMappedFile(const WaterMappedFile&);
+	WaterMappedFile& operator=(const WaterMappedFile&);
+
+	bool map(const char* path, size_t bytes, bool writable);
+
+	void* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_fd;
+#endif
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "water_mesh.h"
+#include <cmath>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WATER_MESH_SSE2
+#endif
+
+
+static inline void water_mesh_vertex(const float* up, const float* h, const float* down,
+	int j, float x, float u, const WaterMeshParams& p, WaterMeshVertex* dst)
+{
+	// same operations as the vector path
+	float dx = (down[j] - up[j])*(0.5f/p.step_x);
+	float dz = (h[j + 1] - h[j - 1])*(0.5f/p.step_z);
+	float inv_len = 1.0f/std::sqrt(dx*dx + dz*dz + 1.0f);
+
+	dst->point[0] = x;
+	dst->point[1] = p.level + h[j];
+	dst->point[2] = p.origin_z + float(j)*p.step_z;
+	dst->coord[0] = u;
+	dst->coord[1] = (float(j) + 0.5f)/float(p.grid_z);
+	dst->normal[0] = -dx*inv_len;
+	dst->normal[1] = inv_len;
+	dst->normal[2] = -dz*inv_len;
+}
+
+void water_mesh_row(const float* up, const float* h, const float* down,
+	int i, const WaterMeshParams& p, WaterMeshVertex* dst)
+{
+	float x = p.origin_x + float(i)*p.step_x;
+	float u = (float(i) + 0.5f)/float(p.grid_x);
+	int j = 0;
+
+#ifdef WATER_MESH_SSE2
+	const __m128 half_x = _mm_set1_ps(0.5f/p.step_x);
+	const __m128 half_z = _mm_set1_ps(0.5f/p.step_z);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 level = _mm_set1_ps(p.level);
+	const __m128 step_z = _mm_set1_ps(p.step_z);
+	const __m128 origin_z = _mm_set1_ps(p.origin_z);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 grid_z = _mm_set1_ps(float(p.grid_z));
+	const __m128 xs = _mm_set1_ps(x);
+	const __m128 us = _mm_set1_ps(u);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	bool stream = (reinterpret_cast<uintptr_t>(dst) & 15) == 0;
+	for (; j + 4 <= p.grid_z; j += 4)
+	{
+		__m128 c = _mm_loadu_ps(h + j);
+		__m128 dx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j)), half_x);
+		__m128 dz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(h + j + 1), _mm_loadu_ps(h + j - 1)), half_z);
+		__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), one);
+		__m128 inv_len = _mm_div_ps(one, _mm_sqrt_ps(len2));
+
+		__m128 jf = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(j), _mm_set_epi32(3, 2, 1, 0)));
+		__m128 y = _mm_add_ps(level, c);
+		__m128 z = _mm_add_ps(origin_z, _mm_mul_ps(jf, step_z));
+		__m128 v = _mm_div_ps(_mm_add_ps(jf, half), grid_z);
+		__m128 nx = _mm_xor_ps(_mm_mul_ps(dx, inv_len), sign);
+		__m128 nz = _mm_xor_ps(_mm_mul_ps(dz, inv_len), sign);
+
+		// structure of arrays to 4 vertices of two 16 byte halves each:
+		// (x, y, z, u) and (v, nx, ny, nz)
+		__m128 a0 = xs, a1 = y, a2 = z, a3 = us;
+		__m128 b0 = v, b1 = nx, b2 = inv_len, b3 = nz;
+		_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+		_MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+		float* out = dst[j].point;
+		if (stream)
+		{
+			_mm_stream_ps(out + 0, a0);
+			_mm_stream_ps(out + 4, b0);
+			_mm_stream_ps(out + 8, a1);
+			_mm_stream_ps(out + 12, b1);
+			_mm_stream_ps(out + 16, a2);
+			_mm_stream_ps(out + 20, b2);
+			_mm_stream_ps(out + 24, a3);
+			_mm_stream_ps(out + 28, b3);
+		}
+		else
+		{
+			_mm_storeu_ps(out + 0, a0);
+			_mm_storeu_ps(out + 4, b0);
+			_mm_storeu_ps(out + 8, a1);
+			_mm_storeu_ps(out + 12, b1);
+			_mm_storeu_ps(out + 16, a2);
+			_mm_storeu_ps(out + 20, b2);
+			_mm_storeu_ps(out + 24, a3);
+			_mm_storeu_ps(out + 28, b3);
+		}
+	}
+	if (stream)
+		_mm_sfence();
+#endif
+
+	for (; j < p.grid_z; j++)
+		water_mesh_vertex(up, h, down, j, x, u, p, dst + j);
+}
+
+void water_mesh_indices(int grid_x, int grid_z, unsigned int* dst)
+{
+	for (int i = 0; i + 1 < grid_x; i++)
+		for (int j = 0; j + 1 < grid_z; j++)
+		{
+			unsigned int a = unsigned(i*grid_z + j);
+			unsigned int b = a + unsigned(grid_z);
+			// counter-clockwise seen from above (+y)
+			*dst++ = a;
+			*dst++ = a + 1;
+			*dst++ = b;
+			*dst++ = b;
+			*dst++ = a + 1;
+			*dst++ = b + 1;
+		}
+}
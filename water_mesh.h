@@ -0,0 +1,41 @@
+#ifndef watermeshH
+#define watermeshH
+
+// Displaced vertex grid of the water surface written on the CPU, one
+// vertex per simulated cell (centre), for renderers that draw the
+// surface as one mesh instead of sampling a height texture.
+
+// layout of the vertex buffer (32 bytes, attributes as Renderable's
+// point, coord and normal)
+struct WaterMeshVertex
+{
+	float point[3];
+	float coord[2];
+	float normal[3];
+};
+
+struct WaterMeshParams
+{
+	float origin_x; // x and z of vertex (0, 0)
+	float origin_z;
+	float step_x;   // distance of rows and of vertices in a row
+	float step_z;
+	float level;    // y of height 0
+	int grid_x;     // rows, for the texture coordinates
+	int grid_z;     // vertices per row
+};
+
+// Writes the vertices of row i from its heights h and the heights of the
+// rows up (i - 1) and down (i + 1), clamped at the edges by the caller;
+// h[-1] and h[grid_z] must be valid. The normal is the analytic one of
+// the central differences, normalize(-dh/dx, 1, -dh/dz). Four vertices
+// at a time with SSE2 where it is available, streaming stores when dst
+// is 16 byte aligned (write-combined buffer mappings).
+void water_mesh_row(const float* up, const float* h, const float* down,
+	int i, const WaterMeshParams& p, WaterMeshVertex* dst);
+
+// triangle indices of the grid_x x grid_z vertex grid, two triangles per
+// cell quad, (grid_x - 1)*(grid_z - 1)*6 indices
+void water_mesh_indices(int grid_x, int grid_z, unsigned int* dst);
+
+#endif
@@ -0,0 +1,373 @@
+#include "water_recording.h"
+#include "water_kernels.h"
+#include "water_lz.h"
+#include <algorithm>
+#include <cstring>
+
+static const char WATER_RECORDING_MAGIC[8] = { 'W', 'A', 'T', 'E', 'R', 'R', 'E', 'C' };
+
+
+// keyframe index of a closed recording, checked against the frames in
+// front of it; false if it is damaged
+static bool read_recording_index(const char* base, size_t size, const WaterRecordingHeader& header,
+	std::vector<WaterRecordingKey>& keys)
+{
+	// the count is bounded before it is multiplied
+	if (header.index_offset < sizeof(WaterRecordingHeader) || header.index_offset > size ||
+		header.index_count > (size - header.index_offset)/sizeof(WaterRecordingKey))
+		return false;
+	// every frame has at least its record before the index, and the
+	// first one is a keyframe
+	uint64_t frame_space = (header.index_offset - sizeof(WaterRecordingHeader))/sizeof(WaterRecordingFrame);
+	if (header.frame_count > frame_space || (header.frame_count == 0) != (header.index_count == 0))
+		return false;
+
+	keys.resize(size_t(header.index_count));
+	if (!keys.empty())
+		memcpy(&keys.front(), base + header.index_offset, keys.size()*sizeof(WaterRecordingKey));
+	for (size_t a = 0; a < keys.size(); ++a)
+	{
+		const WaterRecordingKey& key = keys[a];
+		if (key.frame >= header.frame_count || (a == 0 ? key.frame != 0 : key.frame <= keys[a - 1].frame) ||
+			key.offset < sizeof(WaterRecordingHeader) ||
+			key.offset > header.index_offset - sizeof(WaterRecordingFrame) ||
+			(a > 0 && key.offset <= keys[a - 1].offset) ||
+			!reinterpret_cast<const WaterRecordingFrame*>(base + key.offset)->key)
+		{
+			keys.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+WaterRecorder::WaterRecorder()
+{
+	m_file = nullptr;
+	memset(&m_header, 0, sizeof(m_header));
+	m_offset = 0;
+	m_stop = false;
+	m_dropped = 0;
+}
+
+WaterRecorder::~WaterRecorder()
+{
+	close();
+}
+
+bool WaterRecorder::open(const char* path, int grid_x, int grid_z, int interval,
+	uint64_t usec_step_time, double scale, int key_interval, int max_pending)
+{
+	close();
+	if (grid_x <= 0 || grid_z <= 0 || interval <= 0 || scale <= 0.0 || key_interval <= 0 || max_pending <= 0)
+	{
+		fprintf(stderr, "Invalid parameters of water recording.\n");
+		return false;
+	}
+	m_file = fopen(path, "wb");
+	if (m_file == nullptr)
+	{
+		fprintf(stderr, "Can not open %s.\n", path);
+		return false;
+	}
+
+	memcpy(m_header.magic, WATER_RECORDING_MAGIC, sizeof(m_header.magic));
+	m_header.version = WATER_RECORDING_VERSION;
+	m_header.header_bytes = sizeof(WaterRecordingHeader);
+	m_header.grid_x = grid_x;
+	m_header.grid_z = grid_z;
+	m_header.interval = interval;
+	m_header.key_interval = key_interval;
+	m_header.scale = scale;
+	m_header.usec_step_time = usec_step_time;
+	m_header.frame_count = 0;
+	m_header.index_offset = 0;
+	m_header.index_count = 0;
+	// rewritten with the counts and the index by close()
+	fwrite(&m_header, sizeof(m_header), 1, m_file);
+	m_offset = sizeof(m_header);
+
+	size_t cells = size_t(grid_x)*grid_z;
+	m_keys.clear();
+	m_previous.assign(cells, 0);
+	m_planes.resize(2*cells);
+	m_packed.resize(water_lz_bound(2*cells));
+	for (int a = 0; a < max_pending; a++)
+	{
+		m_free.push_back(new Pending());
+		m_free.back()->heights.resize(cells);
+	}
+	m_stop = false;
+	m_dropped = 0;
+	m_writer = std::thread(&WaterRecorder::writer_main, this);
+	return true;
+}
+
+void WaterRecorder::close()
+{
+	if (m_file == nullptr)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_one();
+	m_writer.join();
+
+	m_header.index_offset = m_offset;
+	m_header.index_count = m_keys.size();
+	if (!m_keys.empty())
+		fwrite(&m_keys.front(), sizeof(WaterRecordingKey), m_keys.size(), m_file);
+	fseek(m_file, 0, SEEK_SET);
+	fwrite(&m_header, sizeof(m_header), 1, m_file);
+	if (fclose(m_file) != 0)
+		fprintf(stderr, "Writing of water recording failed.\n");
+	m_file = nullptr;
+
+	for (size_t a = 0; a < m_free.size(); ++a)
+		delete m_free[a];
+	m_free.clear();
+}
+
+bool WaterRecorder::push_frame(uint64_t step, const float* heights)
+{
+	Pending* frame = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_file == nullptr)
+			return false;
+		if (m_free.empty())
+		{
+			m_dropped++;
+			return false;
+		}
+		frame = m_free.back();
+		m_free.pop_back();
+	}
+
+	// quantization is cheap and keeps the float grid out of the queue
+	frame->step = step;
+	for (size_t a = 0; a < frame->heights.size(); ++a)
+		frame->heights[a] = wave_to_fixed(heights[a], m_header.scale);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(frame);
+	}
+	m_wake.notify_one();
+	return true;
+}
+
+void WaterRecorder::writer_main()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+		if (m_queue.empty())
+			return;
+		Pending* frame = m_queue.front();
+		m_queue.erase(m_queue.begin());
+
+		lock.unlock();
+		bool written = write_frame(*frame);
+		lock.lock();
+		m_free.push_back(frame);
+		if (!written)
+			m_dropped++;
+	}
+}
+
+bool WaterRecorder::write_frame(const Pending& frame)
+{
+	size_t cells = frame.heights.size();
+	bool key = m_header.frame_count % uint64_t(m_header.key_interval) == 0;
+	for (size_t a = 0; a < cells; ++a)
+	{
+		// wraps around, the decoder adds it back modulo 2^16 as well
+		unsigned short delta = (unsigned short)(frame.heights[a] - (key ? 0 : m_previous[a]));
+		m_planes[a] = (unsigned char)(delta & 0xff);
+		m_planes[cells + a] = (unsigned char)(delta >> 8);
+	}
+	m_previous = frame.heights;
+
+	WaterRecordingFrame record;
+	record.bytes = uint32_t(water_lz_compress(&m_planes.front(), m_planes.size(), &m_packed.front()));
+	record.key = key ? 1 : 0;
+	record.step = frame.step;
+	if (fwrite(&record, sizeof(record), 1, m_file) != 1 ||
+		fwrite(&m_packed.front(), 1, record.bytes, m_file) != record.bytes)
+	{
+		fprintf(stderr, "Writing of water recording failed.\n");
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (key)
+	{
+		WaterRecordingKey entry = { m_header.frame_count, m_offset };
+		m_keys.push_back(entry);
+	}
+	m_offset += sizeof(record) + record.bytes;
+	m_header.frame_count++;
+	return true;
+}
+
+uint64_t WaterRecorder::get_frame_count() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_header.frame_count;
+}
+
+uint64_t WaterRecorder::get_dropped_count() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_dropped;
+}
+
+uint64_t WaterRecorder::get_bytes_written() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_offset;
+}
+
+
+WaterRecording::WaterRecording()
+{
+	m_header = nullptr;
+	m_frame_count = 0;
+	m_frame = 0;
+	m_offset = 0;
+	m_step = 0;
+}
+
+bool WaterRecording::open(const char* path)
+{
+	close();
+	if (!m_file.open(path))
+		return false;
+	const WaterRecordingHeader* header = static_cast<const WaterRecordingHeader*>(m_file.data());
+	if (m_file.size() < sizeof(WaterRecordingHeader) ||
+		memcmp(header->magic, WATER_RECORDING_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != WATER_RECORDING_VERSION || header->header_bytes != sizeof(WaterRecordingHeader) ||
+		header->grid_x <= 0 || header->grid_z <= 0)
+	{
+		fprintf(stderr, "%s is not a supported water recording.\n", path);
+		close();
+		return false;
+	}
+	m_header = header;
+
+	const char* base = static_cast<const char*>(m_file.data());
+	bool indexed = header->index_offset != 0 && read_recording_index(base, m_file.size(), *header, m_keys);
+	if (header->index_offset != 0 && !indexed)
+		fprintf(stderr, "Index of water recording %s is damaged, the frames are walked.\n", path);
+	if (indexed)
+		m_frame_count = header->frame_count;
+	else
+	{
+		// not closed (crash) or damaged: the frames are walked to rebuild
+		// the index, up to a damaged index if it is still in the file
+		uint64_t end = m_file.size();
+		if (header->index_offset >= sizeof(WaterRecordingHeader) && header->index_offset < end)
+			end = header->index_offset;
+		uint64_t offset = sizeof(WaterRecordingHeader);
+		while (offset + sizeof(WaterRecordingFrame) <= end)
+		{
+			const WaterRecordingFrame* record = reinterpret_cast<const WaterRecordingFrame*>(base + offset);
+			if (offset + sizeof(WaterRecordingFrame) + record->bytes > end)
+				break;
+			if (record->key)
+			{
+				WaterRecordingKey entry = { m_frame_count, offset };
+				m_keys.push_back(entry);
+			}
+			offset += sizeof(WaterRecordingFrame) + record->bytes;
+			m_frame_count++;
+		}
+	}
+
+	m_heights.assign(size_t(header->grid_x)*header->grid_z, 0);
+	m_planes.resize(2*m_heights.size());
+	m_frame = m_frame_count;
+	return true;
+}
+
+void WaterRecording::close()
+{
+	m_file.close();
+	m_header = nullptr;
+	m_frame_count = 0;
+	m_keys.clear();
+	m_frame = 0;
+	m_offset = 0;
+	m_step = 0;
+}
+
+bool WaterRecording::read_frame(uint64_t frame, float* heights)
+{
+	if (m_header == nullptr || frame >= m_frame_count)
+		return false;
+
+	if (m_frame >= m_frame_count || frame < m_frame)
+	{
+		// restart from the last keyframe at or before frame
+		std::vector<WaterRecordingKey>::const_iterator key = m_keys.end();
+		for (std::vector<WaterRecordingKey>::const_iterator k = m_keys.begin(); k != m_keys.end() && k->frame <= frame; ++k)
+			key = k;
+		if (key == m_keys.end())
+			return false;
+		m_frame = key->frame;
+		m_offset = key->offset;
+		if (!decode_next())
+			return false;
+	}
+	else
+	{
+		// a later keyframe may be closer than the current frame
+		for (size_t a = 0; a < m_keys.size() && m_keys[a].frame <= frame; ++a)
+			if (m_keys[a].frame > m_frame)
+			{
+				m_frame = m_keys[a].frame;
+				m_offset = m_keys[a].offset;
+				if (!decode_next())
+					return false;
+			}
+	}
+	while (m_frame < frame)
+	{
+		m_frame++;
+		if (!decode_next())
+			return false;
+	}
+
+	float scale = float(m_header->scale);
+	for (size_t a = 0; a < m_heights.size(); ++a)
+		heights[a] = m_heights[a]*scale;
+	return true;
+}
+
+bool WaterRecording::decode_next()
+{
+	const char* base = static_cast<const char*>(m_file.data());
+	const WaterRecordingFrame* record = reinterpret_cast<const WaterRecordingFrame*>(base + m_offset);
+	size_t cells = m_heights.size();
+	if (m_offset + sizeof(WaterRecordingFrame) > m_file.size() ||
+		m_offset + sizeof(WaterRecordingFrame) + record->bytes > m_file.size() ||
+		!water_lz_decompress(reinterpret_cast<const unsigned char*>(record + 1), record->bytes,
+			&m_planes.front(), m_planes.size()))
+	{
+		fprintf(stderr, "Water recording frame %llu is damaged.\n", (unsigned long long)m_frame);
+		m_frame = m_frame_count;
+		return false;
+	}
+	for (size_t a = 0; a < cells; ++a)
+	{
+		unsigned short delta = (unsigned short)(m_planes[a] | m_planes[cells + a] << 8);
+		unsigned short base_value = record->key ? 0 : (unsigned short)m_heights[a];
+		m_heights[a] = (short)(unsigned short)(base_value + delta);
+	}
+	m_step = record->step;
+	m_offset += sizeof(WaterRecordingFrame) + record->bytes;
+	return true;
+}
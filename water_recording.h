@@ -0,0 +1,146 @@
+#ifndef waterrecordingH
+#define waterrecordingH
+
+#include "water_mapped_file.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Compressed stream of recorded height grids.
+// Every frame is quantized to 16 bits (height/scale), coded as the
+// difference to the previous frame (keyframes to zero), split in a plane
+// of low bytes and a plane of high bytes and compressed by water_lz.
+// The file is a header, the frames and, after close, an index of the
+// keyframes used for seeking. Values are in native byte order.
+
+static const uint32_t WATER_RECORDING_VERSION = 1;
+
+struct WaterRecordingHeader
+{
+	char magic[8];          // "WATERREC"
+	uint32_t version;
+	uint32_t header_bytes;  // sizeof(WaterRecordingHeader)
+	int32_t grid_x;
+	int32_t grid_z;
+	int32_t interval;       // simulation steps between frames
+	int32_t key_interval;   // frames between keyframes
+	double scale;           // height of one quantization unit
+	uint64_t usec_step_time;
+	uint64_t frame_count;
+	uint64_t index_offset;  // 0 if the recording was not closed
+	uint64_t index_count;
+};
+
+// precedes the compressed bytes of every frame
+struct WaterRecordingFrame
+{
+	uint32_t bytes;
+	uint32_t key;
+	uint64_t step;
+};
+
+struct WaterRecordingKey
+{
+	uint64_t frame;
+	uint64_t offset;
+};
+
+// Writes a recording. Frames are quantized by the simulation thread and
+// handed to a writer thread that codes and writes them; when max_pending
+// frames are already waiting the new one is dropped, so push_frame()
+// never waits for I/O.
+class WaterRecorder
+{
+public:
+	WaterRecorder();
+	~WaterRecorder();
+
+	// grid_x x grid_z heights every interval steps, a keyframe every
+	// key_interval frames
+	bool open(const char* path, int grid_x, int grid_z, int interval,
+		uint64_t usec_step_time, double scale = 1.0/8192.0,
+		int key_interval = 64, int max_pending = 8);
+	// writes the waiting frames and the index
+	void close();
+	bool is_open() const { return m_file != nullptr; }
+
+	// grid_x*grid_z heights row by row (WaterSim::copy_heights()),
+	// false if the frame was dropped
+	bool push_frame(uint64_t step, const float* heights);
+
+	int get_grid_x() const { return m_header.grid_x; }
+	int get_grid_z() const { return m_header.grid_z; }
+	int get_interval() const { return m_header.interval; }
+	uint64_t get_frame_count() const;
+	uint64_t get_dropped_count() const;
+	uint64_t get_bytes_written() const;
+
+private:
+	WaterRecorder(const WaterRecorder&);
+	WaterRecorder& operator=(const WaterRecorder&);
+
+	struct Pending
+	{
+		uint64_t step;
+		std::vector<short> heights;
+	};
+
+	void writer_main();
+	bool write_frame(const Pending& frame);
+
+	FILE* m_file;
+	WaterRecordingHeader m_header;
+	uint64_t m_offset;
+	std::vector<WaterRecordingKey> m_keys;
+	std::vector<short> m_previous;
+	std::vector<unsigned char> m_planes;
+	std::vector<unsigned char> m_packed;
+
+	std::thread m_writer;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::vector<Pending*> m_queue; // oldest first
+	std::vector<Pending*> m_free;
+	bool m_stop;
+	uint64_t m_dropped;
+};
+
+// Reads a recording through a memory mapping. Consecutive frames are
+// decoded from the previous one, others from the preceding keyframe.
+class WaterRecording
+{
+public:
+	WaterRecording();
+
+	bool open(const char* path);
+	void close();
+
+	int get_grid_x() const { return m_header->grid_x; }
+	int get_grid_z() const { return m_header->grid_z; }
+	int get_interval() const { return m_header->interval; }
+	uint64_t get_step_time() const { return m_header->usec_step_time; }
+	uint64_t get_frame_count() const { return m_frame_count; }
+
+	// grid_x*grid_z heights of frame, row by row
+	bool read_frame(uint64_t frame, float* heights);
+	// simulation step of the last frame read
+	uint64_t get_step() const { return m_step; }
+
+private:
+	bool decode_next();
+
+	WaterMappedFile m_file;
+	const WaterRecordingHeader* m_header;
+	uint64_t m_frame_count;
+	std::vector<WaterRecordingKey> m_keys;
+	std::vector<short> m_heights;
+	std::vector<unsigned char> m_planes;
+	uint64_t m_frame;  // frame in m_heights, m_frame_count if none
+	uint64_t m_offset; // record after m_frame
+	uint64_t m_step;
+};
+
+#endif
@@ -0,0 +1,472 @@
+#include "water_refinement.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#define M_PI 3.14159265358979323846
+
+// regrids a block refined by touch() survives without being steep
+static const int TOUCH_HOLD = 2;
+// released patches kept for reuse
+static const size_t SPARE_PATCHES = 8;
+
+
+static double minmod(double a, double b)
+{
+	if (a*b <= 0.0)
+		return 0.0;
+	return fabs(a) < fabs(b) ? a : b;
+}
+
+WaterRefinement::WaterRefinement()
+{
+	m_rows = 0;
+	m_cols = 0;
+	m_block_size = 0;
+	m_ratio = 1;
+	m_max_patches = 0;
+	m_blocks_x = 0;
+	m_blocks_z = 0;
+	m_cell_size_x = 1.0;
+	m_cell_size_z = 1.0;
+	m_slope_threshold = 0.01;
+	m_pool = nullptr;
+	m_kernel = nullptr;
+	m_u_old = nullptr;
+	m_u_new = nullptr;
+	m_v = nullptr;
+}
+
+WaterRefinement::~WaterRefinement()
+{
+	release();
+}
+
+bool WaterRefinement::init(int rows, int cols, int block_size, int ratio, int max_patches,
+	double wave_speed, double dt, double damp_factor,
+	double cell_size_x, double cell_size_z)
+{
+	release();
+	if (rows <= 0 || cols <= 0 || block_size <= 0 || ratio < 2 || max_patches <= 0)
+	{
+		fprintf(stderr, "Invalid parameters of water refinement.\n");
+		return false;
+	}
+
+	m_rows = rows;
+	m_cols = cols;
+	m_block_size = block_size;
+	m_ratio = ratio;
+	m_max_patches = max_patches;
+	m_blocks_x = (rows + block_size - 1)/block_size;
+	m_blocks_z = (cols + block_size - 1)/block_size;
+	m_cell_size_x = cell_size_x;
+	m_cell_size_z = cell_size_z;
+	// ratio sub-steps of dt/ratio on cells ratio times smaller, the
+	// damping of one coarse step is spread over them
+	m_coeffs = wave_make_coeffs(wave_speed, dt/ratio, pow(damp_factor, 1.0/ratio),
+		cell_size_x/ratio, cell_size_z/ratio);
+
+	m_block_patch.assign(m_blocks_x*m_blocks_z, -1);
+	m_hold.assign(m_blocks_x*m_blocks_z, 0);
+	m_score.assign(m_blocks_x*m_blocks_z, 0.0);
+	return true;
+}
+
+void WaterRefinement::release()
+{
+	clear();
+	for (size_t a = 0; a < m_free.size(); ++a)
+		delete m_free[a];
+	m_free.clear();
+	m_block_patch.clear();
+	m_hold.clear();
+	m_score.clear();
+	m_blocks_x = 0;
+	m_blocks_z = 0;
+}
+
+void WaterRefinement::clear()
+{
+	while (!m_patches.empty())
+		remove_patch(int(m_patches.size()) - 1);
+	std::fill(m_hold.begin(), m_hold.end(), 0);
+}
+
+int WaterRefinement::patch_at(int bx, int bz) const
+{
+	if (bx < 0 || bz < 0 || bx >= m_blocks_x || bz >= m_blocks_z)
+		return -1;
+	return m_block_patch[bx*m_blocks_z + bz];
+}
+
+bool WaterRefinement::is_refined(int i, int j) const
+{
+	if (i < 1 || j < 1 || i > m_rows || j > m_cols)
+		return false;
+	return patch_at((i - 1)/m_block_size, (j - 1)/m_block_size) >= 0;
+}
+
+bool WaterRefinement::create_patch(int bx, int bz, const WaterField& u, const WaterField& v)
+{
+	Patch* p = nullptr;
+	if (!m_free.empty())
+	{
+		p = m_free.back();
+		m_free.pop_back();
+	}
+	else
+		p = new Patch();
+
+	p->bx = bx;
+	p->bz = bz;
+	p->i0 = 1 + bx*m_block_size;
+	p->j0 = 1 + bz*m_block_size;
+	p->rows = std::min(m_block_size, m_rows + 1 - p->i0);
+	p->cols = std::min(m_block_size, m_cols + 1 - p->j0);
+	int rows = p->rows*m_ratio;
+	int cols = p->cols*m_ratio;
+	if (p->u.get_rows() != rows || p->u.get_cols() != cols)
+	{
+		if (!p->u.init(rows, cols) || !p->u_new.init(rows, cols) || !p->v.init(rows, cols))
+		{
+			delete p;
+			return false;
+		}
+	}
+
+	// limited linear interpolation, the offsets of the children sum to
+	// zero, so their average is the parent value
+	for (int ci = 0; ci < p->rows; ci++)
+		for (int cj = 0; cj < p->cols; cj++)
+		{
+			int i = p->i0 + ci;
+			int j = p->j0 + cj;
+			double c = u.at(i, j);
+			double sx = minmod(u.at(i + 1, j) - c, c - u.at(i - 1, j));
+			double sz = minmod(u.at(i, j + 1) - c, c - u.at(i, j - 1));
+			double vc = v.at(i, j);
+			for (int a = 0; a < m_ratio; a++)
+			{
+				double ox = (a + 0.5)/m_ratio - 0.5;
+				double* ur = p->u.row(1 + ci*m_ratio + a) + 1 + cj*m_ratio;
+				double* vr = p->v.row(1 + ci*m_ratio + a) + 1 + cj*m_ratio;
+				for (int b = 0; b < m_ratio; b++)
+				{
+					double oz = (b + 0.5)/m_ratio - 0.5;
+					ur[b] = c + sx*ox + sz*oz;
+					vr[b] = vc;
+				}
+			}
+		}
+
+	m_block_patch[bx*m_blocks_z + bz] = int(m_patches.size());
+	m_patches.push_back(p);
+	return true;
+}
+
+void WaterRefinement::remove_patch(int index)
+{
+	// the covered coarse cells already hold the patch average
+	Patch* p = m_patches[index];
+	m_block_patch[p->bx*m_blocks_z + p->bz] = -1;
+	m_patches[index] = m_patches.back();
+	m_patches.pop_back();
+	if (index < int(m_patches.size()))
+		m_block_patch[m_patches[index]->bx*m_blocks_z + m_patches[index]->bz] = index;
+	m_free.push_back(p);
+}
+
+void WaterRefinement::regrid(const WaterField& u, const WaterField& v)
+{
+	// steepest slope per block (the edge to the next block included)
+	for (int bx = 0; bx < m_blocks_x; bx++)
+		for (int bz = 0; bz < m_blocks_z; bz++)
+		{
+			int i0 = 1 + bx*m_block_size;
+			int j0 = 1 + bz*m_block_size;
+			int i1 = std::min(m_rows + 1, i0 + m_block_size);
+			int j1 = std::min(m_cols + 1, j0 + m_block_size);
+			double dx = 0.0;
+			double dz = 0.0;
+			for (int i = i0; i < i1; i++)
+			{
+				const double* r = u.row(i);
+				const double* rn = u.row(i + 1);
+				for (int j = j0; j < j1; j++)
+				{
+					dx = std::max(dx, fabs(rn[j] - r[j]));
+					dz = std::max(dz, fabs(r[j + 1] - r[j]));
+				}
+			}
+			m_score[bx*m_blocks_z + bz] = std::max(dx/m_cell_size_x, dz/m_cell_size_z);
+		}
+
+	// flagged blocks and their neighbours, waves leave a block only
+	// through refined cells before the next regrid
+	std::vector<int> wanted;
+	std::vector<unsigned char> flag(m_blocks_x*m_blocks_z, 0);
+	for (int bx = 0; bx < m_blocks_x; bx++)
+		for (int bz = 0; bz < m_blocks_z; bz++)
+		{
+			int b = bx*m_blocks_z + bz;
+			if (m_hold[b] > 0)
+				m_hold[b]--;
+			else if (m_score[b] <= m_slope_threshold)
+				continue;
+			for (int x = std::max(0, bx - 1); x <= std::min(m_blocks_x - 1, bx + 1); x++)
+				for (int z = std::max(0, bz - 1); z <= std::min(m_blocks_z - 1, bz + 1); z++)
+					flag[x*m_blocks_z + z] = 1;
+		}
+
+	for (int a = int(m_patches.size()) - 1; a >= 0; a--)
+		if (!flag[m_patches[a]->bx*m_blocks_z + m_patches[a]->bz])
+			remove_patch(a);
+	for (int b = 0; b < m_blocks_x*m_blocks_z; b++)
+		if (flag[b] && m_block_patch[b] < 0)
+			wanted.push_back(b);
+
+	// steepest first when the patch budget is short
+	std::sort(wanted.begin(), wanted.end(), [this](int a, int b) { return m_score[a] > m_score[b]; });
+	for (size_t a = 0; a < wanted.size() && int(m_patches.size()) < m_max_patches; ++a)
+		if (!create_patch(wanted[a]/m_blocks_z, wanted[a]%m_blocks_z, u, v))
+			break;
+
+	while (m_free.size() > SPARE_PATCHES)
+	{
+		delete m_free.back();
+		m_free.pop_back();
+	}
+}
+
+void WaterRefinement::refine(int i0, int i1, int j0, int j1, const WaterField& u, const WaterField& v)
+{
+	i0 = std::max(i0, 1);
+	j0 = std::max(j0, 1);
+	i1 = std::min(i1, m_rows + 1);
+	j1 = std::min(j1, m_cols + 1);
+	if (i0 >= i1 || j0 >= j1)
+		return;
+
+	for (int bx = (i0 - 1)/m_block_size; bx <= (i1 - 2)/m_block_size; bx++)
+		for (int bz = (j0 - 1)/m_block_size; bz <= (j1 - 2)/m_block_size; bz++)
+		{
+			m_hold[bx*m_blocks_z + bz] = TOUCH_HOLD;
+			if (patch_at(bx, bz) < 0 && int(m_patches.size()) < m_max_patches)
+				create_patch(bx, bz, u, v);
+		}
+}
+
+double WaterRefinement::touch(double x, double z, int i0, int i1, int j0, int j1,
+	double strength, double distance, WaterField& u)
+{
+	if (distance <= 0.0)
+		return 0.0;
+
+	double h_x = m_cell_size_x;
+	double h_z = m_cell_size_z;
+	double change_sum = 0.0;
+	for (size_t a = 0; a < m_patches.size(); ++a)
+	{
+		Patch& p = *m_patches[a];
+		// covered coarse cells inside the brush window
+		int ci0 = std::max(i0, p.i0);
+		int ci1 = std::min(i1, p.i0 + p.rows);
+		int cj0 = std::max(j0, p.j0);
+		int cj1 = std::min(j1, p.j0 + p.cols);
+		if (ci0 >= ci1 || cj0 >= cj1)
+			continue;
+
+		for (int fi = 1 + (ci0 - p.i0)*m_ratio; fi < 1 + (ci1 - p.i0)*m_ratio; fi++)
+		{
+			double* ur = p.u.row(fi);
+			double x_dist = (p.i0 - 1 + (fi - 0.5)/m_ratio - x)*h_x;
+			for (int fj = 1 + (cj0 - p.j0)*m_ratio; fj < 1 + (cj1 - p.j0)*m_ratio; fj++)
+			{
+				double z_dist = (p.j0 - 1 + (fj - 0.5)/m_ratio - z)*h_z;
+				double dist = sqrt(x_dist*x_dist + z_dist*z_dist);
+				if (dist <= distance) dist = dist/distance;
+				else dist = 1.0;
+				double change = strength * (cos(dist * M_PI) + 1.0) / 2.0;
+				ur[fj] -= change;
+				change_sum += change;
+			}
+		}
+		restrict_patch(p, u, nullptr);
+	}
+	return change_sum/(m_ratio*m_ratio);
+}
+
+double WaterRefinement::coarse_value(double alpha, double x, double z) const
+{
+	// bilinear between coarse cell centres (i - 0.5), halo included
+	double fx = x + 0.5;
+	double fz = z + 0.5;
+	int i = std::min(std::max(int(floor(fx)), 0), m_rows);
+	int j = std::min(std::max(int(floor(fz)), 0), m_cols);
+	double tx = std::min(std::max(fx - i, 0.0), 1.0);
+	double tz = std::min(std::max(fz - j, 0.0), 1.0);
+
+	const WaterField& a = *m_u_old;
+	const WaterField& b = *m_u_new;
+	double va = (a.at(i, j)*(1.0 - tz) + a.at(i, j + 1)*tz)*(1.0 - tx) +
+		(a.at(i + 1, j)*(1.0 - tz) + a.at(i + 1, j + 1)*tz)*tx;
+	double vb = (b.at(i, j)*(1.0 - tz) + b.at(i, j + 1)*tz)*(1.0 - tx) +
+		(b.at(i + 1, j)*(1.0 - tz) + b.at(i + 1, j + 1)*tz)*tx;
+	return va + (vb - va)*alpha;
+}
+
+void WaterRefinement::fill_halo(Patch& p, double alpha)
+{
+	int rows = p.rows*m_ratio;
+	int cols = p.cols*m_ratio;
+	double r = m_ratio;
+	WaterField& u = p.u;
+
+	// top and bottom halo rows
+	for (int side = 0; side < 2; side++)
+	{
+		int fi = side == 0 ? 0 : rows + 1;
+		int inner = side == 0 ? 1 : rows;
+		bool border = side == 0 ? p.i0 == 1 : p.i0 + p.rows - 1 == m_rows;
+		int q = patch_at(p.bx + (side == 0 ? -1 : 1), p.bz);
+		if (border)
+			memcpy(u.row(fi) + 1, u.row(inner) + 1, cols*sizeof(double));
+		else if (q >= 0)
+		{
+			const Patch& n = *m_patches[q];
+			int ni = side == 0 ? n.rows*m_ratio : 1;
+			memcpy(u.row(fi) + 1, n.u.row(ni) + 1, cols*sizeof(double));
+		}
+		else
+		{
+			double x = p.i0 - 1 + (fi - 0.5)/r;
+			double* ur = u.row(fi);
+			for (int fj = 1; fj <= cols; fj++)
+				ur[fj] = coarse_value(alpha, x, p.j0 - 1 + (fj - 0.5)/r);
+		}
+	}
+
+	// left and right halo columns (corners are not read by the stencil)
+	for (int side = 0; side < 2; side++)
+	{
+		int fj = side == 0 ? 0 : cols + 1;
+		int inner = side == 0 ? 1 : cols;
+		bool border = side == 0 ? p.j0 == 1 : p.j0 + p.cols - 1 == m_cols;
+		int q = patch_at(p.bx, p.bz + (side == 0 ? -1 : 1));
+		if (border)
+		{
+			for (int fi = 1; fi <= rows; fi++)
+				u.at(fi, fj) = u.at(fi, inner);
+		}
+		else if (q >= 0)
+		{
+			const Patch& n = *m_patches[q];
+			int nj = side == 0 ? n.cols*m_ratio : 1;
+			for (int fi = 1; fi <= rows; fi++)
+				u.at(fi, fj) = n.u.at(fi, nj);
+		}
+		else
+		{
+			double z = p.j0 - 1 + (fj - 0.5)/r;
+			for (int fi = 1; fi <= rows; fi++)
+				u.at(fi, fj) = coarse_value(alpha, p.i0 - 1 + (fi - 0.5)/r, z);
+		}
+	}
+}
+
+void WaterRefinement::restrict_patch(const Patch& p, WaterField& u, WaterField* v) const
+{
+	double inv = 1.0/(m_ratio*m_ratio);
+	for (int ci = 0; ci < p.rows; ci++)
+		for (int cj = 0; cj < p.cols; cj++)
+		{
+			double su = 0.0;
+			double sv = 0.0;
+			for (int a = 0; a < m_ratio; a++)
+			{
+				const double* ur = p.u.row(1 + ci*m_ratio + a) + 1 + cj*m_ratio;
+				const double* vr = p.v.row(1 + ci*m_ratio + a) + 1 + cj*m_ratio;
+				for (int b = 0; b < m_ratio; b++)
+				{
+					su += ur[b];
+					sv += vr[b];
+				}
+			}
+			u.at(p.i0 + ci, p.j0 + cj) = su*inv;
+			if (v != nullptr)
+				v->at(p.i0 + ci, p.j0 + cj) = sv*inv;
+		}
+}
+
+void WaterRefinement::advance(ThreadPool& pool, WaveRowKernel kernel,
+	const WaterField& u_old, WaterField& u_new, WaterField& v)
+{
+	if (m_patches.empty())
+		return;
+
+	m_pool = &pool;
+	m_kernel = kernel;
+	m_u_old = &u_old;
+	m_u_new = &u_new;
+	m_v = &v;
+	pool.run(advance_task, this);
+	m_pool = nullptr;
+
+	// restricted border cells feed the coarse halo
+	u_new.clamp_edges();
+}
+
+void WaterRefinement::advance_task(void* ctx, int worker, int workers)
+{
+	WaterRefinement* r = static_cast<WaterRefinement*>(ctx);
+	int count = int(r->m_patches.size());
+	for (int s = 0; s < r->m_ratio; s++)
+	{
+		// halos read the interior of neighbouring patches, which is
+		// only written in the next phase
+		double alpha = double(s)/r->m_ratio;
+		for (int a = worker; a < count; a += workers)
+			r->fill_halo(*r->m_patches[a], alpha);
+		r->m_pool->barrier();
+
+		for (int a = worker; a < count; a += workers)
+		{
+			Patch& p = *r->m_patches[a];
+			int cols = p.cols*r->m_ratio;
+			for (int fi = 1; fi <= p.rows*r->m_ratio; fi++)
+				r->m_kernel(p.u.row(fi - 1) + 1, p.u.row(fi) + 1, p.u.row(fi + 1) + 1,
+					p.v.row(fi) + 1, p.u_new.row(fi) + 1, cols, r->m_coeffs);
+			p.u.swap(p.u_new);
+		}
+		r->m_pool->barrier();
+	}
+
+	// patches cover disjoint coarse cells
+	for (int a = worker; a < count; a += workers)
+		r->restrict_patch(*r->m_patches[a], *r->m_u_new, r->m_v);
+}
+
+double WaterRefinement::sample(double x, double z, const WaterField& u) const
+{
+	int i = std::min(std::max(int(floor(x)) + 1, 1), m_rows);
+	int j = std::min(std::max(int(floor(z)) + 1, 1), m_cols);
+	int q = patch_at((i - 1)/m_block_size, (j - 1)/m_block_size);
+	if (q < 0)
+		return u.at(i, j);
+
+	const Patch& p = *m_patches[q];
+	int fi = std::min(std::max(int(floor((x - (p.i0 - 1))*m_ratio)) + 1, 1), p.rows*m_ratio);
+	int fj = std::min(std::max(int(floor((z - (p.j0 - 1))*m_ratio)) + 1, 1), p.cols*m_ratio);
+	return p.u.at(fi, fj);
+}
+
+size_t WaterRefinement::get_bytes() const
+{
+	size_t bytes = 0;
+	for (size_t a = 0; a < m_patches.size(); ++a)
+		bytes += m_patches[a]->u.get_bytes() + m_patches[a]->u_new.get_bytes() + m_patches[a]->v.get_bytes();
+	for (size_t a = 0; a < m_free.size(); ++a)
+		bytes += m_free[a]->u.get_bytes() + m_free[a]->u_new.get_bytes() + m_free[a]->v.get_bytes();
+	return bytes;
+}
@@ -0,0 +1,117 @@
+#ifndef waterrefinementH
+#define waterrefinementH
+
+#include "water_field.h"
+#include "water_kernels.h"
+#include "thread_pool.h"
+#include <vector>
+
+// Two-level adaptive refinement of the CPU wave solver.
+// The coarse grid is divided in square blocks; blocks around touches and
+// steep waves get a patch of ratio times finer cells, which is stepped
+// ratio times per coarse step (same Courant number). Patch halos come from
+// neighbouring patches or from the coarse solution interpolated in space
+// and time. After the sub-steps every patch is averaged back into the
+// coarse cells it covers; new patches are filled by a limited linear
+// interpolation whose children average to their parent. Both transfers
+// therefore keep the volume of every coarse cell.
+class WaterRefinement
+{
+public:
+	WaterRefinement();
+	~WaterRefinement();
+
+	// rows x cols coarse grid, block_size^2 coarse cells per patch
+	bool init(int rows, int cols, int block_size, int ratio, int max_patches,
+		double wave_speed, double dt, double damp_factor,
+		double cell_size_x, double cell_size_z);
+	void release();
+	// removes all patches
+	void clear();
+
+	// blocks whose steepest slope (height difference of neighbouring
+	// coarse cells over the cell size) exceeds slope are refined
+	void set_slope_threshold(double slope) { m_slope_threshold = slope; }
+	double get_slope_threshold() const { return m_slope_threshold; }
+
+	// advances the patches by one coarse step; the coarse grid has already
+	// been stepped from u_old to u_new, covered cells of u_new and v are
+	// replaced by the patch averages
+	void advance(ThreadPool& pool, WaveRowKernel kernel,
+		const WaterField& u_old, WaterField& u_new, WaterField& v);
+	// refines flagged blocks and their neighbours, coarsens the rest
+	void regrid(const WaterField& u, const WaterField& v);
+	// refines blocks covering coarse cells [i0, i1) x [j0, j1) now,
+	// as far as max_patches allows
+	void refine(int i0, int i1, int j0, int j1, const WaterField& u, const WaterField& v);
+
+	// cosine brush on the patch cells whose parent lies in [i0, i1) x
+	// [j0, j1); x, z is the brush centre in coarse cells (cell i spans
+	// [i - 1, i)); covered cells of u are updated, returns the removed
+	// volume in coarse cell units
+	double touch(double x, double z, int i0, int i1, int j0, int j1,
+		double strength, double distance, WaterField& u);
+
+	bool is_refined(int i, int j) const;
+	// finest height at x, z (coarse cells, 0 .. rows x 0 .. cols)
+	double sample(double x, double z, const WaterField& u) const;
+
+	int get_ratio() const { return m_ratio; }
+	int get_block_size() const { return m_block_size; }
+	int get_patch_count() const { return int(m_patches.size()); }
+	int get_max_patches() const { return m_max_patches; }
+	// allocated bytes of all patch fields
+	size_t get_bytes() const;
+
+private:
+	WaterRefinement(const WaterRefinement&);
+	WaterRefinement& operator=(const WaterRefinement&);
+
+	struct Patch
+	{
+		int bx;
+		int bz;
+		int i0;   // first covered coarse cell
+		int j0;
+		int rows; // covered coarse cells
+		int cols;
+		WaterField u;
+		WaterField u_new;
+		WaterField v;
+	};
+
+	static void advance_task(void* ctx, int worker, int workers);
+	bool create_patch(int bx, int bz, const WaterField& u, const WaterField& v);
+	void remove_patch(int index);
+	void fill_halo(Patch& p, double alpha);
+	void restrict_patch(const Patch& p, WaterField& u, WaterField* v) const;
+	double coarse_value(double alpha, double x, double z) const;
+	int patch_at(int bx, int bz) const;
+
+	int m_rows;
+	int m_cols;
+	int m_block_size;
+	int m_ratio;
+	int m_max_patches;
+	int m_blocks_x;
+	int m_blocks_z;
+	double m_cell_size_x;
+	double m_cell_size_z;
+	double m_slope_threshold;
+	WaveCoeffs m_coeffs; // fine level
+
+	std::vector<Patch*> m_patches;
+	std::vector<Patch*> m_free;
+	std::vector<int> m_block_patch; // patch index or -1
+	std::vector<unsigned char> m_hold; // regrids a touched block stays refined
+	std::vector<double> m_score;
+
+	// advance() in progress
+	ThreadPool* m_pool;
+	WaveRowKernel m_kernel;
+	const WaterField* m_u_old;
+	WaterField* m_u_new;
+	WaterField* m_v;
+};
+
+#endif
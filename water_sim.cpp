@@ -0,0 +1,825 @@
+#include "water_sim.h"
+#include "water_checkpoint.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+
+
+WaterSim::WaterSim(
+		float dim_x, float dim_z, int grid_x, int grid_z, 
+		float wave_speed, float dt, float damp_factor, uint64_t usec_step_time):
+	m_governor(usec_step_time)
+{
+	m_dim_x = dim_x;
+	m_dim_z = dim_z;
+	m_grid_x = grid_x;
+	m_grid_z = grid_z;
+	m_wave_speed = wave_speed;
+	m_dt = dt;
+	m_damp_factor = damp_factor;
+
+	m_cell_size_x = 0.0f;
+	m_cell_size_y = 0.0f;
+	m_isa = wave_detect_isa();
+	m_row_kernel = wave_get_row_kernel(m_isa);
+	m_row_kernel16 = wave_get_row_kernel16(m_isa);
+	m_pending_steps = 0;
+	m_block_steps = 1;
+	m_block_tile_rows = 0;
+	m_block_tile_cols = 0;
+	m_sparse = false;
+	m_sparse_threshold = 0.0;
+	m_rest_level = 0.0;
+	m_fixed = false;
+	m_fixed_scale = 1.0;
+	m_refine = false;
+	m_regrid_interval = 1;
+	m_regrid_counter = 0;
+	m_recorder = nullptr;
+	m_record_countdown = 0;
+	m_record_step = 0;
+	m_mesh_dst = nullptr;
+}
+
+bool WaterSim::init() 
+{
+	if (m_dim_x == 0 || m_dim_z == 0 || m_grid_x == 0 || m_grid_z == 0)
+	{
+		fprintf(stderr, "Invalid dimensions of water surface.\n");
+		return false;
+	}
+
+	m_cell_size_x = m_dim_x / m_grid_x;
+	m_cell_size_y = m_dim_z / m_grid_z;
+	m_coeffs = wave_make_coeffs(m_wave_speed, m_dt, m_damp_factor, m_cell_size_x, m_cell_size_y);
+	m_coeffs16 = wave_make_coeffs16(m_coeffs);
+
+	m_governor.reset(m_governor.get_last_call());
+	m_rest_level = 0.0;
+	m_impulses.clear();
+	m_refinement.clear();
+
+	// fields are allocated with boundary (halo) cells
+	if (m_fixed)
+	{
+		if (!m_u16.init(m_grid_x, m_grid_z) || !m_u16_new.init(m_grid_x, m_grid_z) || !m_v16.init(m_grid_x, m_grid_z))
+			return false;
+	}
+	else
+	{
+		if (!m_u.init(m_grid_x, m_grid_z) || !m_u_new.init(m_grid_x, m_grid_z) || !m_v.init(m_grid_x, m_grid_z))
+			return false;
+
+		// init m_u "with some initeresting func"
+		// i.e. m_u.at(i, j) = -sin(10.0f*float(i) / m_grid_x + 10.0f*float(j) / m_grid_z)*0.4;
+		// i.e. m_u.at(i, j) = -sin(10.0f*float(i) / m_grid_x + 0.4f*(10.0f*float(j) / m_grid_z))*0.4;
+		m_u.fill(0.0); // or just wait for interaction
+		m_u_new.fill(0.0);
+		m_v.fill(0.0);
+	}
+
+	return true;
+}
+
+void WaterSim::update_model(uint64_t usec_time, bool force_one_step)
+{
+	int steps = force_one_step ?
+		m_governor.begin_forced_step() : m_governor.begin_frame(usec_time);
+	// queued touches are applied together before the first step
+	if (steps > 0 && !m_impulses.empty())
+		apply_impulses();
+	// with a recorder the steps are run in batches ending on recorded ones
+	int left = steps;
+	while (left > 0)
+	{
+		int batch = m_recorder != nullptr ? std::min(left, m_record_countdown) : left;
+		run_batch(batch);
+		left -= batch;
+		if (m_recorder == nullptr)
+			continue;
+		m_record_step += batch;
+		m_record_countdown -= batch;
+		if (m_record_countdown == 0)
+		{
+			m_record_countdown = m_recorder->get_interval();
+			copy_heights(&m_record_heights.front());
+			m_recorder->push_frame(m_record_step, &m_record_heights.front());
+		}
+	}
+	m_governor.end_frame(steps);
+}
+
+void WaterSim::run_batch(int steps)
+{
+	// quantized steps do not conserve the volume exactly (the damping cuts
+	// small velocities of the wide, shallow part of a wave to 0), the
+	// difference goes to the rest level so that the mean level stays put
+	if (m_fixed)
+	{
+		int64_t volume = fixed_volume();
+		run_steps(steps);
+		m_rest_level += double(volume - fixed_volume())*m_fixed_scale/(double(m_grid_x)*m_grid_z);
+		return;
+	}
+
+	int left = steps;
+	if (m_refine)
+	{
+		run_refined_steps(steps);
+		left = 0;
+	}
+	else if (m_sparse)
+		m_activity.plan(steps, m_u, m_u_new);
+	else if (m_block_steps > 1)
+	{
+		while (left >= 2)
+		{
+			int fused = std::min(left, m_block_steps);
+			run_tiled_steps(fused);
+			left -= fused;
+		}
+	}
+	run_steps(left);
+}
+
+int64_t WaterSim::fixed_volume() const
+{
+	int64_t volume = 0;
+	for (int i = 1; i <= m_grid_x; i++)
+	{
+		const short* u = m_u16.row(i) + 1;
+		int sum = 0; // a row of int16 fits
+		for (int j = 0; j < m_grid_z; j++)
+			sum += u[j];
+		volume += sum;
+	}
+	return volume;
+}
+
+void WaterSim::run_steps(int steps)
+{
+	if (steps <= 0)
+		return;
+
+	// all sub-steps are done in one pool run, bands meet at a barrier
+	// between them, so u and u_new alternate between steps
+	m_pending_steps = steps;
+	m_pool.run(step_task, this);
+	m_pending_steps = 0;
+
+	if (steps % 2 == 1)
+	{
+		// storage swap: u <-> u_new
+		if (m_fixed)
+			m_u16.swap(m_u16_new);
+		else
+			m_u.swap(m_u_new);
+	}
+	if (m_sparse)
+		m_activity.finish_update();
+}
+
+void WaterSim::step_task(void* ctx, int worker, int workers)
+{
+	WaterSim* surface = static_cast<WaterSim*>(ctx);
+	int row_begin = 1 + surface->m_grid_x*worker/workers;
+	int row_end = 1 + surface->m_grid_x*(worker + 1)/workers;
+
+	if (surface->m_fixed)
+	{
+		WaterField16* u = &surface->m_u16;
+		WaterField16* u_new = &surface->m_u16_new;
+		for (int s = 0; s < surface->m_pending_steps; s++)
+		{
+			if (s > 0)
+				surface->m_pool.barrier();
+			surface->step_band16(row_begin, row_end, *u, *u_new);
+			std::swap(u, u_new);
+		}
+		return;
+	}
+
+	WaterField* u = &surface->m_u;
+	WaterField* u_new = &surface->m_u_new;
+	for (int s = 0; s < surface->m_pending_steps; s++)
+	{
+		// rows (and halo) of the neighbouring bands must be finished
+		if (s > 0)
+			surface->m_pool.barrier();
+		surface->step_band(row_begin, row_end, *u, *u_new);
+		std::swap(u, u_new);
+	}
+
+	if (surface->m_sparse)
+	{
+		// tiles straddle bands, wait for all rows
+		surface->m_pool.barrier();
+		for (int tr = worker; tr < surface->m_activity.get_tile_rows(); tr += workers)
+			surface->m_activity.update_row(tr, *u, surface->m_v,
+				0.0, surface->m_sparse_threshold);
+	}
+}
+
+void WaterSim::run_refined_steps(int steps)
+{
+	for (int s = 0; s < steps; s++)
+	{
+		// coarse step to u_new, the patches follow in ratio sub-steps
+		// and overwrite the coarse cells they cover
+		m_pending_steps = 1;
+		m_pool.run(step_task, this);
+		m_pending_steps = 0;
+		m_refinement.advance(m_pool, m_row_kernel, m_u, m_u_new, m_v);
+		m_u.swap(m_u_new);
+
+		if (++m_regrid_counter >= m_regrid_interval)
+		{
+			m_regrid_counter = 0;
+			m_refinement.regrid(m_u, m_v);
+		}
+	}
+}
+
+void WaterSim::run_tiled_steps(int steps)
+{
+	// tiles read u/v and write u_new/v_new, no barriers are needed
+	m_pending_steps = steps;
+	m_pool.run(tiled_task, this);
+	m_pending_steps = 0;
+
+	m_u.swap(m_u_new);
+	m_v.swap(m_v_new);
+	m_u.clamp_edges();
+}
+
+void WaterSim::tiled_task(void* ctx, int worker, int workers)
+{
+	WaterSim* surface = static_cast<WaterSim*>(ctx);
+	int tiles = surface->m_tiling.get_tile_count();
+	for (int t = worker; t < tiles; t += workers)
+	{
+		surface->m_tiling.run_tile(worker, t, surface->m_pending_steps,
+			surface->m_u, surface->m_v, surface->m_u_new, surface->m_v_new,
+			surface->m_row_kernel, surface->m_coeffs);
+	}
+}
+
+void WaterSim::step_band(int row_begin, int row_end, const WaterField& u, WaterField& u_new)
+{
+	for (int i = row_begin; i < row_end; i++)
+	{
+		if (m_sparse)
+		{
+			const std::vector<std::pair<int, int> >& spans =
+				m_activity.get_spans(m_activity.get_tile_row(i));
+			for (size_t a = 0; a < spans.size(); ++a)
+			{
+				int j = spans[a].first;
+				m_row_kernel(u.row(i - 1) + j, u.row(i) + j, u.row(i + 1) + j,
+					m_v.row(i) + j, u_new.row(i) + j, spans[a].second - j, m_coeffs);
+			}
+			continue;
+		}
+		m_row_kernel(u.row(i - 1) + 1, u.row(i) + 1, u.row(i + 1) + 1,
+			m_v.row(i) + 1, u_new.row(i) + 1, m_grid_z, m_coeffs);
+	}
+	// clamp on edges
+	u_new.clamp_edges(row_begin, row_end);
+}
+
+void WaterSim::step_band16(int row_begin, int row_end, const WaterField16& u, WaterField16& u_new)
+{
+	for (int i = row_begin; i < row_end; i++)
+		m_row_kernel16(u.row(i - 1) + 1, u.row(i) + 1, u.row(i + 1) + 1,
+			m_v16.row(i) + 1, u_new.row(i) + 1, m_grid_z, m_coeffs16);
+	u_new.clamp_edges(row_begin, row_end);
+}
+
+void WaterSim::touch(int x, int y, double strength, double distance)
+{
+	WaterImpulse impulse = { x, y, strength, distance };
+	double change_sum = apply_impulse(impulse);
+	// the volume pushed out raises the whole surface, applied lazily
+	m_rest_level += change_sum/((m_grid_x + 2)*(m_grid_z + 2));
+}
+
+void WaterSim::queue_touch(int x, int y, double strength, double distance)
+{
+	WaterImpulse impulse = { x, y, strength, distance };
+	m_impulses.push_back(impulse);
+}
+
+int WaterSim::get_queued_touch_count() const
+{
+	return int(m_impulses.size());
+}
+
+void WaterSim::apply_impulses()
+{
+	double change_sum = 0.0;
+	for (size_t a = 0; a < m_impulses.size(); ++a)
+		change_sum += apply_impulse(m_impulses[a]);
+	m_rest_level += change_sum/((m_grid_x + 2)*(m_grid_z + 2));
+	m_impulses.clear();
+}
+
+double WaterSim::apply_impulse(const WaterImpulse& impulse)
+{
+	m_stamp.prepare(impulse.distance, m_cell_size_x, m_cell_size_y);
+
+	// include boundary (0 and m_grid_x/y + 1)
+	int low_x = std::max(0, impulse.x + m_stamp.get_x0());
+	int high_x = std::min(m_grid_x + 1, impulse.x + m_stamp.get_x1());
+	int low_y = std::max(0, impulse.y + m_stamp.get_z0());
+	int high_y = std::min(m_grid_z + 1, impulse.y + m_stamp.get_z1());
+	if (low_x >= high_x || low_y >= high_y)
+		return 0.0;
+	// interaction is always resolved on the fine level
+	if (m_refine)
+		m_refinement.refine(low_x, high_x, low_y, high_y, m_u, m_v);
+
+	double change_sum = 0.0;
+	for (int i = low_x; i < high_x; i++)
+		for (int j = low_y; j < high_y; j++)
+		{
+			if (m_refine && m_refinement.is_refined(i, j))
+				continue;
+			double change = impulse.strength*m_stamp.weight(i - impulse.x, j - impulse.y);
+			if (m_fixed)
+			{
+				// only the applied (quantized, saturated) dent is moved to
+				// the rest level
+				double units = std::min(65535.0, std::max(-65535.0, floor(change/m_fixed_scale + 0.5)));
+				int before = m_u16.at(i, j);
+				int after = wave_sat16(before - int(units));
+				m_u16.at(i, j) = short(after);
+				change_sum += (before - after)*m_fixed_scale;
+				continue;
+			}
+			m_u.at(i, j) -= change;
+			change_sum += change;
+		}
+	if (m_sparse)
+		m_activity.wake(low_x, high_x, low_y, high_y);
+	// the brush is centred on cell x, y, i.e. at x - 0.5, y - 0.5
+	if (m_refine)
+		change_sum += m_refinement.touch(impulse.x - 0.5, impulse.y - 0.5,
+			low_x, high_x, low_y, high_y, impulse.strength, impulse.distance, m_u);
+	return change_sum;
+}
+
+void WaterSim::set_isa(WaveIsa isa)
+{
+	if (isa > wave_detect_isa())
+		isa = wave_detect_isa();
+	m_isa = isa;
+	m_row_kernel = wave_get_row_kernel(m_isa);
+	m_row_kernel16 = wave_get_row_kernel16(m_isa);
+}
+
+WaveIsa WaterSim::get_isa() const
+{
+	return m_isa;
+}
+
+SimGovernor& WaterSim::get_governor()
+{
+	return m_governor;
+}
+
+const SimGovernor& WaterSim::get_governor() const
+{
+	return m_governor;
+}
+
+bool WaterSim::set_thread_count(int threads, bool pin_threads)
+{
+	if (!m_pool.init(threads, pin_threads))
+		return false;
+	// scratch areas of the tiling are per worker
+	if (m_block_steps > 1)
+		return set_temporal_blocking(m_block_steps, m_block_tile_rows, m_block_tile_cols);
+	return true;
+}
+
+int WaterSim::get_thread_count() const
+{
+	return m_pool.get_thread_count();
+}
+
+bool WaterSim::set_temporal_blocking(int steps, int tile_rows, int tile_cols)
+{
+	m_block_steps = 1;
+	m_tiling.release();
+	m_v_new.release();
+	if (steps <= 1)
+		return true;
+	if (m_fixed || m_refine)
+	{
+		fprintf(stderr, "Temporal blocking is not supported in fixed-point and refined modes.\n");
+		return false;
+	}
+
+	if (!m_tiling.init(m_grid_x, m_grid_z, steps, tile_rows, tile_cols, m_pool.get_thread_count()))
+		return false;
+	if (!m_v_new.init(m_grid_x, m_grid_z))
+	{
+		m_tiling.release();
+		return false;
+	}
+	m_block_steps = steps;
+	m_block_tile_rows = tile_rows;
+	m_block_tile_cols = tile_cols;
+	return true;
+}
+
+int WaterSim::get_temporal_blocking() const
+{
+	return m_block_steps;
+}
+
+bool WaterSim::set_sparse(bool enabled, int tile_size, double threshold)
+{
+	m_sparse = false;
+	m_activity.release();
+	if (!enabled)
+		return true;
+	if (m_fixed || m_refine)
+	{
+		fprintf(stderr, "Sparse stepping is not supported in fixed-point and refined modes.\n");
+		return false;
+	}
+
+	if (!m_activity.init(m_grid_x, m_grid_z, tile_size))
+		return false;
+	// the first step measures every tile
+	m_activity.wake_all();
+	m_sparse_threshold = threshold;
+	m_sparse = true;
+	return true;
+}
+
+bool WaterSim::get_sparse() const
+{
+	return m_sparse;
+}
+
+int WaterSim::get_tile_count() const
+{
+	return m_activity.get_tile_count();
+}
+
+int WaterSim::get_active_tile_count() const
+{
+	return m_activity.get_active_count();
+}
+
+double WaterSim::get_bytes_per_cell() const
+{
+	if (m_grid_x <= 0 || m_grid_z <= 0)
+		return 0.0;
+	size_t bytes = m_u.get_bytes() + m_u_new.get_bytes() + m_v.get_bytes() + m_v_new.get_bytes() +
+		m_u16.get_bytes() + m_u16_new.get_bytes() + m_v16.get_bytes() + m_refinement.get_bytes();
+	return double(bytes)/(double(m_grid_x)*double(m_grid_z));
+}
+
+bool WaterSim::set_fixed_point(bool enabled, double scale)
+{
+	if (scale <= 0.0)
+	{
+		fprintf(stderr, "Invalid scale of fixed-point water surface.\n");
+		return false;
+	}
+	if (enabled && m_refine)
+	{
+		fprintf(stderr, "Fixed-point mode is not supported with refinement.\n");
+		return false;
+	}
+	// before init() only the mode is chosen
+	bool allocated = m_fixed ? m_u16.get_rows() > 0 : m_u.get_rows() > 0;
+	if (!allocated)
+	{
+		m_fixed = enabled;
+		m_fixed_scale = scale;
+		return true;
+	}
+	// double velocity of a stored fixed-point one is v*scale/vel_scale
+	double vel_scale = m_dt*double(1 << WAVE_VEL_FRAC_BITS);
+
+	// rescaling goes through the double representation
+	if (m_fixed)
+	{
+		if (!m_u.init(m_grid_x, m_grid_z) || !m_u_new.init(m_grid_x, m_grid_z) || !m_v.init(m_grid_x, m_grid_z))
+		{
+			m_u.release();
+			m_u_new.release();
+			m_v.release();
+			return false;
+		}
+		for (int i = 0; i < m_grid_x + 2; i++)
+			for (int j = 0; j < m_grid_z + 2; j++)
+			{
+				m_u.at(i, j) = m_u16.at(i, j)*m_fixed_scale;
+				m_v.at(i, j) = m_v16.at(i, j)*m_fixed_scale/vel_scale;
+			}
+		m_u16.release();
+		m_u16_new.release();
+		m_v16.release();
+		m_fixed = false;
+	}
+	if (!enabled)
+		return true;
+
+	set_sparse(false);
+	set_temporal_blocking(1);
+	if (!m_u16.init(m_grid_x, m_grid_z) || !m_u16_new.init(m_grid_x, m_grid_z) || !m_v16.init(m_grid_x, m_grid_z))
+	{
+		m_u16.release();
+		m_u16_new.release();
+		m_v16.release();
+		return false;
+	}
+	for (int i = 0; i < m_grid_x + 2; i++)
+		for (int j = 0; j < m_grid_z + 2; j++)
+		{
+			m_u16.at(i, j) = wave_to_fixed(m_u.at(i, j), scale);
+			m_v16.at(i, j) = wave_to_fixed(m_v.at(i, j)*vel_scale, scale);
+		}
+	m_u.release();
+	m_u_new.release();
+	m_v.release();
+	m_fixed = true;
+	m_fixed_scale = scale;
+	return true;
+}
+
+bool WaterSim::get_fixed_point() const
+{
+	return m_fixed;
+}
+
+double WaterSim::get_height(int i, int j) const
+{
+	if (m_fixed)
+		return m_rest_level + m_u16.at(i, j)*m_fixed_scale;
+	return m_rest_level + m_u.at(i, j);
+}
+
+void WaterSim::copy_heights(float* dst) const
+{
+	for (int i = 1; i < m_grid_x + 1; i++)
+	{
+		float* out = dst + size_t(i - 1)*m_grid_z;
+		if (m_fixed)
+		{
+			wave_fixed_to_float(m_u16.row(i) + 1, out, m_grid_z, float(m_fixed_scale), float(m_rest_level));
+			continue;
+		}
+		const double* u = m_u.row(i) + 1;
+		for (int j = 0; j < m_grid_z; j++)
+			out[j] = float(m_rest_level + u[j]);
+	}
+}
+
+void WaterSim::write_mesh(WaterMeshVertex* dst, const WaterMeshParams& params)
+{
+	size_t row = size_t(m_grid_z) + 2;
+	m_mesh_rows.resize(3*row*m_pool.get_thread_count());
+	m_mesh_dst = dst;
+	m_mesh_params = params;
+	m_mesh_params.grid_x = m_grid_x;
+	m_mesh_params.grid_z = m_grid_z;
+	m_pool.run(mesh_task, this);
+	m_mesh_dst = nullptr;
+}
+
+void WaterSim::mesh_task(void* ctx, int worker, int workers)
+{
+	WaterSim* surface = static_cast<WaterSim*>(ctx);
+	int grid_x = surface->m_grid_x;
+	int grid_z = surface->m_grid_z;
+	int row_begin = 1 + grid_x*worker/workers;
+	int row_end = 1 + grid_x*(worker + 1)/workers;
+	if (row_begin >= row_end)
+		return;
+
+	// sliding window of three converted rows
+	size_t row = size_t(grid_z) + 2;
+	float* up = &surface->m_mesh_rows[3*row*worker];
+	float* h = up + row;
+	float* down = h + row;
+	surface->load_mesh_row(std::max(row_begin - 1, 1), up);
+	surface->load_mesh_row(row_begin, h);
+	for (int i = row_begin; i < row_end; i++)
+	{
+		surface->load_mesh_row(std::min(i + 1, grid_x), down);
+		water_mesh_row(up + 1, h + 1, down + 1, i - 1, surface->m_mesh_params,
+			surface->m_mesh_dst + size_t(i - 1)*grid_z);
+		float* t = up;
+		up = h;
+		h = down;
+		down = t;
+	}
+}
+
+void WaterSim::load_mesh_row(int i, float* dst) const
+{
+	if (m_fixed)
+		wave_fixed_to_float(m_u16.row(i) + 1, dst + 1, m_grid_z, float(m_fixed_scale), float(m_rest_level));
+	else
+	{
+		const double* u = m_u.row(i) + 1;
+		for (int j = 0; j < m_grid_z; j++)
+			dst[j + 1] = float(m_rest_level + u[j]);
+	}
+	dst[0] = dst[1];
+	dst[m_grid_z + 1] = dst[m_grid_z];
+}
+
+bool WaterSim::set_refinement(bool enabled, int ratio, int block_size, int max_patches,
+	double slope_threshold, int regrid_interval)
+{
+	m_refine = false;
+	m_refinement.release();
+	if (!enabled)
+		return true;
+	if (m_fixed)
+	{
+		fprintf(stderr, "Refinement is not supported in fixed-point mode.\n");
+		return false;
+	}
+
+	set_sparse(false);
+	set_temporal_blocking(1);
+	if (!m_refinement.init(m_grid_x, m_grid_z, block_size, ratio, max_patches,
+		m_wave_speed, m_dt, m_damp_factor, m_dim_x/m_grid_x, m_dim_z/m_grid_z))
+		return false;
+	m_refinement.set_slope_threshold(slope_threshold);
+	m_regrid_interval = std::max(1, regrid_interval);
+	m_regrid_counter = 0;
+	m_refine = true;
+	// waves already running get their patches at once
+	if (m_u.get_rows() > 0)
+		m_refinement.regrid(m_u, m_v);
+	return true;
+}
+
+bool WaterSim::get_refinement() const
+{
+	return m_refine;
+}
+
+int WaterSim::get_patch_count() const
+{
+	return m_refinement.get_patch_count();
+}
+
+double WaterSim::sample_height(float x, float z) const
+{
+	// world position relative to the surface centre -> coarse cells
+	double cx = (x + 0.5*m_dim_x)/m_dim_x*m_grid_x;
+	double cz = (z + 0.5*m_dim_z)/m_dim_z*m_grid_z;
+	if (m_refine)
+		return m_rest_level + m_refinement.sample(cx, cz, m_u);
+	int i = std::min(std::max(int(floor(cx)) + 1, 1), m_grid_x);
+	int j = std::min(std::max(int(floor(cz)) + 1, 1), m_grid_z);
+	return get_height(i, j);
+}
+
+bool WaterSim::save_checkpoint(const char* path) const
+{
+	const void* u = m_fixed ? m_u16.data() : m_u.data();
+	const void* v = m_fixed ? m_v16.data() : m_v.data();
+	size_t field_bytes = m_fixed ? m_u16.get_bytes() : m_u.get_bytes();
+	if (u == nullptr || v == nullptr)
+	{
+		fprintf(stderr, "Water surface is not initialized.\n");
+		return false;
+	}
+
+	WaterCheckpointHeader header;
+	size_t bytes = water_checkpoint_layout(header,
+		m_fixed ? WATER_CHECKPOINT_CPU16 : WATER_CHECKPOINT_CPU,
+		m_fixed ? uint32_t(sizeof(short)) : uint32_t(sizeof(double)),
+		m_grid_x, m_grid_z, field_bytes);
+	header.dim_x = m_dim_x;
+	header.dim_z = m_dim_z;
+	header.wave_speed = m_wave_speed;
+	header.dt = m_dt;
+	header.damp_factor = m_damp_factor;
+	header.rest_level = m_rest_level;
+	header.fixed_scale = m_fixed_scale;
+	header.usec_step_time = m_governor.get_step_time();
+	header.usec_accumulated = m_governor.get_accumulated_time();
+
+	WaterMappedFile file;
+	if (!file.create(path, bytes))
+		return false;
+	char* base = static_cast<char*>(file.data());
+	memcpy(base, &header, sizeof(header));
+	memcpy(base + header.u_offset, u, field_bytes);
+	memcpy(base + header.v_offset, v, field_bytes);
+	file.close();
+	return true;
+}
+
+bool WaterSim::load_checkpoint(const char* path)
+{
+	WaterMappedFile file;
+	if (!file.open(path))
+		return false;
+	const WaterCheckpointHeader* header = water_checkpoint_header(file, path,
+		WATER_CHECKPOINT_CPU, WATER_CHECKPOINT_CPU16);
+	if (header == nullptr)
+		return false;
+	if (header->grid_x != m_grid_x || header->grid_z != m_grid_z)
+	{
+		fprintf(stderr, "Water checkpoint %s has grid %dx%d, the surface %dx%d.\n",
+			path, header->grid_x, header->grid_z, m_grid_x, m_grid_z);
+		return false;
+	}
+	bool fixed = header->kind == WATER_CHECKPOINT_CPU16;
+	if (fixed && m_refine)
+	{
+		fprintf(stderr, "Fixed-point mode is not supported with refinement.\n");
+		return false;
+	}
+	// everything is checked before the current state is replaced
+	size_t field_bytes = fixed ? WaterField16::layout_bytes(m_grid_x, m_grid_z) :
+		WaterField::layout_bytes(m_grid_x, m_grid_z);
+	if (header->field_bytes != field_bytes)
+	{
+		fprintf(stderr, "Water checkpoint %s has a different field layout.\n", path);
+		return false;
+	}
+	if (float(header->dim_x) == 0 || float(header->dim_z) == 0)
+	{
+		fprintf(stderr, "Water checkpoint %s has invalid dimensions.\n", path);
+		return false;
+	}
+
+	// parameters of the saved surface, init() derives the coefficients
+	// and allocates the fields of the saved mode
+	m_dim_x = float(header->dim_x);
+	m_dim_z = float(header->dim_z);
+	m_wave_speed = header->wave_speed;
+	m_dt = header->dt;
+	m_damp_factor = header->damp_factor;
+	if (fixed != m_fixed)
+	{
+		m_u.release();
+		m_u_new.release();
+		m_v.release();
+		m_u16.release();
+		m_u16_new.release();
+		m_v16.release();
+	}
+	m_fixed = fixed;
+	m_fixed_scale = header->fixed_scale;
+	if (fixed)
+	{
+		// as in set_fixed_point()
+		set_sparse(false);
+		set_temporal_blocking(1);
+	}
+	if (!init())
+		return false;
+	if (m_refine && !m_refinement.init(m_grid_x, m_grid_z, m_refinement.get_block_size(),
+		m_refinement.get_ratio(), m_refinement.get_max_patches(),
+		m_wave_speed, m_dt, m_damp_factor, m_cell_size_x, m_cell_size_y))
+		return false;
+
+	const char* base = static_cast<const char*>(file.data());
+	memcpy(fixed ? m_u16.data() : m_u.data(), base + header->u_offset, field_bytes);
+	memcpy(fixed ? m_v16.data() : m_v.data(), base + header->v_offset, field_bytes);
+
+	m_rest_level = header->rest_level;
+	m_governor.set_step_time(header->usec_step_time);
+	m_governor.set_accumulated_time(header->usec_accumulated);
+	if (m_sparse)
+		m_activity.wake_all();
+	return true;
+}
+
+bool WaterSim::set_recorder(WaterRecorder* recorder)
+{
+	m_recorder = nullptr;
+	if (recorder == nullptr)
+		return true;
+	if (!recorder->is_open() || recorder->get_grid_x() != m_grid_x || recorder->get_grid_z() != m_grid_z)
+	{
+		fprintf(stderr, "Water recorder is not open for a %dx%d grid.\n", m_grid_x, m_grid_z);
+		return false;
+	}
+	m_record_heights.resize(size_t(m_grid_x)*m_grid_z);
+	m_record_countdown = recorder->get_interval();
+	m_record_step = 0;
+	m_recorder = recorder;
+	return true;
+}
+
+WaterRecorder* WaterSim::get_recorder() const
+{
+	return m_recorder;
+}
@@ -0,0 +1,201 @@
+#ifndef watersimH
+#define watersimH
+
+#include "water_field.h"
+#include "water_kernels.h"
+#include "water_temporal_tiling.h"
+#include "water_activity.h"
+#include "water_impulse.h"
+#include "water_refinement.h"
+#include "water_recording.h"
+#include "water_mesh.h"
+#include "thread_pool.h"
+#include "sim_governor.h"
+#include <cstdint>
+
+// CPU water simulation without any windowing or GL dependency: state,
+// stepping, touches, boundary handling and parameters. Heights are kept
+// per cell of a grid_x x grid_z grid covering dim_x x dim_z, surrounded
+// by one halo cell clamped to the edge (shore). Renderers such as
+// WaterSurfaceCPU read the state through get_height()/copy_heights();
+// errors are reported on stderr and by the return value.
+class WaterSim
+{
+public:
+	WaterSim(
+		float dim_x, float dim_z, int grid_x, int grid_z, 
+		float wave_speed, float dt, float damp_factor, uint64_t usec_step_time);
+	bool init();
+
+	int get_grid_x() const { return m_grid_x; }
+	int get_grid_z() const { return m_grid_z; }
+	float get_dim_x() const { return m_dim_x; }
+	float get_dim_z() const { return m_dim_z; }
+	// valid after init()
+	float get_cell_size_x() const { return m_cell_size_x; }
+	float get_cell_size_z() const { return m_cell_size_y; }
+
+	void update_model(uint64_t usec_time, bool force_one_step);
+	// immediate touch, cost proportional to the brush area
+	void touch(int x, int y, double strength, double distance);
+
+	// touches collected between steps (mouse drags) and applied in one
+	// pass before the next simulation step
+	void queue_touch(int x, int y, double strength, double distance);
+	int get_queued_touch_count() const;
+
+	// catch-up policy (step/time budget per frame, drop or slow motion)
+	SimGovernor& get_governor();
+	const SimGovernor& get_governor() const;
+
+	// memory used by the solver fields (halo and padding included)
+	// divided by the number of simulated cells
+	double get_bytes_per_cell() const;
+
+	// SIMD level of the step kernel, detected in the constructor;
+	// can be lowered to reproduce results of other machines
+	void set_isa(WaveIsa isa);
+	WaveIsa get_isa() const;
+
+	// threads used by update_model (0 = one per hardware thread), the grid
+	// is split in horizontal bands, one per thread; with pin_threads
+	// workers are bound to consecutive cores
+	bool set_thread_count(int threads, bool pin_threads);
+	int get_thread_count() const;
+
+	// fuse up to steps catch-up steps per cache tile (temporal blocking),
+	// steps <= 1 disables it; needs one more velocity field
+	bool set_temporal_blocking(int steps, int tile_rows = 64, int tile_cols = 256);
+	int get_temporal_blocking() const;
+
+	// sparse stepping: only tiles (tile_size^2 cells) that move more than
+	// threshold, and their neighbourhood, are updated; temporal blocking
+	// is not used while it is enabled
+	bool set_sparse(bool enabled, int tile_size = 32, double threshold = 1.0e-5);
+	bool get_sparse() const;
+	int get_tile_count() const;
+	int get_active_tile_count() const;
+
+	// int16 fixed-point solver: heights are stored relative to the rest
+	// level in units of scale (range +-32768*scale), velocities as 1/16 of
+	// that per step; arithmetic saturates. Converts the current state,
+	// sparse stepping and temporal blocking are disabled meanwhile.
+	bool set_fixed_point(bool enabled, double scale = 1.0/16384.0);
+	bool get_fixed_point() const;
+
+	// height of cell (i, j), halo included, in either mode
+	double get_height(int i, int j) const;
+	// grid_x*grid_z simulated heights, row by row, for upload/rendering
+	void copy_heights(float* dst) const;
+	// grid_x*grid_z vertices of the displaced surface with normals, row by
+	// row (water_mesh.h), written in bands by the worker threads; heights
+	// are clamped at the edges. dst may be a mapped GL buffer.
+	void write_mesh(WaterMeshVertex* dst, const WaterMeshParams& params);
+
+	// adaptive refinement: blocks of block_size^2 cells around touches and
+	// waves steeper than slope_threshold are simulated on ratio times finer
+	// patches (at most max_patches), regridded every regrid_interval steps;
+	// the coarse grid holds the patch averages. Not combined with the
+	// fixed-point, sparse and temporal blocking modes.
+	bool set_refinement(bool enabled, int ratio = 4, int block_size = 16, int max_patches = 256,
+		double slope_threshold = 0.01, int regrid_interval = 8);
+	bool get_refinement() const;
+	int get_patch_count() const;
+	// finest height at world position x, z (surface centred at the origin)
+	double sample_height(float x, float z) const;
+
+	// checkpoint of heights, velocities, parameters and the simulation
+	// time not stepped yet (see water_checkpoint.h); queued touches and
+	// refinement patches are not saved, the coarse grid holds their
+	// averages and patches are rebuilt by the next regrid. The grid size
+	// must match; parameters and the fixed-point mode are taken from the
+	// file, the governor keeps the clock of the last update_model() call
+	// and continues with the saved time not stepped yet.
+	bool save_checkpoint(const char* path) const;
+	bool load_checkpoint(const char* path);
+
+	// heights are pushed to recorder after every recorder->get_interval()
+	// steps (update_model() splits its steps there), nullptr stops; the
+	// recorder is not owned and must be open with this grid size
+	bool set_recorder(WaterRecorder* recorder);
+	WaterRecorder* get_recorder() const;
+
+private:
+	WaterSim(const WaterSim&);
+	WaterSim& operator=(const WaterSim&);
+
+	static void step_task(void* ctx, int worker, int workers);
+	void step_band(int row_begin, int row_end, const WaterField& u, WaterField& u_new);
+	void step_band16(int row_begin, int row_end, const WaterField16& u, WaterField16& u_new);
+	void run_steps(int steps);
+	static void tiled_task(void* ctx, int worker, int workers);
+	static void mesh_task(void* ctx, int worker, int workers);
+	// heights of row i (1..grid_x) as floats, dst[0] and dst[grid_z + 1]
+	// repeat the edge cells
+	void load_mesh_row(int i, float* dst) const;
+	void run_tiled_steps(int steps);
+	void run_refined_steps(int steps);
+	// steps in the current mode
+	void run_batch(int steps);
+	// sum of the simulated fixed-point heights
+	int64_t fixed_volume() const;
+	void apply_impulses();
+	// returns the volume removed from the surface
+	double apply_impulse(const WaterImpulse& impulse);
+
+	// set by constructor
+	float m_dim_x;
+	float m_dim_z;
+	int m_grid_x;
+	int m_grid_z;
+	double m_wave_speed;
+	double m_dt;
+	double m_damp_factor;
+
+	// initialized in the init() method
+	float m_cell_size_x;
+	float m_cell_size_y;
+	WaterField m_u;
+	WaterField m_u_new;
+	WaterField m_v;
+	WaveCoeffs m_coeffs;
+	WaveIsa m_isa;
+	WaveRowKernel m_row_kernel;
+	ThreadPool m_pool;
+	int m_pending_steps;
+	WaterTemporalTiling m_tiling;
+	WaterField m_v_new;
+	int m_block_steps;
+	int m_block_tile_rows;
+	int m_block_tile_cols;
+	WaterActivityMask m_activity;
+	bool m_sparse;
+	double m_sparse_threshold;
+	// mean level raised by touch(); fields hold heights relative to it
+	// and it is added at readback (get_height/copy_heights/render)
+	double m_rest_level;
+	WaterStamp m_stamp;
+	std::vector<WaterImpulse> m_impulses;
+	WaterField16 m_u16;
+	WaterField16 m_u16_new;
+	WaterField16 m_v16;
+	WaveCoeffs16 m_coeffs16;
+	WaveRowKernel16 m_row_kernel16;
+	bool m_fixed;
+	double m_fixed_scale;
+	WaterRefinement m_refinement;
+	bool m_refine;
+	int m_regrid_interval;
+	int m_regrid_counter;
+	SimGovernor m_governor;
+	WaterRecorder* m_recorder;
+	int m_record_countdown; // steps to the next recorded frame
+	uint64_t m_record_step;
+	std::vector<float> m_record_heights;
+	// write_mesh()
+	WaterMeshVertex* m_mesh_dst;
+	WaterMeshParams m_mesh_params;
+	std::vector<float> m_mesh_rows; // three rows per worker
+};
+
+#endif
\ No newline at end of file
@@ -1,450 +1,915 @@
-#include "water_surface.h"
-#include <cstdio>
-#include <algorithm>
-#include <cmath>
-#include <windows.h>
-#include "glplusx.h"
-#include "glplusx_prog.h"
-#include "sys_base.h"
-#include "glext.h"
-#define M_PI 3.14159265358979323846
-
-
-WaterSurface::WaterSurface(
-		float dim_x, float dim_z, float pos_y, int grid_x, int grid_z, 
-		float wave_speed, float dt, float damp_factor, uint64 usec_step_time) 
-{
-	m_dim_x = dim_x;
-	m_dim_z = dim_z;
-	m_pos_y = pos_y;
-	m_grid_x = grid_x;
-	m_grid_z = grid_z;
-	m_wave_speed = wave_speed;
-	m_dt = dt;
-	m_damp_factor = damp_factor;
-	m_step = usec_step_time;
-
-	m_plane = nullptr;
-
-	m_air_refract_index = 1.000293f;
-	m_water_refract_index = 1.22f;
-}
-
-WaterSurface::~WaterSurface()
-{
-	if (m_plane != nullptr) 
-		delete m_plane;
-}
-
-bool WaterSurface::init() 
-{
-	if (m_dim_x == 0 || m_dim_z == 0 || m_grid_x == 0 || m_grid_z == 0)
-	{
-		fprintf(stderr, "Invalid dimensions of water surface.\n");
-		return false;
-	}
-
-	m_simulation_time = 0;
-	m_last_call = 0;
-
-	m_model_mat = math::Mat4x4f(math::Mat4x4f::I);
-	m_caustics_model_mat = math::Mat4x4f(math::Mat4x4f::I);
-	
-	m_plane = new Renderable();
-	if (!m_plane->load_grid(m_dim_x/2.0f, m_dim_z/2.0f, m_pos_y, m_grid_x, m_grid_z, 1.0f, 1.0f))
-	{
-		fprintf(stderr, "Loading planes failed.\n");
-		return false;
-	}
-	if (!m_plane->addTextures("base", L"data/textures/water_diff.jpg", nullptr, nullptr))
-	{
-		fprintf(stderr, "Loading texture for plane failed.\n");
-		return false;
-	}
-
-	// pool texture 
-	m_pool_tex.init();
-	if (!glpx::LoadTex2D_RGBA(m_pool_tex, L"data/textures/tile.gif")) {
-		fprintf(stderr, "Loading pool texture failed.\n");
-		return false;
-	}
-	m_pool_tex.set_wrapST(glp::Tex::WrapMode::WM_REPEAT);
-
-	// light texture for caustics
-	m_sunlight_tex.init();
-	if (!glpx::LoadTex2D_RGBA(m_sunlight_tex, L"data/textures/sunlight.jpg")) {
-		fprintf(stderr, "Loading sunlight texture failed.\n");
-		return false;
-	}
-	m_sunlight_tex.set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
-
-	m_frame_buff.init();
-
-	m_height_tex1.init();
-	m_height_tex1.set_image(0, m_grid_x, m_grid_z, glp::Tex::IF_RGBA16F,
-		glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, nullptr);
-	m_height_tex1.set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
-	// why CLAMP_TO_EDGE? We don't want linear interpolation beetweend two borders
-	// what's more, we don't have to clamp manualy first and last row of texture,
-	// but just use values < 0.0 and > 1.0
-
-	m_height_tex2.init();
-	m_height_tex2.set_image(0, m_grid_x, m_grid_z, glp::Tex::IF_RGBA16F,
-		glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, nullptr);
-	m_height_tex2.set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
-
-	m_velocity_tex1.init();
-	m_velocity_tex1.set_image(0, m_grid_x, m_grid_z, glp::Tex::IF_RGBA16F,
-		glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, nullptr);
-	m_velocity_tex1.set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
-
-	m_velocity_tex2.init();
-	m_velocity_tex2.set_image(0, m_grid_x, m_grid_z, glp::Tex::IF_RGBA16F,
-		glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, nullptr);
-	m_velocity_tex2.set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
-
-	m_act_height_tex = &m_height_tex1;
-	m_new_height_tex = &m_height_tex2;
-
-	m_act_velocity_tex = &m_velocity_tex1;
-	m_new_velocity_tex = &m_velocity_tex2;
-
-	return init_render_programs();
-}
-
-bool WaterSurface::init_render_programs()
-{
-	// render shaders
-	{
-		glp::VertProgram vprog;
-		vprog.init();
-		glpx::program_set_source_file(vprog, "glsl/water_vprog.txt");
-		if (!vprog.compile())
-		{
-			glpx::ProgramLog pl;
-			MessageBoxA(NULL, glpx::get_log(vprog, pl),
-				"VERTEX PROGRAM ERROR", MB_OK | MB_ICONSTOP);
-			vprog.release();
-			return false;
-		}
-
-		glp::FragProgram fprog;
-		fprog.init();
-		glpx::program_set_source_file(fprog, "glsl/water_fprog.txt");
-		if (!fprog.compile())
-		{
-			glpx::ProgramLog pl;
-			MessageBoxA(nullptr, glpx::get_log(fprog, pl),
-				"FRAGMENT PROGRAM ERROR", MB_OK | MB_ICONSTOP);
-			fprog.release();
-			vprog.release();
-			return false;
-		}
-
-		m_water_render_prog.init();
-		m_water_render_prog.attach(vprog);
-		m_water_render_prog.attach(fprog);
-
-		m_water_render_prog.bind_attrib_loc("point", Renderable::ATTR_LOC_POINT);
-		m_water_render_prog.bind_attrib_loc("coord", Renderable::ATTR_LOC_COORD);
-		m_water_render_prog.bind_attrib_loc("normal", Renderable::ATTR_LOC_NORMAL);
-
-		if (!m_water_render_prog.link())
-		{
-			glpx::ProgramLog pl;
-			MessageBoxA(nullptr, glpx::get_log(m_water_render_prog, pl),
-				"PROGRAM LINK ERROR", MB_OK | MB_ICONSTOP);
-			m_water_render_prog.release();
-			fprog.release();
-			vprog.release();
-			return false;
-		}
-
-		m_water_render_prog.uniform("texDiff", 0);
-		m_water_render_prog.uniform_vec2("size", math::Vec2f(m_grid_x, m_grid_z).m);
-		m_water_render_prog.uniform("h_x", m_dim_x / m_grid_x);
-		m_water_render_prog.uniform("h_z", m_dim_z / m_grid_z);
-
-		// calculate uniform for Fresnel equation approximation
-		float eta = m_air_refract_index / m_water_refract_index; // n1/n2 <- refract index of air/water
-		float f = ((1 - eta) * (1 - eta)) / ((1 + eta) * (1 + eta)); // equation given in OpenGL shading language, site 359
-		m_water_render_prog.uniform("f", f);
-		m_water_render_prog.uniform("eta", eta);
-
-		m_water_render_prog.uniform("water_y_pos", m_pos_y);
-	}
-
-	// caustics shaders
-	{
-		glp::VertProgram vprog;
-		vprog.init();
-		glpx::program_set_source_file(vprog, "glsl/caustics_vprog.txt");
-		if (!vprog.compile())
-		{
-			glpx::ProgramLog pl;
-			MessageBoxA(NULL, glpx::get_log(vprog, pl),
-				"VERTEX PROGRAM ERROR", MB_OK | MB_ICONSTOP);
-			vprog.release();
-			return false;
-		}
-
-		glp::FragProgram fprog;
-		fprog.init();
-		glpx::program_set_source_file(fprog, "glsl/caustics_fprog.txt");
-		if (!fprog.compile())
-		{
-			glpx::ProgramLog pl;
-			MessageBoxA(nullptr, glpx::get_log(fprog, pl),
-				"FRAGMENT PROGRAM ERROR", MB_OK | MB_ICONSTOP);
-			fprog.release();
-			vprog.release();
-			return false;
-		}
-
-		m_caustics_prog.init();
-		m_caustics_prog.attach(vprog);
-		m_caustics_prog.attach(fprog);
-
-		m_caustics_prog.bind_attrib_loc("point", Renderable::ATTR_LOC_POINT);
-		m_caustics_prog.bind_attrib_loc("coord", Renderable::ATTR_LOC_COORD);
-		m_caustics_prog.bind_attrib_loc("normal", Renderable::ATTR_LOC_NORMAL);
-
-		if (!m_caustics_prog.link())
-		{
-			glpx::ProgramLog pl;
-			MessageBoxA(nullptr, glpx::get_log(m_water_render_prog, pl),
-				"PROGRAM LINK ERROR", MB_OK | MB_ICONSTOP);
-			m_water_render_prog.release();
-			fprog.release();
-			vprog.release();
-			return false;
-		}
-
-		m_caustics_prog.uniform_vec2("size", math::Vec2f(m_grid_x, m_grid_z).m);
-		m_caustics_prog.uniform_vec2("dim", math::Vec2f(m_dim_x, m_dim_z).m);
-		m_caustics_prog.uniform("h_x", m_dim_x / m_grid_x);
-		m_caustics_prog.uniform("h_z", m_dim_z / m_grid_z);
-	}
-
-	// GPGPU shaders
-	{
-		glp::VertProgram vprog;
-		vprog.init();
-		glpx::program_set_source_file(vprog, "glsl/calc_wave_vprog.txt");
-		if (!vprog.compile()) {
-			glpx::ProgramLog pl;
-			MessageBoxA(NULL, glpx::get_log(vprog, pl),
-				"VERTEX PROGRAM ERROR", MB_OK | MB_ICONSTOP);
-			vprog.release();
-			return false;
-		}
-
-		glp::FragProgram fprog;
-		fprog.init();
-		glpx::program_set_source_file(fprog, "glsl/calc_wave_fprog.txt");
-		if (!fprog.compile()) {
-			glpx::ProgramLog pl;
-			MessageBoxA(nullptr, glpx::get_log(fprog, pl),
-				"FRAGMENT PROGRAM ERROR", MB_OK | MB_ICONSTOP);
-			fprog.release();
-			vprog.release();
-			return false;
-		}
-
-		m_update_height_prog.init();
-		m_update_height_prog.attach(vprog);
-		m_update_height_prog.attach(fprog);
-
-		m_update_height_prog.bind_attrib_loc("point", 0);
-
-		m_update_height_prog.bind_frag_data_loc("height", 0);
-		m_update_height_prog.bind_frag_data_loc("velocity", 1);
-
-		if (!m_update_height_prog.link())
-		{
-			glpx::ProgramLog pl;
-			MessageBoxA(nullptr, glpx::get_log(m_update_height_prog, pl),
-				"PROGRAM LINK ERROR", MB_OK | MB_ICONSTOP);
-			m_update_height_prog.release();
-			fprog.release();
-			vprog.release();
-			return false;
-		}
-
-		m_update_height_prog.uniform("heightOld", 0);
-		m_update_height_prog.uniform("velocityOld", 1);
-		m_update_height_prog.uniform_vec2("size", math::Vec2f(m_grid_x, m_grid_z).m);
-		m_update_height_prog.uniform("h_x", m_dim_x / m_grid_x);
-		m_update_height_prog.uniform("h_z", m_dim_z / m_grid_z);
-		m_update_height_prog.uniform("wave_speed", m_wave_speed);
-		m_update_height_prog.uniform("dt", m_dt);
-		m_update_height_prog.uniform("damp_factor", m_damp_factor);
-
-		math::Vec2f quad[4] =
-		{
-			math::Vec2f(-1.0f, -1.0f),
-			math::Vec2f( 1.0f, -1.0f),
-			math::Vec2f(-1.0f,  1.0f),
-			math::Vec2f( 1.0f,  1.0f)
-		};
-		m_quad.init();
-		m_quad.buffer_data(4*sizeof(math::Vec2f), glp::Buffer::UM_STATIC_DRAW, quad);
-
-		m_varray.init();
-		glp::Device::bind_vertex_array(m_varray);
-		glp::Device::bind_buffer(m_quad);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 2, GL_FLOAT, GL_TRUE, sizeof(math::Vec2f), nullptr);
-		glp::Device::unbind_vertex_array(m_varray);
-		glp::Device::unbind_buffer(m_quad);
-	}
-	return true;
-}
-
-void WaterSurface::render(
-	const math::Vec3f viewer_pos, const math::Mat4x4f projection,
-	const math::Mat4x4f& inv_view,
-	const glp::TexCube &cube_map)
-{
-	
-
-	// water render
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glp::Device::bind_program(m_water_render_prog);
-	
-	m_water_render_prog.uniform_mat4x4("proj", projection.m, true);
-	m_water_render_prog.uniform_vec3("viewerPos", viewer_pos.m);
-
-	glp::Device::bind_tex(*m_act_height_tex, 4);
-	glp::Device::bind_tex(cube_map, 5);
-	glp::Device::bind_tex(m_pool_tex, 6);
-
-	m_water_render_prog.uniform("wave_height", 4);
-	m_water_render_prog.uniform("cube_map", 5);
-	m_water_render_prog.uniform("pool_tex", 6);
-	m_water_render_prog.uniform_mat4x4("model", m_model_mat.m, true);
-	m_water_render_prog.uniform_mat4x4("modelView", (inv_view*m_model_mat).m, true);
-	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	m_plane->render(true);
-	//glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	glp::Device::unbind_tex(cube_map, 5);
-	glp::Device::unbind_tex(m_pool_tex, 6);
-	glp::Device::unbind_tex(*m_act_height_tex, 4);
-	glp::Device::unbind_program(m_water_render_prog);
-
-	// caustics render
-	
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-	glp::Device::bind_program(m_caustics_prog);
-	m_caustics_prog.uniform_mat4x4("proj", projection.m, true);
-	m_caustics_prog.uniform_vec3("viewerPos", viewer_pos.m);
-
-	glp::Device::bind_tex(*m_act_height_tex, 4);
-	glp::Device::bind_tex(m_sunlight_tex, 5);
-
-	m_caustics_prog.uniform("wave_height", 4);
-	m_caustics_prog.uniform("tex_light", 5);
-
-	math::set_translation(m_caustics_model_mat, math::Vec3f(0.0f, -1.925f, 0.0f));
-	m_caustics_prog.uniform_mat4x4("model", m_caustics_model_mat.m, true);
-	m_caustics_prog.uniform_mat4x4("modelView", (inv_view*m_caustics_model_mat).m, true);
-
-	m_plane->render(true);
-
-	glp::Device::unbind_tex(m_sunlight_tex, 5);
-	glp::Device::unbind_tex(*m_act_height_tex, 4);
-	glp::Device::unbind_program(m_caustics_prog);
-	glDisable(GL_BLEND);
-	
-}
-
-void WaterSurface::update_model(uint64 usec_time, bool force_one_step)
-{
-	if (force_one_step) 
-	{
-		m_simulation_time = m_step + 1;
-	}
-	else 
-	{
-		m_simulation_time += (usec_time - m_last_call);
-		m_last_call = usec_time;
-	}
-	while (m_simulation_time > m_step) {
-		m_simulation_time -= m_step;
-
-		// render heights (and normals in the future) to texture
-		glp::Device::bind_program(m_update_height_prog);
-
-		m_frame_buff.attach_tex_2d(*m_new_height_tex, 0);
-		m_frame_buff.attach_tex_2d(*m_new_velocity_tex, 1);
-	
-		glp::Device::bind_fbuff(m_frame_buff);
-
-		GLenum bufs[2] = {
-			GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
-		glDrawBuffers(2, bufs);
-
-		glClear(GL_COLOR_BUFFER_BIT);
-	
-		glp::Device::bind_tex(*m_act_height_tex, 0);
-		glp::Device::bind_tex(*m_act_velocity_tex, 1);
-		
-		glp::Device::bind_vertex_array(m_varray);
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-		glp::Device::unbind_vertex_array(m_varray);
-
-		glp::Device::unbind_tex(*m_act_velocity_tex, 1);
-		glp::Device::unbind_tex(*m_act_height_tex, 0);
-
-		glp::Device::unbind_fbuff(m_frame_buff);
-
-		m_frame_buff.detach_tex_2d(1);
-		m_frame_buff.detach_tex_2d(0);
-
-		m_new_height_tex->gen_mipmaps();
-		m_new_velocity_tex->gen_mipmaps();
-
-		// swap textures
-		glp::Tex2D* tmp = m_act_height_tex;
-		m_act_height_tex = m_new_height_tex;
-		m_new_height_tex = tmp;
-
-		tmp = m_act_velocity_tex;
-		m_act_velocity_tex = m_new_velocity_tex;
-		m_new_velocity_tex = tmp;
-	}
-}
-
-void WaterSurface::touch(int x, int y, double strength, double distance)
-{
-	m_update_height_prog.uniform("touch_distance", float(distance));
-	m_update_height_prog.uniform("touch_strength", float(strength));
-	m_update_height_prog.uniform_vec2("touch_pos", math::Vec2f(x, y).m);
-
-	update_model(0, true);
-
-	m_update_height_prog.uniform("touch_distance", 0.0f);
-}
-
-float WaterSurface::get_dim_x()
-{
-	return m_dim_x;
-}
-float WaterSurface::get_dim_z()
-{
-	return m_dim_z;
-}
-float WaterSurface::get_pos_y()
-{
-	return m_pos_y;
-}
-int WaterSurface::get_grid_x()
-{
-	return m_grid_x;
-}
-int WaterSurface::get_grid_z()
-{
-	return m_grid_z;
+#include "water_surface.h"
+#include "water_checkpoint.h"
+#include "render_stats.h"
+#include "uniform_stream.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <windows.h>
+#include "glplusx.h"
+#include "glplusx_prog.h"
+#include "sys_base.h"
+#include "glext.h"
+#define M_PI 3.14159265358979323846
+
+
+WaterSurface::WaterSurface(
+		float dim_x, float dim_z, float pos_y, int grid_x, int grid_z, 
+		float wave_speed, float dt, float damp_factor, uint64 usec_step_time):
+	m_governor(usec_step_time)
+{
+	m_dim_x = dim_x;
+	m_dim_z = dim_z;
+	m_pos_y = pos_y;
+	m_grid_x = grid_x;
+	m_grid_z = grid_z;
+	m_wave_speed = wave_speed;
+	m_dt = dt;
+	m_damp_factor = damp_factor;
+
+	m_plane = nullptr;
+
+	m_playing = false;
+	m_play_clock_started = false;
+	m_play_last_usec = 0;
+	m_play_usec = 0;
+	m_play_loaded[0] = m_play_loaded[1] = UINT64_MAX;
+	m_play_first = 0;
+	for (int a = 0; a < PLAYBACK_RING; a++)
+	{
+		m_play_pbo[a] = 0;
+		m_play_ptr[a] = nullptr;
+		m_play_fence[a] = nullptr;
+	}
+	m_play_persistent = false;
+	m_play_slot = 0;
+	m_play_alpha_loc = -1;
+
+	m_air_refract_index = 1.000293f;
+	m_water_refract_index = 1.22f;
+}
+
+WaterSurface::~WaterSurface()
+{
+	if (m_plane != nullptr) 
+		delete m_plane;
+}
+
+bool WaterSurface::init() 
+{
+	if (m_dim_x == 0 || m_dim_z == 0 || m_grid_x == 0 || m_grid_z == 0)
+	{
+		fprintf(stderr, "Invalid dimensions of water surface.\n");
+		return false;
+	}
+
+	m_governor.reset(m_governor.get_last_call());
+
+	m_model_mat = math::Mat4x4f(math::Mat4x4f::I);
+	m_caustics_model_mat = math::Mat4x4f(math::Mat4x4f::I);
+	math::set_translation(m_caustics_model_mat, math::Vec3f(0.0f, -1.925f, 0.0f));
+	
+	m_plane = new Renderable();
+	// the plane is displaced in world space, so positions stay floats
+	m_plane->set_vertex_format(Renderable::VA_POINT | Renderable::VA_COORD | Renderable::VA_NORMAL);
+	if (!m_plane->load_grid(m_dim_x/2.0f, m_dim_z/2.0f, m_pos_y, m_grid_x, m_grid_z, 1.0f, 1.0f))
+	{
+		fprintf(stderr, "Loading planes failed.\n");
+		return false;
+	}
+	if (!m_plane->addTextures("base", L"data/textures/water_diff.jpg", nullptr, nullptr))
+	{
+		fprintf(stderr, "Loading texture for plane failed.\n");
+		return false;
+	}
+
+	// pool texture 
+	m_pool_tex.init();
+	if (!glpx::LoadTex2D_RGBA(m_pool_tex, L"data/textures/tile.gif")) {
+		fprintf(stderr, "Loading pool texture failed.\n");
+		return false;
+	}
+	m_pool_tex.set_wrapST(glp::Tex::WrapMode::WM_REPEAT);
+
+	// light texture for caustics
+	m_sunlight_tex.init();
+	if (!glpx::LoadTex2D_RGBA(m_sunlight_tex, L"data/textures/sunlight.jpg")) {
+		fprintf(stderr, "Loading sunlight texture failed.\n");
+		return false;
+	}
+	m_sunlight_tex.set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
+
+	m_frame_buff.init();
+
+	m_height_tex1.init();
+	m_height_tex1.set_image(0, m_grid_x, m_grid_z, glp::Tex::IF_RGBA16F,
+		glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, nullptr);
+	m_height_tex1.set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
+	// why CLAMP_TO_EDGE? We don't want linear interpolation beetweend two borders
+	// what's more, we don't have to clamp manualy first and last row of texture,
+	// but just use values < 0.0 and > 1.0
+
+	m_height_tex2.init();
+	m_height_tex2.set_image(0, m_grid_x, m_grid_z, glp::Tex::IF_RGBA16F,
+		glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, nullptr);
+	m_height_tex2.set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
+
+	m_velocity_tex1.init();
+	m_velocity_tex1.set_image(0, m_grid_x, m_grid_z, glp::Tex::IF_RGBA16F,
+		glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, nullptr);
+	m_velocity_tex1.set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
+
+	m_velocity_tex2.init();
+	m_velocity_tex2.set_image(0, m_grid_x, m_grid_z, glp::Tex::IF_RGBA16F,
+		glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, nullptr);
+	m_velocity_tex2.set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
+
+	m_act_height_tex = &m_height_tex1;
+	m_new_height_tex = &m_height_tex2;
+
+	m_act_velocity_tex = &m_velocity_tex1;
+	m_new_velocity_tex = &m_velocity_tex2;
+
+	return init_render_programs();
+}
+
+bool WaterSurface::init_render_programs()
+{
+	// render shaders
+	{
+		glp::VertProgram vprog;
+		vprog.init();
+		glpx::program_set_source_file(vprog, "glsl/water_vprog.txt");
+		if (!vprog.compile())
+		{
+			glpx::ProgramLog pl;
+			MessageBoxA(NULL, glpx::get_log(vprog, pl),
+				"VERTEX PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+			vprog.release();
+			return false;
+		}
+
+		glp::FragProgram fprog;
+		fprog.init();
+		glpx::program_set_source_file(fprog, "glsl/water_fprog.txt");
+		if (!fprog.compile())
+		{
+			glpx::ProgramLog pl;
+			MessageBoxA(nullptr, glpx::get_log(fprog, pl),
+				"FRAGMENT PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+			fprog.release();
+			vprog.release();
+			return false;
+		}
+
+		m_water_render_prog.init();
+		m_water_render_prog.attach(vprog);
+		m_water_render_prog.attach(fprog);
+
+		m_water_render_prog.bind_attrib_loc("point", Renderable::ATTR_LOC_POINT);
+		m_water_render_prog.bind_attrib_loc("coord", Renderable::ATTR_LOC_COORD);
+		m_water_render_prog.bind_attrib_loc("normal", Renderable::ATTR_LOC_NORMAL);
+
+		if (!m_water_render_prog.link())
+		{
+			glpx::ProgramLog pl;
+			MessageBoxA(nullptr, glpx::get_log(m_water_render_prog, pl),
+				"PROGRAM LINK ERROR", MB_OK | MB_ICONSTOP);
+			m_water_render_prog.release();
+			fprog.release();
+			vprog.release();
+			return false;
+		}
+
+		m_water_render_prog.uniform("texDiff", 0);
+		m_water_render_prog.uniform_vec2("size", math::Vec2f(m_grid_x, m_grid_z).m);
+		m_water_render_prog.uniform("h_x", m_dim_x / m_grid_x);
+		m_water_render_prog.uniform("h_z", m_dim_z / m_grid_z);
+
+		// calculate uniform for Fresnel equation approximation
+		float eta = m_air_refract_index / m_water_refract_index; // n1/n2 <- refract index of air/water
+		float f = ((1 - eta) * (1 - eta)) / ((1 + eta) * (1 + eta)); // equation given in OpenGL shading language, site 359
+		m_water_render_prog.uniform("f", f);
+		m_water_render_prog.uniform("eta", eta);
+
+		m_water_render_prog.uniform("water_y_pos", m_pos_y);
+
+		m_water_render_prog.uniform("wave_height", 4);
+		m_water_render_prog.uniform("cube_map", 5);
+		m_water_render_prog.uniform("pool_tex", 6);
+		uniform_bind_blocks(m_water_render_prog);
+	}
+
+	// caustics shaders
+	{
+		glp::VertProgram vprog;
+		vprog.init();
+		glpx::program_set_source_file(vprog, "glsl/caustics_vprog.txt");
+		if (!vprog.compile())
+		{
+			glpx::ProgramLog pl;
+			MessageBoxA(NULL, glpx::get_log(vprog, pl),
+				"VERTEX PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+			vprog.release();
+			return false;
+		}
+
+		glp::FragProgram fprog;
+		fprog.init();
+		glpx::program_set_source_file(fprog, "glsl/caustics_fprog.txt");
+		if (!fprog.compile())
+		{
+			glpx::ProgramLog pl;
+			MessageBoxA(nullptr, glpx::get_log(fprog, pl),
+				"FRAGMENT PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+			fprog.release();
+			vprog.release();
+			return false;
+		}
+
+		m_caustics_prog.init();
+		m_caustics_prog.attach(vprog);
+		m_caustics_prog.attach(fprog);
+
+		m_caustics_prog.bind_attrib_loc("point", Renderable::ATTR_LOC_POINT);
+		m_caustics_prog.bind_attrib_loc("coord", Renderable::ATTR_LOC_COORD);
+		m_caustics_prog.bind_attrib_loc("normal", Renderable::ATTR_LOC_NORMAL);
+
+		if (!m_caustics_prog.link())
+		{
+			glpx::ProgramLog pl;
+			MessageBoxA(nullptr, glpx::get_log(m_water_render_prog, pl),
+				"PROGRAM LINK ERROR", MB_OK | MB_ICONSTOP);
+			m_water_render_prog.release();
+			fprog.release();
+			vprog.release();
+			return false;
+		}
+
+		m_caustics_prog.uniform_vec2("size", math::Vec2f(m_grid_x, m_grid_z).m);
+		m_caustics_prog.uniform_vec2("dim", math::Vec2f(m_dim_x, m_dim_z).m);
+		m_caustics_prog.uniform("h_x", m_dim_x / m_grid_x);
+		m_caustics_prog.uniform("h_z", m_dim_z / m_grid_z);
+		m_caustics_prog.uniform("wave_height", 4);
+		m_caustics_prog.uniform("tex_light", 5);
+		uniform_bind_blocks(m_caustics_prog);
+	}
+
+	// GPGPU shaders
+	{
+		glp::VertProgram vprog;
+		vprog.init();
+		glpx::program_set_source_file(vprog, "glsl/calc_wave_vprog.txt");
+		if (!vprog.compile()) {
+			glpx::ProgramLog pl;
+			MessageBoxA(NULL, glpx::get_log(vprog, pl),
+				"VERTEX PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+			vprog.release();
+			return false;
+		}
+
+		glp::FragProgram fprog;
+		fprog.init();
+		glpx::program_set_source_file(fprog, "glsl/calc_wave_fprog.txt");
+		if (!fprog.compile()) {
+			glpx::ProgramLog pl;
+			MessageBoxA(nullptr, glpx::get_log(fprog, pl),
+				"FRAGMENT PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+			fprog.release();
+			vprog.release();
+			return false;
+		}
+
+		m_update_height_prog.init();
+		m_update_height_prog.attach(vprog);
+		m_update_height_prog.attach(fprog);
+
+		m_update_height_prog.bind_attrib_loc("point", 0);
+
+		m_update_height_prog.bind_frag_data_loc("height", 0);
+		m_update_height_prog.bind_frag_data_loc("velocity", 1);
+
+		if (!m_update_height_prog.link())
+		{
+			glpx::ProgramLog pl;
+			MessageBoxA(nullptr, glpx::get_log(m_update_height_prog, pl),
+				"PROGRAM LINK ERROR", MB_OK | MB_ICONSTOP);
+			m_update_height_prog.release();
+			fprog.release();
+			vprog.release();
+			return false;
+		}
+
+		m_update_height_prog.uniform("heightOld", 0);
+		m_update_height_prog.uniform("velocityOld", 1);
+		m_update_height_prog.uniform_vec2("size", math::Vec2f(m_grid_x, m_grid_z).m);
+		m_update_height_prog.uniform("h_x", m_dim_x / m_grid_x);
+		m_update_height_prog.uniform("h_z", m_dim_z / m_grid_z);
+		m_update_height_prog.uniform("wave_speed", m_wave_speed);
+		m_update_height_prog.uniform("dt", m_dt);
+		m_update_height_prog.uniform("damp_factor", m_damp_factor);
+
+		math::Vec2f quad[4] =
+		{
+			math::Vec2f(-1.0f, -1.0f),
+			math::Vec2f( 1.0f, -1.0f),
+			math::Vec2f(-1.0f,  1.0f),
+			math::Vec2f( 1.0f,  1.0f)
+		};
+		m_quad.init();
+		m_quad.buffer_data(4*sizeof(math::Vec2f), glp::Buffer::UM_STATIC_DRAW, quad);
+
+		m_varray.init();
+		glp::Device::bind_vertex_array(m_varray);
+		glp::Device::bind_buffer(m_quad);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_TRUE, sizeof(math::Vec2f), nullptr);
+		glp::Device::unbind_vertex_array(m_varray);
+		glp::Device::unbind_buffer(m_quad);
+	}
+
+	// impulse splat shaders
+	{
+		glp::VertProgram vprog;
+		vprog.init();
+		glpx::program_set_source_file(vprog, "glsl/splat_vprog.txt");
+		if (!vprog.compile()) {
+			glpx::ProgramLog pl;
+			MessageBoxA(NULL, glpx::get_log(vprog, pl),
+				"VERTEX PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+			vprog.release();
+			return false;
+		}
+
+		glp::FragProgram fprog;
+		fprog.init();
+		glpx::program_set_source_file(fprog, "glsl/splat_fprog.txt");
+		if (!fprog.compile()) {
+			glpx::ProgramLog pl;
+			MessageBoxA(nullptr, glpx::get_log(fprog, pl),
+				"FRAGMENT PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+			fprog.release();
+			vprog.release();
+			return false;
+		}
+
+		m_splat_prog.init();
+		m_splat_prog.attach(vprog);
+		m_splat_prog.attach(fprog);
+
+		m_splat_prog.bind_attrib_loc("point", 0);
+		m_splat_prog.bind_attrib_loc("impulse", 1);
+
+		m_splat_prog.bind_frag_data_loc("height", 0);
+
+		if (!m_splat_prog.link())
+		{
+			glpx::ProgramLog pl;
+			MessageBoxA(nullptr, glpx::get_log(m_splat_prog, pl),
+				"PROGRAM LINK ERROR", MB_OK | MB_ICONSTOP);
+			m_splat_prog.release();
+			fprog.release();
+			vprog.release();
+			return false;
+		}
+
+		m_splat_prog.uniform_vec2("size", math::Vec2f(m_grid_x, m_grid_z).m);
+
+		// one instance of the quad per impulse
+		m_impulse_buff.init();
+		m_impulse_buff.buffer_data(4*sizeof(float), glp::Buffer::UM_STREAM_DRAW, nullptr);
+
+		m_splat_varray.init();
+		glp::Device::bind_vertex_array(m_splat_varray);
+		glp::Device::bind_buffer(m_quad);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_TRUE, sizeof(math::Vec2f), nullptr);
+		glp::Device::bind_buffer(m_impulse_buff);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 4*sizeof(float), nullptr);
+		glVertexAttribDivisor(1, 1);
+		glp::Device::unbind_vertex_array(m_splat_varray);
+		glp::Device::unbind_buffer(m_impulse_buff);
+	}
+
+	// playback blend shaders (same full screen quad as the solver)
+	{
+		glp::VertProgram vprog;
+		vprog.init();
+		glpx::program_set_source_file(vprog, "glsl/calc_wave_vprog.txt");
+		if (!vprog.compile()) {
+			glpx::ProgramLog pl;
+			MessageBoxA(NULL, glpx::get_log(vprog, pl),
+				"VERTEX PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+			vprog.release();
+			return false;
+		}
+
+		glp::FragProgram fprog;
+		fprog.init();
+		glpx::program_set_source_file(fprog, "glsl/playback_fprog.txt");
+		if (!fprog.compile()) {
+			glpx::ProgramLog pl;
+			MessageBoxA(nullptr, glpx::get_log(fprog, pl),
+				"FRAGMENT PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+			fprog.release();
+			vprog.release();
+			return false;
+		}
+
+		m_playback_prog.init();
+		m_playback_prog.attach(vprog);
+		m_playback_prog.attach(fprog);
+
+		m_playback_prog.bind_attrib_loc("point", 0);
+
+		m_playback_prog.bind_frag_data_loc("height", 0);
+
+		if (!m_playback_prog.link())
+		{
+			glpx::ProgramLog pl;
+			MessageBoxA(nullptr, glpx::get_log(m_playback_prog, pl),
+				"PROGRAM LINK ERROR", MB_OK | MB_ICONSTOP);
+			m_playback_prog.release();
+			fprog.release();
+			vprog.release();
+			return false;
+		}
+
+		m_playback_prog.uniform("frame0", 0);
+		m_playback_prog.uniform("frame1", 1);
+		m_playback_prog.uniform_vec2("size", math::Vec2f(m_grid_x, m_grid_z).m);
+		m_play_alpha_loc = uniform_location(m_playback_prog, "alpha");
+	}
+	return true;
+}
+
+void WaterSurface::render(
+	UniformStream& uniforms,
+	const math::Mat4x4f& inv_view,
+	const glp::TexCube &cube_map)
+{
+	
+
+	// water render
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glp::Device::bind_program(m_water_render_prog);
+
+	glp::Device::bind_tex(*m_act_height_tex, 4);
+	glp::Device::bind_tex(cube_map, 5);
+	glp::Device::bind_tex(m_pool_tex, 6);
+
+	uniforms.set_draw(m_model_mat, inv_view*m_model_mat);
+	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	m_plane->render(true);
+	//glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glp::Device::unbind_tex(cube_map, 5);
+	glp::Device::unbind_tex(m_pool_tex, 6);
+	glp::Device::unbind_tex(*m_act_height_tex, 4);
+	glp::Device::unbind_program(m_water_render_prog);
+
+	// caustics render
+	
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glp::Device::bind_program(m_caustics_prog);
+
+	glp::Device::bind_tex(*m_act_height_tex, 4);
+	glp::Device::bind_tex(m_sunlight_tex, 5);
+
+	uniforms.set_draw(m_caustics_model_mat, inv_view*m_caustics_model_mat);
+
+	m_plane->render(true);
+
+	glp::Device::unbind_tex(m_sunlight_tex, 5);
+	glp::Device::unbind_tex(*m_act_height_tex, 4);
+	glp::Device::unbind_program(m_caustics_prog);
+	glDisable(GL_BLEND);
+	
+}
+
+void WaterSurface::update_model(uint64 usec_time, bool force_one_step)
+{
+	// all passes below render texel for texel into the grid textures
+	int oldViewport[4];
+	glGetIntegerv(GL_VIEWPORT, oldViewport);
+	glViewport(0, 0, m_grid_x, m_grid_z);
+
+	// the solver is bypassed while a recording plays
+	if (m_playing)
+	{
+		update_playback(usec_time);
+		glViewport(oldViewport[0], oldViewport[1], oldViewport[2], oldViewport[3]);
+		return;
+	}
+
+	int steps = force_one_step ?
+		m_governor.begin_forced_step() : m_governor.begin_frame(usec_time);
+	// touches since the last step enter before the next one
+	if (steps > 0 && !m_impulses.empty())
+		splat_impulses();
+	for (int s = 0; s < steps; s++) {
+		// render heights (and normals in the future) to texture
+		glp::Device::bind_program(m_update_height_prog);
+
+		m_frame_buff.attach_tex_2d(*m_new_height_tex, 0);
+		m_frame_buff.attach_tex_2d(*m_new_velocity_tex, 1);
+	
+		glp::Device::bind_fbuff(m_frame_buff);
+
+		GLenum bufs[2] = {
+			GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+		glDrawBuffers(2, bufs);
+
+		glClear(GL_COLOR_BUFFER_BIT);
+	
+		glp::Device::bind_tex(*m_act_height_tex, 0);
+		glp::Device::bind_tex(*m_act_velocity_tex, 1);
+		
+		glp::Device::bind_vertex_array(m_varray);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		render_stats_draw();
+		glp::Device::unbind_vertex_array(m_varray);
+
+		glp::Device::unbind_tex(*m_act_velocity_tex, 1);
+		glp::Device::unbind_tex(*m_act_height_tex, 0);
+
+		glp::Device::unbind_fbuff(m_frame_buff);
+
+		m_frame_buff.detach_tex_2d(1);
+		m_frame_buff.detach_tex_2d(0);
+
+		m_new_height_tex->gen_mipmaps();
+		m_new_velocity_tex->gen_mipmaps();
+
+		// swap textures
+		glp::Tex2D* tmp = m_act_height_tex;
+		m_act_height_tex = m_new_height_tex;
+		m_new_height_tex = tmp;
+
+		tmp = m_act_velocity_tex;
+		m_act_velocity_tex = m_new_velocity_tex;
+		m_new_velocity_tex = tmp;
+	}
+	m_governor.end_frame(steps);
+
+	glViewport(oldViewport[0], oldViewport[1], oldViewport[2], oldViewport[3]);
+}
+
+void WaterSurface::touch(int x, int y, double strength, double distance)
+{
+	// the solver does not run while a recording plays
+	if (distance <= 0.0 || m_playing)
+		return;
+	WaterImpulse impulse = { x, y, strength, distance };
+	m_impulses.push_back(impulse);
+}
+
+void WaterSurface::splat_impulses()
+{
+	// upload all impulses at once (the buffer is orphaned every time)
+	m_impulse_data.resize(4*m_impulses.size());
+	for (size_t a = 0; a < m_impulses.size(); ++a)
+	{
+		m_impulse_data[4*a + 0] = float(m_impulses[a].x);
+		m_impulse_data[4*a + 1] = float(m_impulses[a].y);
+		m_impulse_data[4*a + 2] = float(m_impulses[a].strength);
+		m_impulse_data[4*a + 3] = float(m_impulses[a].distance);
+	}
+	m_impulse_buff.buffer_data(m_impulse_data.size()*sizeof(float),
+		glp::Buffer::UM_STREAM_DRAW, &m_impulse_data.front());
+
+	// heights are changed in place, velocities are left alone
+	glp::Device::bind_program(m_splat_prog);
+	m_frame_buff.attach_tex_2d(*m_act_height_tex, 0);
+	glp::Device::bind_fbuff(m_frame_buff);
+
+	GLenum bufs[1] = { GL_COLOR_ATTACHMENT0 };
+	glDrawBuffers(1, bufs);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+
+	glp::Device::bind_vertex_array(m_splat_varray);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(m_impulses.size()));
+	render_stats_draw(m_impulses.size());
+	glp::Device::unbind_vertex_array(m_splat_varray);
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDisable(GL_BLEND);
+
+	glp::Device::unbind_fbuff(m_frame_buff);
+	m_frame_buff.detach_tex_2d(0);
+	glp::Device::unbind_program(m_splat_prog);
+
+	m_impulses.clear();
+}
+
+bool WaterSurface::start_playback(const char* path)
+{
+	stop_playback();
+	if (!m_playback.open(path))
+		return false;
+	if (m_playback.get_grid_x() != m_grid_x || m_playback.get_grid_z() != m_grid_z ||
+		m_playback.get_frame_count() == 0)
+	{
+		fprintf(stderr, "Recording %s does not fit the %dx%d water surface.\n", path, m_grid_x, m_grid_z);
+		m_playback.close();
+		return false;
+	}
+
+	// upload buffers stay mapped, fences tell when the GPU is done with one;
+	// without buffer storage they are mapped (invalidated) for every upload
+	GLsizeiptr bytes = GLsizeiptr(m_grid_x)*m_grid_z*sizeof(float);
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	m_play_persistent = gl_has_buffer_storage();
+	glGenBuffers(PLAYBACK_RING, m_play_pbo);
+	for (int a = 0; a < PLAYBACK_RING; a++)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_play_pbo[a]);
+		if (m_play_persistent)
+		{
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, flags);
+			m_play_ptr[a] = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags);
+		}
+		else
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+		m_play_fence[a] = nullptr;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	for (int a = 0; a < PLAYBACK_RING && m_play_persistent; a++)
+		if (m_play_ptr[a] == nullptr)
+		{
+			fprintf(stderr, "Mapping of playback buffers failed.\n");
+			stop_playback();
+			return false;
+		}
+
+	for (int a = 0; a < 2; a++)
+	{
+		m_play_tex[a].init();
+		m_play_tex[a].set_image(0, m_grid_x, m_grid_z, glp::Tex::IF_RGBA16F,
+			glp::Tex::PF_RGBA, glp::Tex::PT_UNSIGNED_BYTE, nullptr);
+		m_play_tex[a].set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
+		m_play_loaded[a] = UINT64_MAX;
+	}
+	m_play_first = 0;
+	m_play_slot = 0;
+	m_play_frame.resize(size_t(m_grid_x)*m_grid_z);
+	m_play_clock_started = false;
+	m_play_usec = 0;
+	m_impulses.clear();
+	m_playing = true;
+	return true;
+}
+
+void WaterSurface::stop_playback()
+{
+	for (int a = 0; a < PLAYBACK_RING; a++)
+	{
+		if (m_play_fence[a] != nullptr)
+			glDeleteSync(m_play_fence[a]);
+		m_play_fence[a] = nullptr;
+		if (m_play_ptr[a] != nullptr)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_play_pbo[a]);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			m_play_ptr[a] = nullptr;
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (m_play_pbo[0] != 0)
+		glDeleteBuffers(PLAYBACK_RING, m_play_pbo);
+	for (int a = 0; a < PLAYBACK_RING; a++)
+		m_play_pbo[a] = 0;
+	if (m_playing)
+	{
+		m_play_tex[0].release();
+		m_play_tex[1].release();
+		// the solver continues from the blended heights, without
+		// catching up the time spent playing
+		m_governor.reset(m_play_last_usec);
+	}
+	m_playback.close();
+	m_playing = false;
+	m_impulses.clear();
+}
+
+bool WaterSurface::is_playing() const
+{
+	return m_playing;
+}
+
+void WaterSurface::update_playback(uint64 usec_time)
+{
+	if (m_play_clock_started)
+		m_play_usec += usec_time - m_play_last_usec;
+	m_play_last_usec = usec_time;
+	m_play_clock_started = true;
+
+	// recorded frames are interval simulation steps apart
+	uint64_t frames = m_playback.get_frame_count();
+	uint64_t frame_usec = std::max<uint64_t>(1, m_playback.get_step_time()*m_playback.get_interval());
+	uint64_t usec = m_play_usec % (frames*frame_usec);
+	uint64_t frame_a = usec/frame_usec;
+	uint64_t frame_b = std::min(frame_a + 1, frames - 1);
+	float alpha = float(usec % frame_usec)/float(frame_usec);
+
+	// moving on by one frame reuses the texture of the later one,
+	// so in steady playback every recorded frame is uploaded once
+	int first = m_play_first;
+	if (m_play_loaded[first] != frame_a)
+	{
+		if (m_play_loaded[1 - first] == frame_a)
+			first = 1 - first;
+		else if (!upload_playback_frame(first, frame_a))
+			return;
+	}
+	if (m_play_loaded[1 - first] != frame_b && !upload_playback_frame(1 - first, frame_b))
+		return;
+	m_play_first = first;
+
+	glp::Device::bind_program(m_playback_prog);
+	glUniform1f(m_play_alpha_loc, alpha);
+	m_frame_buff.attach_tex_2d(*m_act_height_tex, 0);
+	glp::Device::bind_fbuff(m_frame_buff);
+
+	GLenum bufs[1] = { GL_COLOR_ATTACHMENT0 };
+	glDrawBuffers(1, bufs);
+
+	glp::Device::bind_tex(m_play_tex[first], 0);
+	glp::Device::bind_tex(m_play_tex[1 - first], 1);
+
+	glp::Device::bind_vertex_array(m_varray);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	render_stats_draw();
+	glp::Device::unbind_vertex_array(m_varray);
+
+	glp::Device::unbind_tex(m_play_tex[1 - first], 1);
+	glp::Device::unbind_tex(m_play_tex[first], 0);
+
+	glp::Device::unbind_fbuff(m_frame_buff);
+	m_frame_buff.detach_tex_2d(0);
+	glp::Device::unbind_program(m_playback_prog);
+
+	m_act_height_tex->gen_mipmaps();
+}
+
+bool WaterSurface::upload_playback_frame(int tex, uint64_t frame)
+{
+	int slot = m_play_slot;
+	m_play_slot = (m_play_slot + 1) % PLAYBACK_RING;
+	if (m_play_fence[slot] != nullptr)
+	{
+		// the upload PLAYBACK_RING frames ago has to be finished
+		glClientWaitSync(m_play_fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+		glDeleteSync(m_play_fence[slot]);
+		m_play_fence[slot] = nullptr;
+	}
+	if (!m_playback.read_frame(frame, &m_play_frame.front()))
+	{
+		stop_playback();
+		return false;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_play_pbo[slot]);
+	float* dst = static_cast<float*>(m_play_ptr[slot]);
+	if (!m_play_persistent)
+		dst = static_cast<float*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+			GLsizeiptr(m_grid_x)*m_grid_z*sizeof(float), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+	if (dst == nullptr)
+	{
+		fprintf(stderr, "Mapping of playback buffer failed.\n");
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		stop_playback();
+		return false;
+	}
+	// recorded rows run along z, texture rows along x
+	for (int j = 0; j < m_grid_z; j++)
+		for (int i = 0; i < m_grid_x; i++)
+			*dst++ = m_play_frame[size_t(i)*m_grid_z + j];
+	if (!m_play_persistent)
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	glp::Device::bind_tex(m_play_tex[tex], 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_grid_x, m_grid_z, GL_RED, GL_FLOAT, nullptr);
+	glp::Device::unbind_tex(m_play_tex[tex], 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (m_play_persistent)
+		m_play_fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_play_loaded[tex] = frame;
+	return true;
+}
+
+bool WaterSurface::save_checkpoint(const char* path)
+{
+	WaterCheckpointHeader header;
+	size_t field_bytes = size_t(m_grid_x)*m_grid_z*4*sizeof(float);
+	size_t bytes = water_checkpoint_layout(header, WATER_CHECKPOINT_GPU,
+		uint32_t(sizeof(float)), m_grid_x, m_grid_z, field_bytes);
+	header.dim_x = m_dim_x;
+	header.dim_z = m_dim_z;
+	header.wave_speed = m_wave_speed;
+	header.dt = m_dt;
+	header.damp_factor = m_damp_factor;
+	header.rest_level = 0.0;
+	header.fixed_scale = 1.0;
+	header.usec_step_time = m_governor.get_step_time();
+	header.usec_accumulated = m_governor.get_accumulated_time();
+
+	WaterMappedFile file;
+	if (!file.create(path, bytes))
+		return false;
+	char* base = static_cast<char*>(file.data());
+	memcpy(base, &header, sizeof(header));
+
+	// textures are read straight into the mapping
+	glp::Tex2D* textures[2] = { m_act_height_tex, m_act_velocity_tex };
+	uint64_t offsets[2] = { header.u_offset, header.v_offset };
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	for (int a = 0; a < 2; a++)
+	{
+		m_frame_buff.attach_tex_2d(*textures[a], 0);
+		glp::Device::bind_fbuff(m_frame_buff);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glReadPixels(0, 0, m_grid_x, m_grid_z, GL_RGBA, GL_FLOAT, base + offsets[a]);
+		glp::Device::unbind_fbuff(m_frame_buff);
+		m_frame_buff.detach_tex_2d(0);
+	}
+	file.close();
+	return true;
+}
+
+bool WaterSurface::load_checkpoint(const char* path)
+{
+	WaterMappedFile file;
+	if (!file.open(path))
+		return false;
+	const WaterCheckpointHeader* header = water_checkpoint_header(file, path,
+		WATER_CHECKPOINT_GPU, WATER_CHECKPOINT_GPU);
+	if (header == nullptr)
+		return false;
+	if (header->grid_x != m_grid_x || header->grid_z != m_grid_z ||
+		float(header->dim_x) != m_dim_x || float(header->dim_z) != m_dim_z ||
+		header->field_bytes != size_t(m_grid_x)*m_grid_z*4*sizeof(float))
+	{
+		fprintf(stderr, "Water checkpoint %s was saved by a surface of another size.\n", path);
+		return false;
+	}
+
+	const char* base = static_cast<const char*>(file.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	m_act_height_tex->set_image(0, m_grid_x, m_grid_z, glp::Tex::IF_RGBA16F,
+		glp::Tex::PF_RGBA, glp::Tex::PT_FLOAT, base + header->u_offset);
+	m_act_velocity_tex->set_image(0, m_grid_x, m_grid_z, glp::Tex::IF_RGBA16F,
+		glp::Tex::PF_RGBA, glp::Tex::PT_FLOAT, base + header->v_offset);
+	m_act_height_tex->gen_mipmaps();
+	m_act_velocity_tex->gen_mipmaps();
+
+	m_wave_speed = float(header->wave_speed);
+	m_dt = float(header->dt);
+	m_damp_factor = float(header->damp_factor);
+	m_update_height_prog.uniform("wave_speed", m_wave_speed);
+	m_update_height_prog.uniform("dt", m_dt);
+	m_update_height_prog.uniform("damp_factor", m_damp_factor);
+
+	m_impulses.clear();
+	m_governor.reset(m_governor.get_last_call());
+	m_governor.set_step_time(header->usec_step_time);
+	m_governor.set_accumulated_time(header->usec_accumulated);
+	return true;
+}
+
+SimGovernor& WaterSurface::get_governor()
+{
+	return m_governor;
+}
+
+const SimGovernor& WaterSurface::get_governor() const
+{
+	return m_governor;
+}
+
+float WaterSurface::get_dim_x()
+{
+	return m_dim_x;
+}
+float WaterSurface::get_dim_z()
+{
+	return m_dim_z;
+}
+float WaterSurface::get_pos_y()
+{
+	return m_pos_y;
+}
+int WaterSurface::get_grid_x()
+{
+	return m_grid_x;
+}
+int WaterSurface::get_grid_z()
+{
+	return m_grid_z;
 }
\ No newline at end of file
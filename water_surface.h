@@ -1,79 +1,136 @@
-#ifndef watersurfaceH
-#define watersurfaceH
-
-#include "renderable.h"
-#include "glplus.h"
-
-class WaterSurface
-{
-public:
-	WaterSurface(
-		float dim_x, float dim_z, float pos_y, int grid_x, int grid_z, 
-		float wave_speed, float dt, float damp_factor, uint64 usec_step_time);
-	bool init();
-	void render(
-		const math::Vec3f viewer_pos, const math::Mat4x4f projection, 
-		const math::Mat4x4f& inv_view,
-		const glp::TexCube &cube_map);
-	void update_model(uint64 usec_time, bool force_one_step);
-	void touch(int x, int y, double strength, double distance);
-	~WaterSurface();
-
-	float get_dim_x();
-	float get_dim_z();
-	float get_pos_y();
-	int get_grid_x();
-	int get_grid_z();
-
-private:
-	bool init_render_programs();
-	// set by constructor
-	float m_dim_x;
-	float m_dim_z;
-	float m_pos_y;
-	int m_grid_x;
-	int m_grid_z;
-	float m_wave_speed;
-	float m_dt;
-	float m_damp_factor;
-	uint64 m_step;
-
-	// water and air refract indexes
-	float m_air_refract_index;
-	float m_water_refract_index;
-
-	// initialized in the init() method
-	float m_cell_size_x;
-	float m_cell_size_y;
-	uint64 m_simulation_time;
-	uint64 m_last_call;
-
-	math::Mat4x4f m_model_mat;
-	math::Mat4x4f m_caustics_model_mat;
-	Renderable* m_plane;
-
-	// render program
-	glp::Program m_water_render_prog;
-	glp::Program m_caustics_prog;
-
-	glp::FrameBuffer m_frame_buff;
-	//glp::RenderBuffer m_render_buff;
-	glp::VertexBuffer m_quad;
-	glp::VertexArray m_varray;
-	// GPGPU program
-	glp::Program m_update_height_prog;
-	// textures for GPGPU calculations
-	glp::Tex2D m_height_tex1; // during generation of new heigh map
-	glp::Tex2D m_height_tex2; // old values are needed
-	glp::Tex2D* m_act_height_tex;
-	glp::Tex2D* m_new_height_tex;
-	glp::Tex2D m_velocity_tex1;
-	glp::Tex2D m_velocity_tex2;
-	glp::Tex2D* m_act_velocity_tex;
-	glp::Tex2D* m_new_velocity_tex;
-
-	glp::Tex2D m_sunlight_tex;
-	glp::Tex2D m_pool_tex;
-};
-
+#ifndef watersurfaceH
+#define watersurfaceH
+
+#include "renderable.h"
+#include "sim_governor.h"
+#include "water_impulse.h"
+#include "water_recording.h"
+#include "uniform_stream.h"
+#include "glplus.h"
+
+class WaterSurface
+{
+public:
+	WaterSurface(
+		float dim_x, float dim_z, float pos_y, int grid_x, int grid_z, 
+		float wave_speed, float dt, float damp_factor, uint64 usec_step_time);
+	bool init();
+	// the camera block of uniforms must be set for the frame
+	void render(
+		UniformStream& uniforms,
+		const math::Mat4x4f& inv_view,
+		const glp::TexCube &cube_map);
+	void update_model(uint64 usec_time, bool force_one_step);
+	// queues an impulse, it is splatted into the height texture before
+	// the next simulation step, so input does not add steps; ignored
+	// while a recording plays
+	void touch(int x, int y, double strength, double distance);
+	~WaterSurface();
+
+	// catch-up policy (step/time budget per frame, drop or slow motion)
+	SimGovernor& get_governor();
+	const SimGovernor& get_governor() const;
+
+	// checkpoint of the height and velocity textures (read back as RGBA
+	// floats), the wave parameters and the simulation time not stepped
+	// yet (see water_checkpoint.h); queued touches are not saved. The
+	// grid and dimensions must match, restoring uploads the mapped file
+	// straight into the textures, the governor keeps the clock of the
+	// last update_model() call. Needs the GL context.
+	bool save_checkpoint(const char* path);
+	bool load_checkpoint(const char* path);
+
+	// playback of a WaterRecording of the same grid instead of the
+	// solver: update_model() only advances the playback clock, uploads the
+	// recorded frames around it (through a ring of persistently mapped
+	// pixel buffers with GL 4.4 / ARB_buffer_storage, buffers mapped for
+	// every upload without it) and blends the two
+	// neighbouring frames into the height texture; loops at the end
+	bool start_playback(const char* path);
+	void stop_playback();
+	bool is_playing() const;
+
+	float get_dim_x();
+	float get_dim_z();
+	float get_pos_y();
+	int get_grid_x();
+	int get_grid_z();
+
+private:
+	bool init_render_programs();
+	void splat_impulses();
+	void update_playback(uint64 usec_time);
+	bool upload_playback_frame(int tex, uint64_t frame);
+	// set by constructor
+	float m_dim_x;
+	float m_dim_z;
+	float m_pos_y;
+	int m_grid_x;
+	int m_grid_z;
+	float m_wave_speed;
+	float m_dt;
+	float m_damp_factor;
+
+	// water and air refract indexes
+	float m_air_refract_index;
+	float m_water_refract_index;
+
+	// initialized in the init() method
+	float m_cell_size_x;
+	float m_cell_size_y;
+	SimGovernor m_governor;
+
+	math::Mat4x4f m_model_mat;
+	math::Mat4x4f m_caustics_model_mat;
+	Renderable* m_plane;
+
+	// render program
+	glp::Program m_water_render_prog;
+	glp::Program m_caustics_prog;
+
+	glp::FrameBuffer m_frame_buff;
+	//glp::RenderBuffer m_render_buff;
+	glp::VertexBuffer m_quad;
+	glp::VertexArray m_varray;
+	// GPGPU program
+	glp::Program m_update_height_prog;
+	// textures for GPGPU calculations
+	glp::Tex2D m_height_tex1; // during generation of new heigh map
+	glp::Tex2D m_height_tex2; // old values are needed
+	glp::Tex2D* m_act_height_tex;
+	glp::Tex2D* m_new_height_tex;
+	glp::Tex2D m_velocity_tex1;
+	glp::Tex2D m_velocity_tex2;
+	glp::Tex2D* m_act_velocity_tex;
+	glp::Tex2D* m_new_velocity_tex;
+	// additive pass adding queued touches to the height texture
+	glp::Program m_splat_prog;
+	glp::VertexBuffer m_impulse_buff; // x, y, strength, distance per impulse
+	glp::VertexArray m_splat_varray;
+	std::vector<WaterImpulse> m_impulses;
+	std::vector<float> m_impulse_data;
+
+	// playback (start_playback())
+	static const int PLAYBACK_RING = 3;
+	WaterRecording m_playback;
+	bool m_playing;
+	bool m_play_clock_started;
+	uint64 m_play_last_usec;
+	uint64 m_play_usec;
+	glp::Program m_playback_prog;
+	GLint m_play_alpha_loc;
+	glp::Tex2D m_play_tex[2]; // two recorded frames, blended
+	uint64_t m_play_loaded[2]; // frame in m_play_tex, UINT64_MAX if none
+	int m_play_first;          // m_play_tex holding the earlier frame
+	GLuint m_play_pbo[PLAYBACK_RING];
+	void* m_play_ptr[PLAYBACK_RING]; // nullptr without buffer storage
+	bool m_play_persistent;
+	GLsync m_play_fence[PLAYBACK_RING];
+	int m_play_slot;
+	std::vector<float> m_play_frame;
+
+	glp::Tex2D m_sunlight_tex;
+	glp::Tex2D m_pool_tex;
+};
+
 #endif
\ No newline at end of file
@@ -1,203 +1,412 @@
-#include "water_surface_cpu.h"
-#include <cstdio>
-#include <algorithm>
-#include <cmath>
-#define M_PI 3.14159265358979323846
-
-
-WaterSurfaceCPU::WaterSurfaceCPU(
-		float dim_x, float dim_z, int grid_x, int grid_z, 
-		float wave_speed, float dt, float damp_factor, uint64 usec_step_time) 
-{
-	m_dim_x = dim_x;
-	m_dim_z = dim_z;
-	m_grid_x = grid_x;
-	m_grid_z = grid_z;
-	m_wave_speed = wave_speed;
-	m_dt = dt;
-	m_damp_factor = damp_factor;
-	m_step = usec_step_time;
-
-	m_u = nullptr;
-	m_u_new = nullptr;
-	m_v = nullptr;
-	m_bar = nullptr;
-	m_model_mat = nullptr;
-}
-
-WaterSurfaceCPU::~WaterSurfaceCPU()
-{
-	if (m_u != nullptr) 
-	{
-		for (int i = 0; i < m_grid_x + 2; i++)
-			delete[] m_u[i];
-		delete[] m_u;
-	}
-	if (m_u_new != nullptr) 
-	{
-		for (int i = 0; i < m_grid_x + 2; i++)
-			delete[] m_u_new[i];
-		delete[] m_u_new;
-	}
-	if (m_v != nullptr) 
-	{
-		for (int i = 0; i < m_grid_x + 2; i++)
-			delete[] m_v[i];
-		delete[] m_v;
-	}
-	if (m_model_mat != nullptr) 
-	{
-		for (int i = 0; i < m_grid_x + 2; i++)
-			delete[] m_model_mat[i];
-		delete[] m_model_mat;
-	}
-	if (m_bar != nullptr) 
-		delete m_bar;
-}
-
-bool WaterSurfaceCPU::init() 
-{
-	if (m_dim_x == 0 || m_dim_z == 0 || m_grid_x == 0 || m_grid_z == 0)
-	{
-		fprintf(stderr, "Invalid dimensions of water surface.\n");
-		return false;
-	}
-
-	m_cell_size_x = m_dim_x / m_grid_x;
-	m_cell_size_y = m_dim_z / m_grid_z;
-
-	m_simulation_time = 0;
-	m_last_call = 0;
-
-	m_u = new double*[m_grid_x + 2]; // + boundary
-	m_u_new = new double*[m_grid_x + 2];
-	m_v = new double*[m_grid_x + 2]; 
-	m_model_mat = new math::Mat4x4f*[m_grid_x + 2];
-	
-	for (int i = 0; i < m_grid_x + 2; i++)
-	{
-		m_u[i] = new double[m_grid_z + 2];
-		m_u_new[i] = new double[m_grid_z + 2];
-		m_v[i] = new double[m_grid_z + 2];
-		m_model_mat[i] = new math::Mat4x4f[m_grid_z + 2];
-	}
-
-	for (int i = 0; i < m_grid_x + 2; i++)
-		for (int j = 0; j < m_grid_z + 2; j++) 
-		{
-			// init m_u "with some initeresting func"
-			// i.e. m_u[i][j] = -sin(10.0f*float(i) / m_grid_x + 10.0f*float(j) / m_grid_z)*0.4;
-			// i.e. m_u[i][j] = -sin(10.0f*float(i) / m_grid_x + 0.4f*(10.0f*float(j) / m_grid_z))*0.4;
-			m_u[i][j] = 0.0; // or just wait for interaction
-			m_v[i][j] = 0.0f;
-			m_model_mat[i][j] = math::Mat4x4f(math::Mat4x4f::I);
-		}
-
-	m_bar = new Renderable();
-	if (!m_bar->load_box(m_cell_size_x/2.0f, 1.0f, m_cell_size_y/2.0f))
-	{
-		fprintf(stderr, "Loading planes failed.\n");
-		return false;
-	}
-	if (!m_bar->addTextures("base", L"../data/water_diff.jpg", nullptr, nullptr))
-	{
-		fprintf(stderr, "Loading textures for planes failed.\n");
-		return false;
-	}
-
-	return true;
-}
-
-void WaterSurfaceCPU::render(
-	glp::Program& render_program, 
-	const math::Mat4x4f& inv_view) const
-{
-	for (int i = 1; i < m_grid_x + 1; i++)
-		for (int j = 1; j < m_grid_z + 1; j++) 
-		{
-			// transpose bars to proper positions
-			math::Vec3f tr = math::Vec3f(-0.5f*m_dim_x + (i - 0.5f)*m_cell_size_x, -1.5f + float(m_u[i][j]), -0.5f*m_dim_z + (j - 0.5f)*m_cell_size_y);
-			math::set_translation(m_model_mat[i][j], tr);
-
-			render_program.uniform_mat4x4("model", m_model_mat[i][j].m, true);
-			render_program.uniform_mat4x4("modelView", (inv_view*m_model_mat[i][j]).m, true);
-			m_bar->render(true);
-		}
-}
-
-void WaterSurfaceCPU::update_model(uint64 usec_time, bool force_one_step)
-{
-	if (force_one_step) 
-	{
-		m_simulation_time = m_step + 1;
-	}
-	else 
-	{
-		m_simulation_time += (usec_time - m_last_call);
-		m_last_call = usec_time;
-	}
-	while (m_simulation_time > m_step) {
-		m_simulation_time -= m_step;
-
-		double force;
-		for (int i = 1; i <= m_grid_x; i++)
-			for (int j = 1; j <= m_grid_z; j++) 
-			{
-				force = 
-					pow(m_wave_speed, 2.0) // c^2
-					*(m_u[i-1][j] + m_u[i+1][j] + m_u[i][j-1] + m_u[i][j+1] - 4*m_u[i][j])
-					/(m_cell_size_x*m_cell_size_y); // h^2
-				m_v[i][j] += force * m_dt;
-				m_v[i][j] = m_v[i][j] * m_damp_factor;
-				m_u_new[i][j] = m_u[i][j] + m_v[i][j] * m_dt;
-			}
-		// pointers swap: u <-> u_new
-		double** tmp = m_u;
-		m_u = m_u_new;
-		m_u_new = tmp;
-
-		// clamp on edges
-		for (int i = 0; i < m_grid_x + 2; i++)
-		{
-			m_u[i][0] = m_u[i][1];
-			m_u[i][m_grid_z + 1] = m_u[i][m_grid_z];
-		}
-
-		for (int j = 0; j < m_grid_z + 2; j++) 
-		{
-			m_u[0][j] = m_u[1][j];
-			m_u[m_grid_x + 1][j] = m_u[m_grid_x][j];
-		}
-
-	}
-}
-
-void WaterSurfaceCPU::touch(int x, int y, double strength, double distance)
-{
-	// include boundary (0 and m_grid_x/y + 1)
-	int low_x = std::max(0, x - 10);
-	int high_x = std::min(m_grid_x + 1, x + 10);
-	int low_y = std::max(0, y - 10);
-	int high_y = std::min(m_grid_z + 1, y + 10);
-
-	double change_sum = 0.0;
-	for (int i = low_x; i < high_x; i++)
-		for (int j = low_y; j < high_y; j++)
-		{
-			double x_dist = (i - x)*m_cell_size_x;
-			double y_dist = (j - y)*m_cell_size_y;
-			double dist = sqrt(pow(x_dist, 2.0) + pow(y_dist, 2.0));
-			if (dist <= distance) dist = dist/distance;
-			else dist = 1.0;
-			double change = strength * (cos(dist * M_PI) + 1.0) / 2.0;
-			m_u[i][j] -= change;
-			change_sum += change;
-		}
-
-	change_sum /= (m_grid_x + 2)*(m_grid_z + 2);
-	for (int i = 0; i < m_grid_x + 2; i++)
-		for (int j = 0; j < m_grid_z + 2; j++) 
-		{
-			m_u[i][j] += change_sum;
-		}
-}
\ No newline at end of file
+#include "water_surface_cpu.h"
+#include "render_stats.h"
+#include "uniform_stream.h"
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+#include <windows.h>
+#include "glplusx.h"
+#include "glplusx_prog.h"
+#include "glext.h"
+
+
+WaterSurfaceCPU::WaterSurfaceCPU(
+		float dim_x, float dim_z, int grid_x, int grid_z, 
+		float wave_speed, float dt, float damp_factor, uint64 usec_step_time):
+	m_sim(dim_x, dim_z, grid_x, grid_z, wave_speed, dt, damp_factor, usec_step_time)
+{
+	m_output = WATER_CPU_BARS;
+	m_bar = nullptr;
+
+	m_mesh_vbo = 0;
+	m_mesh_ibo = 0;
+	m_mesh_ptr = nullptr;
+	for (int a = 0; a < MESH_RING; a++)
+		m_mesh_fence[a] = nullptr;
+	m_mesh_slot = 0;
+	m_mesh_index_count = 0;
+}
+
+WaterSurfaceCPU::~WaterSurfaceCPU()
+{
+	if (m_bar != nullptr) 
+		delete m_bar;
+}
+
+bool WaterSurfaceCPU::init() 
+{
+	if (!m_sim.init())
+		return false;
+
+	m_bar = new Renderable();
+	if (!m_bar->load_box(m_sim.get_cell_size_x()/2.0f, 1.0f, m_sim.get_cell_size_z()/2.0f))
+	{
+		fprintf(stderr, "Loading planes failed.\n");
+		return false;
+	}
+	if (!m_bar->addTextures("base", L"../data/water_diff.jpg", nullptr, nullptr))
+	{
+		fprintf(stderr, "Loading textures for planes failed.\n");
+		return false;
+	}
+
+	// one texel per cell, rows as copy_heights() writes them
+	int grid_x = m_sim.get_grid_x();
+	int grid_z = m_sim.get_grid_z();
+	m_heights.resize(size_t(grid_x)*grid_z);
+	// one float channel as uploaded, read with texelFetch: no mipmaps,
+	// the nearest filter keeps the single level complete
+	m_height_tex.init();
+	glp::Device::bind_tex(m_height_tex, 3);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, grid_z, grid_x, 0, GL_RED, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glp::Device::unbind_tex(m_height_tex, 3);
+	m_height_tex.set_wrapST(glp::Tex::WrapMode::WM_CLAMP_TO_EDGE);
+
+	return init_render_program();
+}
+
+bool WaterSurfaceCPU::init_render_program()
+{
+	glp::VertProgram vprog;
+	vprog.init();
+	glpx::program_set_source_file(vprog, "glsl/bars_vprog.txt");
+	if (!vprog.compile()) {
+		glpx::ProgramLog pl;
+		MessageBoxA(NULL, glpx::get_log(vprog, pl),
+			"VERTEX PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+		vprog.release();
+		return false;
+	}
+
+	glp::FragProgram fprog;
+	fprog.init();
+	glpx::program_set_source_file(fprog, "glsl/illum_fprog.txt");
+	if (!fprog.compile()) {
+		glpx::ProgramLog pl;
+		MessageBoxA(nullptr, glpx::get_log(fprog, pl),
+			"FRAGMENT PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+		fprog.release();
+		vprog.release();
+		return false;
+	}
+
+	m_bar_prog.init();
+	m_bar_prog.attach(vprog);
+	m_bar_prog.attach(fprog);
+
+	m_bar_prog.bind_attrib_loc("point", Renderable::ATTR_LOC_POINT);
+	m_bar_prog.bind_attrib_loc("coord", Renderable::ATTR_LOC_COORD);
+	m_bar_prog.bind_attrib_loc("normal", Renderable::ATTR_LOC_NORMAL);
+	m_bar_prog.bind_attrib_loc("tgtU", Renderable::ATTR_LOC_TGT_U);
+	m_bar_prog.bind_attrib_loc("tgtV", Renderable::ATTR_LOC_TGT_V);
+
+	if (!m_bar_prog.link())
+	{
+		glpx::ProgramLog pl;
+		MessageBoxA(nullptr, glpx::get_log(m_bar_prog, pl),
+			"PROGRAM LINK ERROR", MB_OK | MB_ICONSTOP);
+		m_bar_prog.release();
+		fprog.release();
+		vprog.release();
+		return false;
+	}
+
+	// bar textures use units 0..2
+	m_bar_prog.uniform("texDiff", 0);
+	m_bar_prog.uniform("texNormal", 1);
+	m_bar_prog.uniform("texHeight", 2);
+	m_bar_prog.uniform("heights", 3);
+	m_bar_prog.uniform("grid_z", m_sim.get_grid_z());
+	// centre of bar (1, 1) as placed by the per-cell matrices before
+	math::Vec3f origin(
+		-0.5f*m_sim.get_dim_x() + 0.5f*m_sim.get_cell_size_x(), -1.5f,
+		-0.5f*m_sim.get_dim_z() + 0.5f*m_sim.get_cell_size_z());
+	m_bar_prog.uniform_vec3("origin", origin.m);
+	m_bar_prog.uniform_vec2("cellSize", math::Vec2f(m_sim.get_cell_size_x(), m_sim.get_cell_size_z()).m);
+	uniform_bind_blocks(m_bar_prog);
+	return true;
+}
+
+void WaterSurfaceCPU::render(
+	UniformStream& uniforms,
+	const math::Mat4x4f& inv_view,
+	const glp::TexCube &cube_map)
+{
+	if (m_output == WATER_CPU_MESH)
+		render_mesh(uniforms, inv_view, cube_map);
+	else
+		render_bars();
+}
+
+void WaterSurfaceCPU::render_bars()
+{
+	int grid_x = m_sim.get_grid_x();
+	int grid_z = m_sim.get_grid_z();
+	m_sim.copy_heights(&m_heights.front());
+	glp::Device::bind_tex(m_height_tex, 3);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, grid_z, grid_x, GL_RED, GL_FLOAT, &m_heights.front());
+
+	// camera from the shared block
+	glp::Device::bind_program(m_bar_prog);
+
+	m_bar->render_instanced(true, grid_x*grid_z);
+
+	glp::Device::unbind_program(m_bar_prog);
+	glp::Device::unbind_tex(m_height_tex, 3);
+}
+
+void WaterSurfaceCPU::render_mesh(
+	UniformStream& uniforms,
+	const math::Mat4x4f& inv_view,
+	const glp::TexCube &cube_map)
+{
+	int slot = m_mesh_slot;
+	m_mesh_slot = (m_mesh_slot + 1) % MESH_RING;
+	if (m_mesh_fence[slot] != nullptr)
+	{
+		// the draw MESH_RING frames ago has to be finished
+		glClientWaitSync(m_mesh_fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+		glDeleteSync(m_mesh_fence[slot]);
+		m_mesh_fence[slot] = nullptr;
+	}
+	GLint cells = GLint(m_sim.get_grid_x())*m_sim.get_grid_z();
+	if (m_mesh_ptr != nullptr)
+		m_sim.write_mesh(m_mesh_ptr + size_t(slot)*cells, m_mesh_params);
+	else
+	{
+		m_sim.write_mesh(&m_mesh_staging.front(), m_mesh_params);
+		glBindBuffer(GL_ARRAY_BUFFER, m_mesh_vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, GLintptr(slot)*cells*sizeof(WaterMeshVertex),
+			GLsizeiptr(cells)*sizeof(WaterMeshVertex), &m_mesh_staging.front());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glp::Device::bind_program(m_mesh_prog);
+	math::Mat4x4f model(math::Mat4x4f::I);
+	uniforms.set_draw(model, inv_view);
+
+	glp::Device::bind_tex(m_mesh_diff_tex, 0);
+	glp::Device::bind_tex(cube_map, 5);
+	glp::Device::bind_tex(m_pool_tex, 6);
+
+	// the regions differ only in the base vertex
+	glp::Device::bind_vertex_array(m_mesh_varray);
+	glDrawElementsBaseVertex(GL_TRIANGLES, m_mesh_index_count, GL_UNSIGNED_INT, nullptr, slot*cells);
+	render_stats_draw();
+	glp::Device::unbind_vertex_array(m_mesh_varray);
+	if (m_mesh_ptr != nullptr)
+		m_mesh_fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	glp::Device::unbind_tex(m_pool_tex, 6);
+	glp::Device::unbind_tex(cube_map, 5);
+	glp::Device::unbind_tex(m_mesh_diff_tex, 0);
+	glp::Device::unbind_program(m_mesh_prog);
+}
+
+bool WaterSurfaceCPU::set_output(WaterCpuOutput output)
+{
+	if (output == m_output)
+		return true;
+	if (output == WATER_CPU_MESH && !init_mesh())
+	{
+		release_mesh();
+		return false;
+	}
+	if (output == WATER_CPU_BARS)
+		release_mesh();
+	m_output = output;
+	return true;
+}
+
+WaterCpuOutput WaterSurfaceCPU::get_output() const
+{
+	return m_output;
+}
+
+bool WaterSurfaceCPU::init_mesh()
+{
+	glp::VertProgram vprog;
+	vprog.init();
+	glpx::program_set_source_file(vprog, "glsl/water_mesh_vprog.txt");
+	if (!vprog.compile()) {
+		glpx::ProgramLog pl;
+		MessageBoxA(NULL, glpx::get_log(vprog, pl),
+			"VERTEX PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+		vprog.release();
+		return false;
+	}
+
+	glp::FragProgram fprog;
+	fprog.init();
+	glpx::program_set_source_file(fprog, "glsl/water_fprog.txt");
+	if (!fprog.compile()) {
+		glpx::ProgramLog pl;
+		MessageBoxA(nullptr, glpx::get_log(fprog, pl),
+			"FRAGMENT PROGRAM ERROR", MB_OK | MB_ICONSTOP);
+		fprog.release();
+		vprog.release();
+		return false;
+	}
+
+	m_mesh_prog.init();
+	m_mesh_prog.attach(vprog);
+	m_mesh_prog.attach(fprog);
+
+	m_mesh_prog.bind_attrib_loc("point", Renderable::ATTR_LOC_POINT);
+	m_mesh_prog.bind_attrib_loc("coord", Renderable::ATTR_LOC_COORD);
+	m_mesh_prog.bind_attrib_loc("normal", Renderable::ATTR_LOC_NORMAL);
+
+	if (!m_mesh_prog.link())
+	{
+		glpx::ProgramLog pl;
+		MessageBoxA(nullptr, glpx::get_log(m_mesh_prog, pl),
+			"PROGRAM LINK ERROR", MB_OK | MB_ICONSTOP);
+		m_mesh_prog.release();
+		fprog.release();
+		vprog.release();
+		return false;
+	}
+
+	// the top of the bars is the rest level of both outputs
+	m_mesh_params.origin_x = -0.5f*m_sim.get_dim_x() + 0.5f*m_sim.get_cell_size_x();
+	m_mesh_params.origin_z = -0.5f*m_sim.get_dim_z() + 0.5f*m_sim.get_cell_size_z();
+	m_mesh_params.step_x = m_sim.get_cell_size_x();
+	m_mesh_params.step_z = m_sim.get_cell_size_z();
+	m_mesh_params.level = -0.5f;
+	m_mesh_params.grid_x = m_sim.get_grid_x();
+	m_mesh_params.grid_z = m_sim.get_grid_z();
+
+	// same constants as WaterSurface
+	float air_refract_index = 1.000293f;
+	float water_refract_index = 1.22f;
+	float eta = air_refract_index / water_refract_index;
+	float f = ((1 - eta) * (1 - eta)) / ((1 + eta) * (1 + eta));
+	m_mesh_prog.uniform("texDiff", 0);
+	m_mesh_prog.uniform("cube_map", 5);
+	m_mesh_prog.uniform("pool_tex", 6);
+	m_mesh_prog.uniform("f", f);
+	m_mesh_prog.uniform("eta", eta);
+	m_mesh_prog.uniform("water_y_pos", m_mesh_params.level);
+	uniform_bind_blocks(m_mesh_prog);
+
+	m_mesh_diff_tex.init();
+	if (!glpx::LoadTex2D_RGBA(m_mesh_diff_tex, L"data/textures/water_diff.jpg")) {
+		fprintf(stderr, "Loading water texture failed.\n");
+		return false;
+	}
+	m_pool_tex.init();
+	if (!glpx::LoadTex2D_RGBA(m_pool_tex, L"data/textures/tile.gif")) {
+		fprintf(stderr, "Loading pool texture failed.\n");
+		return false;
+	}
+	m_pool_tex.set_wrapST(glp::Tex::WrapMode::WM_REPEAT);
+
+	// static indices, vertices stay mapped while the mesh is shown
+	int grid_x = m_sim.get_grid_x();
+	int grid_z = m_sim.get_grid_z();
+	std::vector<unsigned int> indices(size_t(std::max(grid_x - 1, 0))*std::max(grid_z - 1, 0)*6);
+	if (indices.empty())
+	{
+		fprintf(stderr, "Water mesh needs at least 2x2 cells.\n");
+		return false;
+	}
+	water_mesh_indices(grid_x, grid_z, &indices.front());
+	m_mesh_index_count = GLsizei(indices.size());
+
+	GLsizeiptr bytes = GLsizeiptr(MESH_RING)*grid_x*grid_z*sizeof(WaterMeshVertex);
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	bool persistent = gl_has_buffer_storage();
+	m_mesh_varray.init();
+	glp::Device::bind_vertex_array(m_mesh_varray);
+	glGenBuffers(1, &m_mesh_ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_mesh_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int), &indices.front(), GL_STATIC_DRAW);
+	glGenBuffers(1, &m_mesh_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_mesh_vbo);
+	if (persistent)
+	{
+		glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+		m_mesh_ptr = static_cast<WaterMeshVertex*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags));
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+		m_mesh_staging.resize(size_t(grid_x)*grid_z);
+	}
+
+	glEnableVertexAttribArray(Renderable::ATTR_LOC_POINT);
+	glEnableVertexAttribArray(Renderable::ATTR_LOC_COORD);
+	glEnableVertexAttribArray(Renderable::ATTR_LOC_NORMAL);
+	glVertexAttribPointer(Renderable::ATTR_LOC_POINT, 3, GL_FLOAT, GL_FALSE, sizeof(WaterMeshVertex), (void*)offsetof(WaterMeshVertex, point));
+	glVertexAttribPointer(Renderable::ATTR_LOC_COORD, 2, GL_FLOAT, GL_FALSE, sizeof(WaterMeshVertex), (void*)offsetof(WaterMeshVertex, coord));
+	glVertexAttribPointer(Renderable::ATTR_LOC_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(WaterMeshVertex), (void*)offsetof(WaterMeshVertex, normal));
+
+	glp::Device::unbind_vertex_array(m_mesh_varray);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	if (persistent && m_mesh_ptr == nullptr)
+	{
+		fprintf(stderr, "Mapping of water mesh buffer failed.\n");
+		return false;
+	}
+	m_mesh_slot = 0;
+	return true;
+}
+
+void WaterSurfaceCPU::release_mesh()
+{
+	for (int a = 0; a < MESH_RING; a++)
+	{
+		if (m_mesh_fence[a] != nullptr)
+			glDeleteSync(m_mesh_fence[a]);
+		m_mesh_fence[a] = nullptr;
+	}
+	if (m_mesh_ptr != nullptr)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_mesh_vbo);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		m_mesh_ptr = nullptr;
+	}
+	std::vector<WaterMeshVertex>().swap(m_mesh_staging);
+	if (m_mesh_vbo != 0)
+		glDeleteBuffers(1, &m_mesh_vbo);
+	if (m_mesh_ibo != 0)
+		glDeleteBuffers(1, &m_mesh_ibo);
+	m_mesh_vbo = 0;
+	m_mesh_ibo = 0;
+	m_mesh_varray.release();
+	m_mesh_prog.release();
+	m_mesh_diff_tex.release();
+	m_pool_tex.release();
+	m_mesh_index_count = 0;
+}
+
+void WaterSurfaceCPU::update_model(uint64 usec_time, bool force_one_step)
+{
+	m_sim.update_model(usec_time, force_one_step);
+}
+
+void WaterSurfaceCPU::touch(int x, int y, double strength, double distance)
+{
+	m_sim.touch(x, y, strength, distance);
+}
+
+void WaterSurfaceCPU::queue_touch(int x, int y, double strength, double distance)
+{
+	m_sim.queue_touch(x, y, strength, distance);
+}
+
+WaterSim& WaterSurfaceCPU::get_sim()
+{
+	return m_sim;
+}
+
+const WaterSim& WaterSurfaceCPU::get_sim() const
+{
+	return m_sim;
+}
@@ -1,45 +1,84 @@
-#ifndef watersurfacecpuH
-#define watersurfacecpuH
-
-#include "renderable.h"
-#include "glplus.h"
-
-class WaterSurfaceCPU
-{
-public:
-	WaterSurfaceCPU(
-		float dim_x, float dim_z, int grid_x, int grid_z, 
-		float wave_speed, float dt, float damp_factor, uint64 usec_step_time);
-	bool init();
-	void render(
-		glp::Program& render_program, 
-		const math::Mat4x4f& inv_view) const;
-	void update_model(uint64 usec_time, bool force_one_step);
-	void touch(int x, int y, double strength, double distance);
-	~WaterSurfaceCPU();
-
-private:
-	// set by constructor
-	float m_dim_x;
-	float m_dim_z;
-	int m_grid_x;
-	int m_grid_z;
-	double m_wave_speed;
-	double m_dt;
-	double m_damp_factor;
-	uint64 m_step;
-
-	// initialized in the init() method
-	float m_cell_size_x;
-	float m_cell_size_y;
-	double** m_u;
-	double** m_u_new;
-	double** m_v;
-	uint64 m_simulation_time;
-	uint64 m_last_call;
-
-	Renderable* m_bar;
-	math::Mat4x4f** m_model_mat;
-};
-
-#endif
\ No newline at end of file
+#ifndef watersurfacecpuH
+#define watersurfacecpuH
+
+#include "renderable.h"
+#include "water_sim.h"
+#include "uniform_stream.h"
+#include "glplus.h"
+#include <vector>
+
+enum WaterCpuOutput
+{
+	WATER_CPU_BARS = 0, // one textured bar per cell
+	WATER_CPU_MESH      // displaced surface shaded as WaterSurface
+};
+
+// Renders a WaterSim either as one textured bar per cell, all bars in one
+// instanced draw with the heights uploaded to a texture every render(),
+// or as a displaced vertex grid with normals written by the solver
+// threads straight into a persistently mapped vertex buffer (through a
+// CPU copy and glBufferSubData without buffer storage).
+class WaterSurfaceCPU
+{
+public:
+	WaterSurfaceCPU(
+		float dim_x, float dim_z, int grid_x, int grid_z, 
+		float wave_speed, float dt, float damp_factor, uint64 usec_step_time);
+	bool init();
+	// the camera block of uniforms must be set for the frame
+	void render(
+		UniformStream& uniforms,
+		const math::Mat4x4f& inv_view,
+		const glp::TexCube &cube_map);
+	void update_model(uint64 usec_time, bool force_one_step);
+	void touch(int x, int y, double strength, double distance);
+	void queue_touch(int x, int y, double strength, double distance);
+	~WaterSurfaceCPU();
+
+	// the mesh is written to a ring of MESH_RING regions of one vertex
+	// buffer (GL 4.4 / ARB_buffer_storage), a fence per region keeps the
+	// CPU from overwriting vertices the GPU still draws; one draw call.
+	// Without buffer storage the vertices are written to m_mesh_staging
+	// and copied into the region with glBufferSubData.
+	bool set_output(WaterCpuOutput output);
+	WaterCpuOutput get_output() const;
+
+	// solver state and settings (threads, ISA, modes, governor)
+	WaterSim& get_sim();
+	const WaterSim& get_sim() const;
+
+private:
+	bool init_render_program();
+	bool init_mesh();
+	void release_mesh();
+	void render_bars();
+	void render_mesh(
+		UniformStream& uniforms,
+		const math::Mat4x4f& inv_view,
+		const glp::TexCube &cube_map);
+
+	WaterSim m_sim;
+	WaterCpuOutput m_output;
+
+	Renderable* m_bar;
+	glp::Program m_bar_prog;
+	glp::Tex2D m_height_tex; // grid_z x grid_x R32F, heights of row i in row i
+	std::vector<float> m_heights;
+
+	// mesh output
+	static const int MESH_RING = 3;
+	glp::Program m_mesh_prog;
+	glp::Tex2D m_mesh_diff_tex;
+	glp::Tex2D m_pool_tex;
+	glp::VertexArray m_mesh_varray;
+	GLuint m_mesh_vbo;
+	GLuint m_mesh_ibo;
+	WaterMeshVertex* m_mesh_ptr; // MESH_RING*grid_x*grid_z vertices
+	std::vector<WaterMeshVertex> m_mesh_staging; // one region, if not mapped
+	GLsync m_mesh_fence[MESH_RING];
+	int m_mesh_slot;
+	GLsizei m_mesh_index_count;
+	WaterMeshParams m_mesh_params;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "water_temporal_tiling.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+
+WaterTemporalTiling::WaterTemporalTiling()
+{
+	m_rows = 0;
+	m_cols = 0;
+	m_max_steps = 0;
+	m_tile_rows = 0;
+	m_tile_cols = 0;
+	m_tiles_x = 0;
+	m_tiles_z = 0;
+}
+
+WaterTemporalTiling::~WaterTemporalTiling()
+{
+	release();
+}
+
+bool WaterTemporalTiling::init(int rows, int cols, int max_steps, int tile_rows, int tile_cols, int workers)
+{
+	release();
+	if (rows <= 0 || cols <= 0 || max_steps <= 0 || tile_rows <= 0 || tile_cols <= 0 || workers <= 0)
+	{
+		fprintf(stderr, "Invalid parameters of temporal tiling.\n");
+		return false;
+	}
+
+	m_rows = rows;
+	m_cols = cols;
+	m_max_steps = max_steps;
+	m_tile_rows = std::min(tile_rows, rows);
+	m_tile_cols = std::min(tile_cols, cols);
+	m_tiles_x = (rows + m_tile_rows - 1)/m_tile_rows;
+	m_tiles_z = (cols + m_tile_cols - 1)/m_tile_cols;
+
+	// tile + max_steps cells on every side
+	for (int w = 0; w < workers; w++)
+	{
+		Scratch* s = new Scratch();
+		m_scratch.push_back(s);
+		int scratch_rows = m_tile_rows + 2*max_steps;
+		int scratch_cols = m_tile_cols + 2*max_steps;
+		if (!s->u[0].init(scratch_rows, scratch_cols) ||
+			!s->u[1].init(scratch_rows, scratch_cols) ||
+			!s->v.init(scratch_rows, scratch_cols))
+		{
+			release();
+			return false;
+		}
+	}
+	return true;
+}
+
+void WaterTemporalTiling::release()
+{
+	for (size_t a = 0; a < m_scratch.size(); ++a)
+		delete m_scratch[a];
+	m_scratch.clear();
+	m_tiles_x = 0;
+	m_tiles_z = 0;
+}
+
+void WaterTemporalTiling::run_tile(int worker, int tile, int steps,
+	const WaterField& u, const WaterField& v,
+	WaterField& u_out, WaterField& v_out,
+	WaveRowKernel kernel, const WaveCoeffs& k)
+{
+	Scratch& s = *m_scratch[worker];
+
+	// tile core in grid coordinates (1..rows, 1..cols are simulated cells)
+	int ti0 = 1 + (tile/m_tiles_z)*m_tile_rows;
+	int ti1 = std::min(m_rows + 1, ti0 + m_tile_rows);
+	int tj0 = 1 + (tile%m_tiles_z)*m_tile_cols;
+	int tj1 = std::min(m_cols + 1, tj0 + m_tile_cols);
+
+	// area read at time 0, the grid halo included
+	int gi0 = std::max(0, ti0 - steps);
+	int gi1 = std::min(m_rows + 2, ti1 + steps);
+	int gj0 = std::max(0, tj0 - steps);
+	int gj1 = std::min(m_cols + 2, tj1 + steps);
+	size_t width = (gj1 - gj0)*sizeof(double);
+
+	for (int gi = gi0; gi < gi1; gi++)
+	{
+		memcpy(s.u[0].row(gi - gi0), u.row(gi) + gj0, width);
+		memcpy(s.v.row(gi - gi0), v.row(gi) + gj0, width);
+	}
+
+	for (int step = 1; step <= steps; step++)
+	{
+		WaterField& src = s.u[(step - 1) % 2];
+		WaterField& dst = s.u[step % 2];
+
+		// cells still needed by the remaining steps
+		int e = steps - step;
+		int ci0 = std::max(1, ti0 - e);
+		int ci1 = std::min(m_rows + 1, ti1 + e);
+		int cj0 = std::max(1, tj0 - e);
+		int cj1 = std::min(m_cols + 1, tj1 + e);
+		int c = cj0 - gj0;
+
+		for (int gi = ci0; gi < ci1; gi++)
+		{
+			int r = gi - gi0;
+			kernel(src.row(r - 1) + c, src.row(r) + c, src.row(r + 1) + c,
+				s.v.row(r) + c, dst.row(r) + c, cj1 - cj0, k);
+		}
+
+		// clamp on edges of the grid, as WaterField::clamp_edges() does
+		if (cj0 == 1)
+			for (int gi = ci0; gi < ci1; gi++)
+				dst.row(gi - gi0)[0 - gj0] = dst.row(gi - gi0)[1 - gj0];
+		if (cj1 == m_cols + 1)
+			for (int gi = ci0; gi < ci1; gi++)
+				dst.row(gi - gi0)[m_cols + 1 - gj0] = dst.row(gi - gi0)[m_cols - gj0];
+		if (ci0 == 1)
+			memcpy(dst.row(0 - gi0), dst.row(1 - gi0), width);
+		if (ci1 == m_rows + 1)
+			memcpy(dst.row(m_rows + 1 - gi0), dst.row(m_rows - gi0), width);
+	}
+
+	const WaterField& result = s.u[steps % 2];
+	size_t core = (tj1 - tj0)*sizeof(double);
+	for (int gi = ti0; gi < ti1; gi++)
+	{
+		memcpy(u_out.row(gi) + tj0, result.row(gi - gi0) + (tj0 - gj0), core);
+		memcpy(v_out.row(gi) + tj0, s.v.row(gi - gi0) + (tj0 - gj0), core);
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef watertemporaltilingH
+#define watertemporaltilingH
+
+#include "water_field.h"
+#include "water_kernels.h"
+#include <vector>
+
+// Temporal blocking of the CPU wave solver (overlapped trapezoid tiling).
+// The grid is cut in tiles; a tile together with a halo of k cells is
+// copied to a per-worker scratch area small enough to stay in L2, advanced
+// there by k steps (the computed area shrinks by one cell per step) and its
+// core is written back. DRAM is therefore touched once per k steps instead
+// of once per step.
+// The same row kernel and the same edge clamp are used as in the one step
+// path, so the result is bit-identical to k single steps. Tiles only read
+// the input fields, so the output goes to separate u_out/v_out fields and
+// tiles can be processed in any order, by any number of workers.
+class WaterTemporalTiling
+{
+public:
+	WaterTemporalTiling();
+	~WaterTemporalTiling();
+
+	// rows x cols simulated grid, up to max_steps fused steps
+	bool init(int rows, int cols, int max_steps, int tile_rows, int tile_cols, int workers);
+	void release();
+
+	int get_tile_count() const { return m_tiles_x*m_tiles_z; }
+	int get_max_steps() const { return m_max_steps; }
+
+	// advances tile by steps (<= max_steps), the halo of u_out is not set
+	void run_tile(int worker, int tile, int steps,
+		const WaterField& u, const WaterField& v,
+		WaterField& u_out, WaterField& v_out,
+		WaveRowKernel kernel, const WaveCoeffs& k);
+
+private:
+	WaterTemporalTiling(const WaterTemporalTiling&);
+	WaterTemporalTiling& operator=(const WaterTemporalTiling&);
+
+	struct Scratch
+	{
+		WaterField u[2];
+		WaterField v;
+	};
+
+	int m_rows;
+	int m_cols;
+	int m_max_steps;
+	int m_tile_rows;
+	int m_tile_cols;
+	int m_tiles_x;
+	int m_tiles_z;
+	std::vector<Scratch*> m_scratch; // one per worker
+};
+
+#endif
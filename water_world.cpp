@@ -0,0 +1,475 @@
+#include "water_world.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#define M_PI 3.14159265358979323846
+
+
+WaterWorld::WaterWorld(
+		int chunks_x, int chunks_z, int chunk_cells, float cell_size,
+		float wave_speed, float dt, float damp_factor, uint64_t usec_step_time):
+	m_governor(usec_step_time)
+{
+	m_chunks_x = chunks_x;
+	m_chunks_z = chunks_z;
+	m_chunk_cells = chunk_cells;
+	m_cell_size = cell_size;
+	m_wave_speed = wave_speed;
+	m_dt = dt;
+	m_damp_factor = damp_factor;
+
+	m_max_resident = 0;
+	m_threshold = 1.0e-5;
+	m_row_kernel = wave_get_row_kernel(wave_detect_isa());
+	m_pending_steps = 0;
+	m_rest_level = 0.0;
+	m_focus_x = 0.0f;
+	m_focus_z = 0.0f;
+	m_focus_radius = 0.0f;
+}
+
+WaterWorld::~WaterWorld()
+{
+	release();
+}
+
+bool WaterWorld::init(int max_resident)
+{
+	release();
+	if (m_chunks_x <= 0 || m_chunks_z <= 0 || m_chunk_cells <= 0 || m_cell_size <= 0.0 || max_resident <= 0)
+	{
+		fprintf(stderr, "Invalid dimensions of water world.\n");
+		return false;
+	}
+
+	m_max_resident = max_resident;
+	m_coeffs = wave_make_coeffs(m_wave_speed, m_dt, m_damp_factor, m_cell_size, m_cell_size);
+	m_slot.assign(m_chunks_x*m_chunks_z, -1);
+	m_governor.reset(0);
+	m_rest_level = 0.0;
+	return true;
+}
+
+void WaterWorld::release()
+{
+	for (size_t a = 0; a < m_resident.size(); ++a)
+		delete m_resident[a];
+	for (size_t a = 0; a < m_free.size(); ++a)
+		delete m_free[a];
+	m_resident.clear();
+	m_free.clear();
+	m_slot.clear();
+	m_dormant.clear();
+}
+
+bool WaterWorld::set_thread_count(int threads, bool pin_threads)
+{
+	return m_pool.init(threads, pin_threads);
+}
+
+void WaterWorld::set_isa(WaveIsa isa)
+{
+	m_row_kernel = wave_get_row_kernel(isa);
+}
+
+int WaterWorld::resident_at(int cx, int cz) const
+{
+	if (cx < 0 || cz < 0 || cx >= m_chunks_x || cz >= m_chunks_z)
+		return -1;
+	return m_slot[chunk_index(cx, cz)];
+}
+
+double WaterWorld::distance_to_focus(int cx, int cz) const
+{
+	double size = m_chunk_cells*m_cell_size;
+	double dx = (cx + 0.5)*size - m_focus_x;
+	double dz = (cz + 0.5)*size - m_focus_z;
+	return sqrt(dx*dx + dz*dz);
+}
+
+void WaterWorld::set_focus(float x, float z, float radius)
+{
+	m_focus_x = x;
+	m_focus_z = z;
+	m_focus_radius = radius;
+	page();
+}
+
+void WaterWorld::update_model(uint64_t usec_time)
+{
+	int steps = m_governor.begin_frame(usec_time);
+	if (steps > 0 && !m_resident.empty())
+	{
+		// all steps in one pool run, chunks exchange halos between them
+		m_pending_steps = steps;
+		m_pool.run(step_task, this);
+		m_pending_steps = 0;
+	}
+	m_governor.end_frame(steps);
+	if (steps > 0)
+		page();
+}
+
+void WaterWorld::step_task(void* ctx, int worker, int workers)
+{
+	WaterWorld* world = static_cast<WaterWorld*>(ctx);
+	int count = int(world->m_resident.size());
+	int n = world->m_chunk_cells;
+	for (int s = 0; s < world->m_pending_steps; s++)
+	{
+		// halos read the interior of neighbouring chunks, which is
+		// only written in the next phase
+		for (int a = worker; a < count; a += workers)
+			world->fill_halo(*world->m_resident[a]);
+		world->m_pool.barrier();
+
+		for (int a = worker; a < count; a += workers)
+		{
+			Chunk& c = *world->m_resident[a];
+			for (int i = 1; i <= n; i++)
+				world->m_row_kernel(c.u.row(i - 1) + 1, c.u.row(i) + 1, c.u.row(i + 1) + 1,
+					c.v.row(i) + 1, c.u_new.row(i) + 1, n, world->m_coeffs);
+			c.u.swap(c.u_new);
+		}
+		world->m_pool.barrier();
+	}
+}
+
+double WaterWorld::outside_value(int cx, int cz, int i, int j) const
+{
+	int n = m_chunk_cells;
+	if (i < 1) { cx--; i += n; }
+	else if (i > n) { cx++; i -= n; }
+	if (j < 1) { cz--; j += n; }
+	else if (j > n) { cz++; j -= n; }
+
+	int r = resident_at(cx, cz);
+	if (r >= 0)
+		return m_resident[r]->u.at(i, j);
+	std::unordered_map<int, Dormant>::const_iterator d = m_dormant.find(chunk_index(cx, cz));
+	if (d != m_dormant.end())
+		return d->second.u[(i - 1)*n + j - 1]*double(d->second.u_scale);
+	// never touched, still water
+	return 0.0;
+}
+
+void WaterWorld::fill_halo(Chunk& c)
+{
+	int n = m_chunk_cells;
+	WaterField& u = c.u;
+
+	// top/bottom rows
+	for (int side = 0; side < 2; side++)
+	{
+		int i = side == 0 ? 0 : n + 1;
+		int inner = side == 0 ? 1 : n;
+		int ncx = c.cx + (side == 0 ? -1 : 1);
+		int r = resident_at(ncx, c.cz);
+		if (ncx < 0 || ncx >= m_chunks_x)
+			memcpy(u.row(i) + 1, u.row(inner) + 1, n*sizeof(double)); // shore
+		else if (r >= 0)
+			memcpy(u.row(i) + 1, m_resident[r]->u.row(side == 0 ? n : 1) + 1, n*sizeof(double));
+		else
+		{
+			for (int j = 1; j <= n; j++)
+				u.at(i, j) = outside_value(c.cx, c.cz, i, j);
+		}
+	}
+
+	// left/right columns (corners are not read by the stencil)
+	for (int side = 0; side < 2; side++)
+	{
+		int j = side == 0 ? 0 : n + 1;
+		int inner = side == 0 ? 1 : n;
+		int ncz = c.cz + (side == 0 ? -1 : 1);
+		if (ncz < 0 || ncz >= m_chunks_z)
+		{
+			for (int i = 1; i <= n; i++)
+				u.at(i, j) = u.at(i, inner);
+		}
+		else
+		{
+			for (int i = 1; i <= n; i++)
+				u.at(i, j) = outside_value(c.cx, c.cz, i, j);
+		}
+	}
+}
+
+double WaterWorld::activity(const Chunk& c, double edge[4]) const
+{
+	int n = m_chunk_cells;
+	double all = 0.0;
+	edge[0] = edge[1] = edge[2] = edge[3] = 0.0;
+	for (int i = 1; i <= n; i++)
+	{
+		const double* u = c.u.row(i);
+		const double* v = c.v.row(i);
+		double row = 0.0;
+		for (int j = 1; j <= n; j++)
+			row = std::max(row, std::max(fabs(u[j]), fabs(v[j])));
+		all = std::max(all, row);
+		if (i == 1)
+			edge[0] = row;
+		if (i == n)
+			edge[1] = row;
+		edge[2] = std::max(edge[2], std::max(fabs(u[1]), fabs(v[1])));
+		edge[3] = std::max(edge[3], std::max(fabs(u[n]), fabs(v[n])));
+	}
+	return all;
+}
+
+WaterWorld::Chunk* WaterWorld::page_in(int cx, int cz)
+{
+	int r = resident_at(cx, cz);
+	if (r >= 0)
+		return m_resident[r];
+
+	int n = m_chunk_cells;
+	Chunk* c = nullptr;
+	if (!m_free.empty())
+	{
+		c = m_free.back();
+		m_free.pop_back();
+	}
+	else
+	{
+		c = new Chunk();
+		if (!c->u.init(n, n) || !c->u_new.init(n, n) || !c->v.init(n, n))
+		{
+			delete c;
+			return nullptr;
+		}
+	}
+	c->cx = cx;
+	c->cz = cz;
+
+	std::unordered_map<int, Dormant>::iterator d = m_dormant.find(chunk_index(cx, cz));
+	if (d == m_dormant.end())
+	{
+		c->u.fill(0.0);
+		c->v.fill(0.0);
+	}
+	else
+	{
+		// resume from the frozen state
+		for (int i = 1; i <= n; i++)
+			for (int j = 1; j <= n; j++)
+			{
+				c->u.at(i, j) = d->second.u[(i - 1)*n + j - 1]*double(d->second.u_scale);
+				c->v.at(i, j) = d->second.v[(i - 1)*n + j - 1]*double(d->second.v_scale);
+			}
+		m_dormant.erase(d);
+	}
+
+	m_slot[chunk_index(cx, cz)] = int(m_resident.size());
+	m_resident.push_back(c);
+	return c;
+}
+
+void WaterWorld::page_out(int index)
+{
+	Chunk* c = m_resident[index];
+	int n = m_chunk_cells;
+
+	double max_u = 0.0;
+	double max_v = 0.0;
+	for (int i = 1; i <= n; i++)
+		for (int j = 1; j <= n; j++)
+		{
+			max_u = std::max(max_u, fabs(c->u.at(i, j)));
+			max_v = std::max(max_v, fabs(c->v.at(i, j)));
+		}
+
+	// still water is not stored, the rest is quantized to 16 bits
+	if (max_u > m_threshold || max_v > m_threshold)
+	{
+		Dormant& d = m_dormant[chunk_index(c->cx, c->cz)];
+		d.u_scale = max_u > 0.0 ? float(max_u/32767.0) : 1.0f;
+		d.v_scale = max_v > 0.0 ? float(max_v/32767.0) : 1.0f;
+		d.u.resize(n*n);
+		d.v.resize(n*n);
+		for (int i = 1; i <= n; i++)
+			for (int j = 1; j <= n; j++)
+			{
+				d.u[(i - 1)*n + j - 1] = wave_to_fixed(c->u.at(i, j), d.u_scale);
+				d.v[(i - 1)*n + j - 1] = wave_to_fixed(c->v.at(i, j), d.v_scale);
+			}
+	}
+
+	m_slot[chunk_index(c->cx, c->cz)] = -1;
+	m_resident[index] = m_resident.back();
+	m_resident.pop_back();
+	if (index < int(m_resident.size()))
+		m_slot[chunk_index(m_resident[index]->cx, m_resident[index]->cz)] = index;
+	m_free.push_back(c);
+}
+
+void WaterWorld::page()
+{
+	if (m_slot.empty())
+		return;
+
+	// chunks around the focus come first, nearest first
+	std::vector<std::pair<double, int> > wanted;
+	double size = m_chunk_cells*m_cell_size;
+	double reach = m_focus_radius + 0.5*size*sqrt(2.0);
+	int cx0 = std::max(0, int(floor((m_focus_x - reach)/size)));
+	int cx1 = std::min(m_chunks_x - 1, int(floor((m_focus_x + reach)/size)));
+	int cz0 = std::max(0, int(floor((m_focus_z - reach)/size)));
+	int cz1 = std::min(m_chunks_z - 1, int(floor((m_focus_z + reach)/size)));
+	for (int cx = cx0; cx <= cx1; cx++)
+		for (int cz = cz0; cz <= cz1; cz++)
+		{
+			double dist = distance_to_focus(cx, cz);
+			if (dist <= reach)
+				wanted.push_back(std::make_pair(dist, chunk_index(cx, cz)));
+		}
+
+	// then moving chunks, and the next chunk where waves reach an edge
+	for (size_t a = 0; a < m_resident.size(); ++a)
+	{
+		const Chunk& c = *m_resident[a];
+		double edge[4];
+		if (activity(c, edge) <= m_threshold)
+			continue;
+		int next[5][3] = {
+			{ c.cx, c.cz, 1 },
+			{ c.cx - 1, c.cz, edge[0] > m_threshold && c.cx > 0 },
+			{ c.cx + 1, c.cz, edge[1] > m_threshold && c.cx < m_chunks_x - 1 },
+			{ c.cx, c.cz - 1, edge[2] > m_threshold && c.cz > 0 },
+			{ c.cx, c.cz + 1, edge[3] > m_threshold && c.cz < m_chunks_z - 1 } };
+		for (int b = 0; b < 5; b++)
+			if (next[b][2])
+				wanted.push_back(std::make_pair(reach + distance_to_focus(next[b][0], next[b][1]),
+					chunk_index(next[b][0], next[b][1])));
+	}
+
+	// the first max_resident distinct chunks are kept
+	std::sort(wanted.begin(), wanted.end());
+	std::vector<int> keep;
+	for (size_t a = 0; a < wanted.size() && int(keep.size()) < m_max_resident; ++a)
+		if (std::find(keep.begin(), keep.end(), wanted[a].second) == keep.end())
+			keep.push_back(wanted[a].second);
+
+	for (int a = int(m_resident.size()) - 1; a >= 0; a--)
+	{
+		int index = chunk_index(m_resident[a]->cx, m_resident[a]->cz);
+		if (std::find(keep.begin(), keep.end(), index) == keep.end())
+			page_out(a);
+	}
+	for (size_t a = 0; a < keep.size(); ++a)
+		if (m_slot[keep[a]] < 0 && page_in(keep[a]/m_chunks_z, keep[a]%m_chunks_z) == nullptr)
+			break;
+
+	// a few spare chunks are kept for reuse
+	while (m_free.size() > 4)
+	{
+		delete m_free.back();
+		m_free.pop_back();
+	}
+}
+
+void WaterWorld::touch(float x, float z, double strength, double distance)
+{
+	if (distance <= 0.0 || m_slot.empty())
+		return;
+
+	int n = m_chunk_cells;
+	int cells_x = m_chunks_x*n;
+	int cells_z = m_chunks_z*n;
+	int i0 = std::max(0, int(floor((x - distance)/m_cell_size)));
+	int i1 = std::min(cells_x - 1, int(floor((x + distance)/m_cell_size)));
+	int j0 = std::max(0, int(floor((z - distance)/m_cell_size)));
+	int j1 = std::min(cells_z - 1, int(floor((z + distance)/m_cell_size)));
+	if (i0 > i1 || j0 > j1)
+		return;
+
+	// chunks under the brush are paged in first, making room by dropping
+	// the resident chunk farthest from the focus that is not under it
+	std::vector<int> brush;
+	for (int cx = i0/n; cx <= i1/n; cx++)
+		for (int cz = j0/n; cz <= j1/n; cz++)
+			brush.push_back(chunk_index(cx, cz));
+	for (size_t b = 0; b < brush.size(); ++b)
+	{
+		int cx = brush[b]/m_chunks_z;
+		int cz = brush[b]%m_chunks_z;
+		if (resident_at(cx, cz) >= 0)
+			continue;
+		if (int(m_resident.size()) >= m_max_resident)
+		{
+			int far = -1;
+			for (int a = 0; a < int(m_resident.size()); a++)
+			{
+				if (std::find(brush.begin(), brush.end(), chunk_index(m_resident[a]->cx, m_resident[a]->cz)) != brush.end())
+					continue;
+				if (far < 0 || distance_to_focus(m_resident[a]->cx, m_resident[a]->cz) >
+					distance_to_focus(m_resident[far]->cx, m_resident[far]->cz))
+					far = a;
+			}
+			if (far < 0)
+				break;
+			page_out(far);
+		}
+		if (page_in(cx, cz) == nullptr)
+			break;
+	}
+
+	double change_sum = 0.0;
+	for (size_t b = 0; b < brush.size(); ++b)
+	{
+		int cx = brush[b]/m_chunks_z;
+		int cz = brush[b]%m_chunks_z;
+		int r = resident_at(cx, cz);
+		if (r < 0)
+			continue;
+		Chunk* c = m_resident[r];
+
+		for (int gi = std::max(i0, cx*n); gi <= std::min(i1, cx*n + n - 1); gi++)
+			for (int gj = std::max(j0, cz*n); gj <= std::min(j1, cz*n + n - 1); gj++)
+			{
+				double x_dist = (gi + 0.5)*m_cell_size - x;
+				double z_dist = (gj + 0.5)*m_cell_size - z;
+				double dist = sqrt(x_dist*x_dist + z_dist*z_dist);
+				if (dist > distance)
+					continue;
+				double change = strength * (cos(dist/distance * M_PI) + 1.0) / 2.0;
+				c->u.at(gi - cx*n + 1, gj - cz*n + 1) -= change;
+				change_sum += change;
+			}
+	}
+	// volume is spread over the whole world, applied at readback
+	m_rest_level += change_sum/(double(cells_x)*double(cells_z));
+}
+
+double WaterWorld::get_height(float x, float z) const
+{
+	int n = m_chunk_cells;
+	int gi = std::min(std::max(int(floor(x/m_cell_size)), 0), m_chunks_x*n - 1);
+	int gj = std::min(std::max(int(floor(z/m_cell_size)), 0), m_chunks_z*n - 1);
+	int cx = gi/n;
+	int cz = gj/n;
+	int r = resident_at(cx, cz);
+	if (r >= 0)
+		return m_rest_level + m_resident[r]->u.at(gi - cx*n + 1, gj - cz*n + 1);
+	return m_rest_level + outside_value(cx, cz, gi - cx*n + 1, gj - cz*n + 1);
+}
+
+size_t WaterWorld::get_resident_bytes() const
+{
+	size_t bytes = 0;
+	for (size_t a = 0; a < m_resident.size(); ++a)
+		bytes += m_resident[a]->u.get_bytes() + m_resident[a]->u_new.get_bytes() + m_resident[a]->v.get_bytes();
+	for (size_t a = 0; a < m_free.size(); ++a)
+		bytes += m_free[a]->u.get_bytes() + m_free[a]->u_new.get_bytes() + m_free[a]->v.get_bytes();
+	return bytes;
+}
+
+size_t WaterWorld::get_dormant_bytes() const
+{
+	size_t bytes = 0;
+	for (std::unordered_map<int, Dormant>::const_iterator d = m_dormant.begin(); d != m_dormant.end(); ++d)
+		bytes += sizeof(Dormant) + (d->second.u.size() + d->second.v.size())*sizeof(short);
+	return bytes;
+}
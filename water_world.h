@@ -0,0 +1,120 @@
+#ifndef waterworldH
+#define waterworldH
+
+#include "water_field.h"
+#include "water_kernels.h"
+#include "thread_pool.h"
+#include "sim_governor.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Chunked water surface for domains too large to simulate at once.
+// The world is a chunks_x x chunks_z array of square chunks of
+// chunk_cells^2 cells. Only chunks near the focus (camera) and chunks
+// where waves are running are resident and simulated; their halos are
+// copied from the neighbouring chunks before every step, so resident
+// chunks behave as one grid. Other chunks are dormant: their state is
+// frozen and a chunk paged in again resumes from it. The number of
+// resident chunks (three double fields each) is bounded; dormant chunks
+// stay in RAM quantized to two shorts per cell, a sixth of a resident
+// chunk, and still water is not stored at all. Memory therefore grows
+// with the area disturbed so far, not with the world size, but it is
+// not bounded: there is no backing store on disk.
+class WaterWorld
+{
+public:
+	WaterWorld(
+		int chunks_x, int chunks_z, int chunk_cells, float cell_size,
+		float wave_speed, float dt, float damp_factor, uint64_t usec_step_time);
+	~WaterWorld();
+
+	bool init(int max_resident);
+	void release();
+
+	// positions are in world units, the world spans
+	// [0, chunks_x*chunk_cells*cell_size) x [0, chunks_z*chunk_cells*cell_size)
+	void set_focus(float x, float z, float radius);
+	void update_model(uint64_t usec_time);
+	// cosine brush like WaterSim::touch(), touched chunks are paged in;
+	// they evict only resident chunks outside of the brush, parts of a
+	// brush wider than max_resident chunks are ignored
+	void touch(float x, float z, double strength, double distance);
+	double get_height(float x, float z) const;
+
+	// chunks that move less than threshold are paged out when out of focus
+	void set_activity_threshold(double threshold) { m_threshold = threshold; }
+	bool set_thread_count(int threads, bool pin_threads);
+	int get_thread_count() const { return m_pool.get_thread_count(); }
+	void set_isa(WaveIsa isa);
+	SimGovernor& get_governor() { return m_governor; }
+	const SimGovernor& get_governor() const { return m_governor; }
+
+	int get_resident_count() const { return int(m_resident.size()); }
+	int get_dormant_count() const { return int(m_dormant.size()); }
+	size_t get_resident_bytes() const;
+	size_t get_dormant_bytes() const;
+	int get_chunk_cells() const { return m_chunk_cells; }
+
+private:
+	WaterWorld(const WaterWorld&);
+	WaterWorld& operator=(const WaterWorld&);
+
+	struct Chunk
+	{
+		int cx;
+		int cz;
+		WaterField u;
+		WaterField u_new;
+		WaterField v;
+	};
+	// frozen chunk, value = q*scale
+	struct Dormant
+	{
+		float u_scale;
+		float v_scale;
+		std::vector<short> u;
+		std::vector<short> v;
+	};
+
+	static void step_task(void* ctx, int worker, int workers);
+	void fill_halo(Chunk& c);
+	// neighbour value for halo cell (i, j) of chunk cx, cz (outside of it)
+	double outside_value(int cx, int cz, int i, int j) const;
+	void page();
+	Chunk* page_in(int cx, int cz);
+	void page_out(int index);
+	double activity(const Chunk& c, double edge[4]) const;
+	double distance_to_focus(int cx, int cz) const;
+	int chunk_index(int cx, int cz) const { return cx*m_chunks_z + cz; }
+	int resident_at(int cx, int cz) const;
+
+	// set by constructor
+	int m_chunks_x;
+	int m_chunks_z;
+	int m_chunk_cells;
+	double m_cell_size;
+	double m_wave_speed;
+	double m_dt;
+	double m_damp_factor;
+
+	// initialized in the init() method
+	int m_max_resident;
+	double m_threshold;
+	WaveCoeffs m_coeffs;
+	WaveRowKernel m_row_kernel;
+	ThreadPool m_pool;
+	int m_pending_steps;
+	SimGovernor m_governor;
+	double m_rest_level; // volume pushed out by touches, spread over the world
+	float m_focus_x;
+	float m_focus_z;
+	float m_focus_radius;
+
+	std::vector<Chunk*> m_resident;
+	std::vector<Chunk*> m_free;
+	std::vector<int> m_slot; // resident index per chunk or -1
+	std::unordered_map<int, Dormant> m_dormant;
+};
+
+#endif